@@ -3,8 +3,8 @@
    Program:    chisq
    File:       chisq.c
    
-   Version:    V1.2
-   Date:       09.02.94
+   Version:    V1.4
+   Date:       16.10.26
    Function:   Do statistical analysis of seqan output
    
    Copyright:  (c) Dr. Andrew C. R. Martin, 1994
@@ -33,6 +33,15 @@
 
    Description:
    ============
+   Reads the output of seqan, which has a block of residue pair counts
+   for each pair of positions starting with a "Pair:" line, and gives
+   a contingency table and Chi squared for each block.
+
+   Each block is held in its own BLOCK with the options, so blocks may
+   be computed at the same time. With -t, the blocks are read by the 
+   main thread, computed by a pool of threads into a memory stream 
+   each and written in order by a writer thread, so the output is the
+   same as from a single thread.
 
 **************************************************************************
 
@@ -51,6 +60,15 @@
    V1.0  03.02.94 Original
    V1.1  04.02.94 Fixed bug in ClearArray()
    V1.2  09.02.94 Added ChiSq calculation of individual data items
+   V1.3  16.10.26 The data and options are held in a BLOCK for each 
+                  Pair block rather than in globals. Added -t to compute
+                  the blocks on a pool of threads
+   V1.4  16.10.26 Input is read in large blocks and split into lines of
+                  any length rather than with fgets() into 80 characters.
+                  Residues are looked up in a table and counts parsed
+                  directly. Fixed TERMINATE which only checked the first
+                  character so the Pair: line was printed with its 
+                  newline
 
 
 *************************************************************************/
@@ -60,6 +78,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <pthread.h>
 
 /***********************************************************************/
 /* Defines
@@ -74,48 +93,101 @@
 #define BIN_FIRST   1
 #define BIN_SECOND  2
 #define SMALL       ((double)1e-10)
-#define TERMINATE(x) {                                            \
-                         int i;                                   \
-                         for(i=0; (x)[i]; i++)                    \
-                         {                                        \
-                            if((x)[i] == '\n') (x)[i] = '\0';     \
-                            break;                                \
-                         }                                        \
-                      }
-
+#define READSIZE    (4*1024*1024) /* Bytes read from the file at once */
+#define MAXTHREADS  256
+#define BLOCKSPERTHREAD 4    /* Blocks read ahead for each thread      */
+#define HEADER_NONE  0       /* Header printed before a block          */
+#define HEADER_FIRST 1
+#define HEADER_NEXT  2
 
 /***********************************************************************/
 /* Type definitions
 */
 typedef int BOOL;
 
+typedef struct
+{
+   BOOL Wide,                  /* Print results in wide format          */
+        Individual;            /* Show ChiSq on each item of data       */
+   int  MinBin,                /* Residues seen less are binned         */
+        NThreads;              /* Threads to compute blocks             */
+}  OPTIONS;
+
+typedef struct
+{
+   int     Data[MAXAA][MAXAA]; /* Counts for each residue pair          */
+   char    *Pair;              /* The Pair: line starting the block     */
+   size_t  PairSize;           /* Allocated size of Pair                */
+   int     Header;             /* HEADER_NONE, _FIRST or _NEXT          */
+   OPTIONS *Options;
+   char    *Output;            /* Report on the block (threaded)        */
+   size_t  OutputLen;
+   BOOL    Done;               /* Output is ready to be written         */
+}  BLOCK;
+
+typedef struct
+{
+   FILE   *fp;
+   char   *buffer,             /* Data read from the file               */
+          *Pair;               /* Pair: line which ended the last block */
+   size_t size,                /* Allocated size of buffer              */
+          start,               /* Start of the next line in buffer      */
+          end,                 /* End of the data in buffer             */
+          PairSize;            /* Allocated size of Pair                */
+   BOOL   eof,                 /* All of the file is in buffer          */
+          FirstCall;
+}  READER;
+
+typedef struct
+{
+   BLOCK           **Blocks;   /* Ring of blocks read but not written   */
+   int             NSlots,     /* Size of the ring                      */
+                   NRead,      /* Blocks read                           */
+                   NStarted,   /* Blocks taken by a thread              */
+                   NWritten;   /* Blocks written                        */
+   BOOL            Eof;        /* All blocks have been read             */
+   pthread_mutex_t Lock;
+   pthread_cond_t  Changed;    /* Signalled whenever a count changes    */
+}  POOL;
+
 /***********************************************************************/
 /* Globals
 */
-int  gData[MAXAA][MAXAA];
 char gAAtab[]    = "ACDEFGHIKLMNPQRSTVWYB"; /* B is used for the bin   */
-BOOL gWide       = FALSE,
-     gIndividual = FALSE;
-int  gMinBin     = MINBIN;
+int  gAAIndex[256];                         /* Position of each residue
+                                               in gAAtab or -1          */
 
 /***********************************************************************/
 /* Prototypes
 */
 int main(int argc, char **argv);
 BOOL Initialise(void);
-BOOL ParseCmdLine(int argc, char **argv, char *filename);
+BOOL ParseCmdLine(int argc, char **argv, char *filename, 
+                  OPTIONS *options);
 void Usage(void);
-BOOL ProcessExample(FILE *fp);
-void ClearArray(void);
-void StoreData(char *buffer);
+BOOL InitReader(READER *reader, FILE *fp);
+void FreeReader(READER *reader);
+BOOL NextLine(READER *reader, char **line, size_t *len);
+void CopyLine(char **copy, size_t *size, char *line, size_t len);
+BOOL ReadExample(READER *reader, BLOCK *block);
+void ProcessExample(BLOCK *block, FILE *out);
+void ProcessAll(READER *reader, OPTIONS *options);
+void ProcessThreaded(READER *reader, OPTIONS *options);
+void *BlockWorker(void *arg);
+void *BlockWriter(void *arg);
+BLOCK *NewBlock(OPTIONS *options);
+void ClearArray(BLOCK *block);
+void StoreData(BLOCK *block, char *buffer);
+void FreeBlock(BLOCK *block);
 BOOL Lookup(char First, char Second, int *pos1, int *pos2);
-void ProcessData(void);
+void ProcessData(BLOCK *block, FILE *out);
 char LookDown(int pos);
-void PrintObsExpTable(double Expected[MAXAA][MAXAA]);
+void PrintObsExpTable(BLOCK *block, double Expected[MAXAA][MAXAA], 
+                      FILE *out);
 void CalcExpected(int *FirstTotal, int *SecondTotal, int NObs, 
                   double Expected[MAXAA][MAXAA]);
-void BinResidues(int flag, int *totals);
-void ShowTotals(int *FirstTotal, int *SecondTotal);
+void BinResidues(BLOCK *block, int flag, int *totals, FILE *out);
+void ShowTotals(int *FirstTotal, int *SecondTotal, FILE *out);
 void PrintHeader(void);
 
 /***********************************************************************/
@@ -124,17 +196,22 @@ void PrintHeader(void);
    ChiSq main program
 
    03.02.94 Original   By: ACRM
+   16.10.26 Options are held in an OPTIONS. Blocks are read and 
+            processed by ProcessAll() or ProcessThreaded()
+   16.10.26 Reads with a READER from InitReader()
 */
 int main(int argc, char **argv)
 {
-   char filename[160];
-   FILE *fp;
+   char    filename[160];
+   FILE    *fp;
+   OPTIONS options;
+   READER  reader;
    
    if(Initialise())
    {
       PrintHeader();
       
-      if(ParseCmdLine(argc, argv, filename))
+      if(ParseCmdLine(argc, argv, filename, &options))
       {
          if(!filename[0])
             fp = stdin;
@@ -146,9 +223,18 @@ int main(int argc, char **argv)
             fprintf(stderr,"Unable to open input file %s\n",filename);
             exit(1);
          }
+         else if(!InitReader(&reader, fp))
+         {
+            fprintf(stderr,"No memory for input buffer\n");
+            exit(1);
+         }
          else
          {
-            while(ProcessExample(fp)) ;
+            if(options.NThreads > 1)
+               ProcessThreaded(&reader, &options);
+            else
+               ProcessAll(&reader, &options);
+            FreeReader(&reader);
          }
       }
       else
@@ -165,29 +251,45 @@ int main(int argc, char **argv)
 /***********************************************************************/
 /*>BOOL Initialise(void)
    ---------------------
-   Initialisation (dummy)
+   Initialisation. Builds the table of residue positions in gAAtab
 
-   03.02.94 Original   By: ACRM
+   03.02.94 Original (dummy)   By: ACRM
+   16.10.26 Builds gAAIndex
 */
 BOOL Initialise(void)
 {
+   int i;
+
+   for(i=0; i<256; i++)
+      gAAIndex[i] = (-1);
+   for(i=0; gAAtab[i]; i++)
+      gAAIndex[(unsigned char)gAAtab[i]] = i;
+   
    return(TRUE);
 }
 
 /***********************************************************************/
-/*>BOOL ParseCmdLine(int argc, char **argv, char *filename)
-   --------------------------------------------------------
+/*>BOOL ParseCmdLine(int argc, char **argv, char *filename, 
+                     OPTIONS *options)
+   ---------------------------------------------------------
    Parse the command line getting switches and the filename.
 
    03.02.94 Original   By: ACRM
    09.02.94 Added -i
+   16.10.26 Switches are returned in options. Added -t. Returns TRUE
+            when reading from stdin
 */
-BOOL ParseCmdLine(int argc, char **argv, char *filename)
+BOOL ParseCmdLine(int argc, char **argv, char *filename, 
+                  OPTIONS *options)
 {
    argc--;
    argv++;
 
    filename[0] = '\0';
+   options->Wide       = FALSE;
+   options->Individual = FALSE;
+   options->MinBin     = MINBIN;
+   options->NThreads   = 1;
       
    while(argc>0)
    {
@@ -196,15 +298,23 @@ BOOL ParseCmdLine(int argc, char **argv, char *filename)
          switch(argv[0][1])
          {
          case 'w':
-            gWide = TRUE;
+            options->Wide = TRUE;
             break;
          case 'm':
             argv++; argc--;
-            gMinBin = atoi(argv[0]);
+            options->MinBin = atoi(argv[0]);
             break;
          case 'i':
-            gIndividual = TRUE;
-            gWide       = TRUE;
+            options->Individual = TRUE;
+            options->Wide       = TRUE;
+            break;
+         case 't':
+            argv++; argc--;
+            if(!argc)
+               return(FALSE);
+            options->NThreads = atoi(argv[0]);
+            if(options->NThreads < 1 || options->NThreads > MAXTHREADS)
+               return(FALSE);
             break;
          case 'h': case '?':
             Usage();
@@ -229,6 +339,7 @@ BOOL ParseCmdLine(int argc, char **argv, char *filename)
       argc--;
       argv++;
    }
+   return(TRUE);
 }
 
 /***********************************************************************/
@@ -238,131 +349,519 @@ BOOL ParseCmdLine(int argc, char **argv, char *filename)
 
    03.02.94 Original   By: ACRM
    09.02.94 Added -i
+   16.10.26 Added -t
+   17.10.26 Prints the current version
 */
 void Usage(void)
 {
-   printf("chisq V1.0 - A program to calculate Chi Squared from output of \
+   printf("chisq V1.4 - A program to calculate Chi Squared from output of \
 seqan\n");
-   printf("Usage: chisq [-w] [-m <min>] [-h] [file.in]\n");
+   printf("Usage: chisq [-w] [-m <min>] [-i] [-t <threads>] [-h] \
+[file.in]\n");
    printf("If an input file is not specified, input is read from stdin\n");
    printf("       -w Print results in wide format\n");
    printf("       -m Specify max frequency for binning (default: %d)\n",
           MINBIN);
    printf("       -i Show ChiSq on each item of data\n");
+   printf("       -t Number of threads to compute the blocks \
+(default: 1)\n");
    printf("       -h/-? This help message\n");
 }
 
 /***********************************************************************/
-/*>BOOL ProcessExample(FILE *fp)
-   -----------------------------
-   Read data from ffile for a single residue pair and call processing
-   routines
+/*>BOOL InitReader(READER *reader, FILE *fp)
+   -----------------------------------------
+   Set up a reader for a file. Returns FALSE if there is no memory for 
+   the buffer
 
-   03.02.94 Original   By: ACRM
-   09.02.94 Added separator line
+   16.10.26 Original   By: ACRM
 */
-BOOL ProcessExample(FILE *fp)
+BOOL InitReader(READER *reader, FILE *fp)
 {
-   static BOOL FirstCall = TRUE;
-   static char buffer[80];
-      
-   ClearArray();
+   reader->fp        = fp;
+   reader->size      = READSIZE;
+   reader->start     = reader->end = 0;
+   reader->eof       = FALSE;
+   reader->FirstCall = TRUE;
+   reader->Pair      = NULL;
+   reader->PairSize  = 0;
+
+   /* The extra byte leaves room to terminate a last line with no 
+      newline
+   */
+   if((reader->buffer = (char *)malloc(reader->size + 1)) == NULL)
+      return(FALSE);
+   return(TRUE);
+}
+
+/***********************************************************************/
+/*>void FreeReader(READER *reader)
+   -------------------------------
+   Free the buffers of a reader
+
+   16.10.26 Original   By: ACRM
+*/
+void FreeReader(READER *reader)
+{
+   free(reader->buffer);
+   free(reader->Pair);
+}
+
+/***********************************************************************/
+/*>BOOL NextLine(READER *reader, char **line, size_t *len)
+   -------------------------------------------------------
+   Return the next line in the reader's buffer, reading more of the file
+   as required. The newline (and any carriage return before it) is 
+   replaced by a '\0'. The buffer is grown if a line does not fit. 
+   Returns FALSE at the end of the file.
+
+   16.10.26 Original   By: ACRM
+*/
+BOOL NextLine(READER *reader, char **line, size_t *len)
+{
+   char   *eol;
+   size_t nread;
    
-   /* If not the first call, then display the buffer from the last go    */
-   if(!FirstCall)
+   for(;;)
    {
-      if(gWide)
-         fprintf(stdout,"\n========================================\
-=====================================================================\
-======================\n");
-      else
-         fprintf(stdout,"\n========================================\
-========================================\n");
-      fprintf(stdout,"%s\n",buffer);
+      if((eol = memchr(reader->buffer + reader->start, '\n', 
+                       reader->end - reader->start)) != NULL)
+         break;
+
+      if(reader->eof)
+      {
+         /* A last line with no newline                                  */
+         if(reader->start == reader->end)
+            return(FALSE);
+         eol = reader->buffer + reader->end;
+         break;
+      }
+
+      /* Move the partial line to the start of the buffer and fill the 
+         rest, growing the buffer if the line fills it
+      */
+      if(reader->start)
+      {
+         memmove(reader->buffer, reader->buffer + reader->start,
+                 reader->end - reader->start);
+         reader->end  -= reader->start;
+         reader->start = 0;
+      }
+      else if(reader->end == reader->size)
+      {
+         char *buffer;
+         
+         if((buffer = (char *)realloc(reader->buffer, 
+                                      2 * reader->size + 1)) == NULL)
+         {
+            fprintf(stderr,"No memory for input line\n");
+            exit(1);
+         }
+         reader->buffer = buffer;
+         reader->size  *= 2;
+      }
+      
+      nread = fread(reader->buffer + reader->end, 1, 
+                    reader->size - reader->end, reader->fp);
+      reader->end += nread;
+      if(nread == 0)
+         reader->eof = TRUE;
    }
 
-   while(fgets(buffer,80,fp))
+   *line = reader->buffer + reader->start;
+   *len  = eol - *line;
+   reader->start = (eol - reader->buffer) + 
+                   (eol < reader->buffer + reader->end);
+
+   if(*len && (*line)[*len - 1] == '\r')
+      (*len)--;
+   (*line)[*len] = '\0';
+
+   return(TRUE);
+}
+
+/***********************************************************************/
+/*>void CopyLine(char **copy, size_t *size, char *line, size_t len)
+   ----------------------------------------------------------------
+   Copy a line into a buffer of *size bytes, growing it as required
+
+   16.10.26 Original   By: ACRM
+*/
+void CopyLine(char **copy, size_t *size, char *line, size_t len)
+{
+   if(len >= *size)
    {
-      TERMINATE(buffer);
+      free(*copy);
+      *size = len + 1;
+      if((*copy = (char *)malloc(*size)) == NULL)
+      {
+         fprintf(stderr,"No memory for Pair line\n");
+         exit(1);
+      }
+   }
+   memcpy(*copy, line, len + 1);
+}
 
-      if(!strncmp(buffer,"Pair:",5))
+/***********************************************************************/
+/*>BOOL ReadExample(READER *reader, BLOCK *block)
+   ----------------------------------------------
+   Read data from file for a single residue pair into a block
+
+   03.02.94 Original (as ProcessExample())   By: ACRM
+   09.02.94 Added separator line
+   16.10.26 Reads into a block which is processed by ProcessExample().
+            The state between calls is kept in the READER
+   16.10.26 Reads lines of any length with NextLine()
+*/
+BOOL ReadExample(READER *reader, BLOCK *block)
+{
+   char   *line;
+   size_t len;
+   
+   ClearArray(block);
+   block->Header = HEADER_NONE;
+   
+   /* If not the first call, then display the Pair line from the last go */
+   if(!reader->FirstCall)
+   {
+      block->Header = HEADER_NEXT;
+      CopyLine(&(block->Pair), &(block->PairSize), reader->Pair, 
+               strlen(reader->Pair));
+   }
+
+   while(NextLine(reader, &line, &len))
+   {
+      if(!strncmp(line,"Pair:",5))
       {
-         if(FirstCall)
+         if(reader->FirstCall)
          {
             /* If it's the first call, this is the first time a Pair line
                has been seen, so display it.
             */
-            fprintf(stdout,"\n\n%s\n",buffer);
-            FirstCall=FALSE;
+            block->Header = HEADER_FIRST;
+            CopyLine(&(block->Pair), &(block->PairSize), line, len);
+            reader->FirstCall=FALSE;
          }
          else
          {
             /* Not the first call and a Pair line seen, so it's the end
                of this dataset.
             */
-            ProcessData();
+            CopyLine(&(reader->Pair), &(reader->PairSize), line, len);
             return(TRUE);
          }
       }
-      else if(buffer[2]==':')
+      else if(len > 2 && line[2]==':')
       {
          /* It's a data line                                              */
-         StoreData(buffer);
+         StoreData(block, line);
       }
    }
    
-   ProcessData();
    return(FALSE);
 }
 
 /***********************************************************************/
-/*>void ClearArray(void)
-   ---------------------
+/*>void ProcessExample(BLOCK *block, FILE *out)
+   --------------------------------------------
+   Print the header for a block and process it
+
+   16.10.26 Original (from ProcessExample())   By: ACRM
+*/
+void ProcessExample(BLOCK *block, FILE *out)
+{
+   if(block->Header == HEADER_FIRST)
+   {
+      fprintf(out,"\n\n%s\n",block->Pair);
+   }
+   else if(block->Header == HEADER_NEXT)
+   {
+      if(block->Options->Wide)
+         fprintf(out,"\n========================================\
+=====================================================================\
+======================\n");
+      else
+         fprintf(out,"\n========================================\
+========================================\n");
+      fprintf(out,"%s\n",block->Pair);
+   }
+   
+   ProcessData(block, out);
+}
+
+/***********************************************************************/
+/*>void ProcessAll(READER *reader, OPTIONS *options)
+   -------------------------------------------------
+   Read and process each block in turn
+
+   16.10.26 Original   By: ACRM
+*/
+void ProcessAll(READER *reader, OPTIONS *options)
+{
+   BLOCK *block;
+   BOOL  more;
+
+   block = NewBlock(options);
+   do
+   {
+      more = ReadExample(reader, block);
+      ProcessExample(block, stdout);
+   }  while(more);
+   FreeBlock(block);
+}
+
+/***********************************************************************/
+/*>void ProcessThreaded(READER *reader, OPTIONS *options)
+   ------------------------------------------------------
+   Read the blocks into a ring which is shared with a pool of threads
+   which process them and a writer thread which writes their output in
+   the order they were read. Reading waits while the ring is full so 
+   only a few blocks for each thread are held at once.
+
+   16.10.26 Original   By: ACRM
+*/
+void ProcessThreaded(READER *reader, OPTIONS *options)
+{
+   POOL      pool;
+   pthread_t *threads,
+             writer;
+   BLOCK     *block;
+   BOOL      more;
+   int       i;
+
+   pool.NSlots   = options->NThreads * BLOCKSPERTHREAD;
+   pool.NRead    = pool.NStarted = pool.NWritten = 0;
+   pool.Eof      = FALSE;
+   pthread_mutex_init(&(pool.Lock), NULL);
+   pthread_cond_init(&(pool.Changed), NULL);
+   
+   if(((pool.Blocks = (BLOCK **)malloc(pool.NSlots * sizeof(BLOCK *)))
+       == NULL) ||
+      ((threads = (pthread_t *)malloc(options->NThreads * 
+                                      sizeof(pthread_t))) == NULL))
+   {
+      fprintf(stderr,"No memory for threads\n");
+      exit(1);
+   }
+
+   for(i=0; i<options->NThreads; i++)
+   {
+      if(pthread_create(&(threads[i]), NULL, BlockWorker, &pool))
+      {
+         fprintf(stderr,"Unable to create thread\n");
+         exit(1);
+      }
+   }
+   if(pthread_create(&writer, NULL, BlockWriter, &pool))
+   {
+      fprintf(stderr,"Unable to create thread\n");
+      exit(1);
+   }
+
+   do
+   {
+      block = NewBlock(options);
+      more  = ReadExample(reader, block);
+
+      pthread_mutex_lock(&(pool.Lock));
+      while(pool.NRead - pool.NWritten >= pool.NSlots)
+         pthread_cond_wait(&(pool.Changed), &(pool.Lock));
+      pool.Blocks[pool.NRead % pool.NSlots] = block;
+      pool.NRead++;
+      pool.Eof = !more;
+      pthread_cond_broadcast(&(pool.Changed));
+      pthread_mutex_unlock(&(pool.Lock));
+   }  while(more);
+
+   for(i=0; i<options->NThreads; i++)
+      pthread_join(threads[i], NULL);
+   pthread_join(writer, NULL);
+
+   pthread_mutex_destroy(&(pool.Lock));
+   pthread_cond_destroy(&(pool.Changed));
+   free(pool.Blocks);
+   free(threads);
+}
+
+/***********************************************************************/
+/*>void *BlockWorker(void *arg)
+   ----------------------------
+   Thread which takes the next block which has been read and processes
+   it into a memory stream
+
+   16.10.26 Original   By: ACRM
+*/
+void *BlockWorker(void *arg)
+{
+   POOL  *pool = (POOL *)arg;
+   BLOCK *block;
+   FILE  *out;
+
+   for(;;)
+   {
+      pthread_mutex_lock(&(pool->Lock));
+      while(pool->NStarted == pool->NRead && !pool->Eof)
+         pthread_cond_wait(&(pool->Changed), &(pool->Lock));
+      if(pool->NStarted == pool->NRead)
+      {
+         pthread_mutex_unlock(&(pool->Lock));
+         return(NULL);
+      }
+      block = pool->Blocks[pool->NStarted % pool->NSlots];
+      pool->NStarted++;
+      pthread_mutex_unlock(&(pool->Lock));
+
+      if((out = open_memstream(&(block->Output), &(block->OutputLen)))
+         == NULL)
+      {
+         fprintf(stderr,"No memory for output\n");
+         exit(1);
+      }
+      ProcessExample(block, out);
+      if(fclose(out))
+      {
+         fprintf(stderr,"No memory for output\n");
+         exit(1);
+      }
+
+      pthread_mutex_lock(&(pool->Lock));
+      block->Done = TRUE;
+      pthread_cond_broadcast(&(pool->Changed));
+      pthread_mutex_unlock(&(pool->Lock));
+   }
+}
+
+/***********************************************************************/
+/*>void *BlockWriter(void *arg)
+   ----------------------------
+   Thread which writes the output of each block to stdout in the order
+   the blocks were read, freeing the block to make room in the ring
+
+   16.10.26 Original   By: ACRM
+*/
+void *BlockWriter(void *arg)
+{
+   POOL  *pool = (POOL *)arg;
+   BLOCK *block;
+
+   for(;;)
+   {
+      pthread_mutex_lock(&(pool->Lock));
+      while(!(pool->NWritten < pool->NRead && 
+              pool->Blocks[pool->NWritten % pool->NSlots]->Done) &&
+            !(pool->Eof && pool->NWritten == pool->NRead))
+         pthread_cond_wait(&(pool->Changed), &(pool->Lock));
+      if(pool->NWritten == pool->NRead)
+      {
+         pthread_mutex_unlock(&(pool->Lock));
+         return(NULL);
+      }
+      block = pool->Blocks[pool->NWritten % pool->NSlots];
+      pthread_mutex_unlock(&(pool->Lock));
+
+      fwrite(block->Output, 1, block->OutputLen, stdout);
+      FreeBlock(block);
+
+      pthread_mutex_lock(&(pool->Lock));
+      pool->NWritten++;
+      pthread_cond_broadcast(&(pool->Changed));
+      pthread_mutex_unlock(&(pool->Lock));
+   }
+}
+
+/***********************************************************************/
+/*>BLOCK *NewBlock(OPTIONS *options)
+   ---------------------------------
+   Allocate a block
+
+   16.10.26 Original   By: ACRM
+*/
+BLOCK *NewBlock(OPTIONS *options)
+{
+   BLOCK *block;
+
+   if((block = (BLOCK *)malloc(sizeof(BLOCK))) == NULL)
+   {
+      fprintf(stderr,"No memory for data\n");
+      exit(1);
+   }
+   block->Options   = options;
+   block->Output    = NULL;
+   block->OutputLen = 0;
+   block->Done      = FALSE;
+   block->Pair      = NULL;
+   block->PairSize  = 0;
+   return(block);
+}
+
+/***********************************************************************/
+/*>void FreeBlock(BLOCK *block)
+   ----------------------------
+   Free a block
+
+   16.10.26 Original   By: ACRM
+*/
+void FreeBlock(BLOCK *block)
+{
+   free(block->Output);
+   free(block->Pair);
+   free(block);
+}
+
+/***********************************************************************/
+/*>void ClearArray(BLOCK *block)
+   -----------------------------
    Clear the data array
 
    03.02.94 Original   By: ACRM
    04.02.94 Corrected count to MAXAA rather than 20
+   16.10.26 Clears the array in a block
 */
-void ClearArray(void)
+void ClearArray(BLOCK *block)
 {
    int i,j;
    
    for(i=0; i<MAXAA; i++)
       for(j=0; j<MAXAA; j++)
-         gData[i][j] = 0;
+         block->Data[i][j] = 0;
 }
 
 /***********************************************************************/
-/*>void StoreData(char *buffer)
-   ----------------------------
-   Store a line of data in the data array
+/*>void StoreData(BLOCK *block, char *buffer)
+   -------------------------------------------
+   Store a line of data in the data array. The line is of the form
+   "XY: n, p%" and only the count, n, is used.
    03.02.94 Original   By: ACRM
+   16.10.26 Stores in a block
+   16.10.26 Parses the count directly rather than with strlen() and
+            atoi()
 */
-void StoreData(char *buffer)
+void StoreData(BLOCK *block, char *buffer)
 {
-   char First,
-        Second;
-   int  i,
-        ndata,
+   char *ch;
+   int  ndata = 0,
+        sign  = 1,
         pos1,
         pos2;
 
-   First  = buffer[0];
-   Second = buffer[1];
-
-   for(i=0; i<strlen(buffer); i++)
+   if(!Lookup(buffer[0],buffer[1],&pos1,&pos2))
+      return;
+   
+   for(ch=buffer+3; *ch==' ' || *ch=='\t'; ch++) ;
+   if(*ch == '-')
    {
-      if(buffer[i] == ',')
-      {
-         buffer[i] = '\0';
-         break;
-      }
+      sign = (-1);
+      ch++;
+   }
+   else if(*ch == '+')
+   {
+      ch++;
    }
    
-   ndata = atoi(buffer+3);
+   for(; *ch>='0' && *ch<='9'; ch++)
+      ndata = 10*ndata + (*ch - '0');
 
-   if(Lookup(First,Second,&pos1,&pos2))
-      gData[pos1][pos2] = ndata;
+   block->Data[pos1][pos2] = sign * ndata;
 }
 
 /***********************************************************************/
@@ -371,18 +870,12 @@ void StoreData(char *buffer)
    Look up the array positions for a residue pair
 
    03.02.94 Original   By: ACRM
+   16.10.26 Uses gAAIndex rather than searching gAAtab
 */
 BOOL Lookup(char First, char Second, int *pos1, int *pos2)
 {
-   int i;
-   
-   *pos1 = *pos2 = (-1);
-
-   for(i=0; gAAtab[i]; i++)
-   {
-      if(gAAtab[i]==First)  *pos1 = i;
-      if(gAAtab[i]==Second) *pos2 = i;
-   }
+   *pos1 = gAAIndex[(unsigned char)First];
+   *pos2 = gAAIndex[(unsigned char)Second];
    
    if(*pos1 == (-1) || *pos2 == (-1))
       return(FALSE);
@@ -403,14 +896,15 @@ char LookDown(int pos)
 }
 
 /***********************************************************************/
-/*>void ProcessData(void)
-   ----------------------
+/*>void ProcessData(BLOCK *block, FILE *out)
+   -----------------------------------------
    Process the data. Calculate expected values, perform binning and 
    recalcultlate. Calculate ChiSq
 
    03.02.94 Original   By: ACRM
+   16.10.26 Processes a block and writes to out
 */
-void ProcessData(void)
+void ProcessData(BLOCK *block, FILE *out)
 {
    int    FirstTotal[MAXAA],
           SecondTotal[MAXAA],
@@ -436,12 +930,12 @@ void ProcessData(void)
    /* Sum the residue occurences for first position                   */
    for(i=0; i<MAXAA; i++)
       for(j=0; j<MAXAA; j++)
-         FirstTotal[i] += gData[i][j];
+         FirstTotal[i] += block->Data[i][j];
       
    /* Sum the residue occurences for second position                  */
    for(j=0; j<MAXAA; j++)
       for(i=0; i<MAXAA; i++)
-         SecondTotal[j] += gData[i][j];
+         SecondTotal[j] += block->Data[i][j];
 
    /* Calculate total number of observations                          */
    for(i=0, NObs=0; i<MAXAA; i++)
@@ -451,26 +945,26 @@ void ProcessData(void)
    CalcExpected(FirstTotal, SecondTotal, NObs, Expected);
 
    /* Print raw results                                              */
-   printf("Raw results:\n============\n\n");
-   printf("Number of observations: %d\n",NObs);
-   ShowTotals(FirstTotal, SecondTotal);
-   PrintObsExpTable(Expected);
+   fprintf(out,"Raw results:\n============\n\n");
+   fprintf(out,"Number of observations: %d\n",NObs);
+   ShowTotals(FirstTotal, SecondTotal, out);
+   PrintObsExpTable(block, Expected, out);
    
-   /* Now move all residues with <gMinBin occurences into the bins     */
-   printf("\nThe following residues at the first position are now \
+   /* Now move all residues with <MinBin occurences into the bins     */
+   fprintf(out,"\nThe following residues at the first position are now \
 grouped:\n");
-   BinResidues(BIN_FIRST,FirstTotal);
-   printf("\nThe following residues at the second position are now \
+   BinResidues(block, BIN_FIRST, FirstTotal, out);
+   fprintf(out,"\nThe following residues at the second position are now \
 grouped:\n");
-   BinResidues(BIN_SECOND,SecondTotal);
+   BinResidues(block, BIN_SECOND, SecondTotal, out);
 
    /* Recalculate all expected values                                  */
    CalcExpected(FirstTotal, SecondTotal, NObs, Expected);
    
    /* Show the binned results                                          */
-   printf("\n\nBinned results:\n===============\n");
-   ShowTotals(FirstTotal, SecondTotal);
-   PrintObsExpTable(Expected);
+   fprintf(out,"\n\nBinned results:\n===============\n");
+   ShowTotals(FirstTotal, SecondTotal, out);
+   PrintObsExpTable(block, Expected, out);
 
    /* Calculate the ChiSq value.                                       */
    ChiSq = 0.0;
@@ -479,8 +973,8 @@ grouped:\n");
       for(j=0; j<MAXAA; j++)
       {
          if(FirstTotal[i] && SecondTotal[j])
-            ChiSq += ((gData[i][j] - Expected[i][j]) * 
-                      (gData[i][j] - Expected[i][j]) / 
+            ChiSq += ((block->Data[i][j] - Expected[i][j]) * 
+                      (block->Data[i][j] - Expected[i][j]) / 
                       Expected[i][j]);
       }
    }
@@ -493,70 +987,77 @@ grouped:\n");
    NDoF = (rows-1) * (cols-1);
 
    /* Display these values                                            */
-   printf("Chi Squared = %lf with %d degrees of freedom\n\n",ChiSq,NDoF);
+   fprintf(out,"Chi Squared = %lf with %d degrees of freedom\n\n",
+           ChiSq,NDoF);
 
 }
 
 /***********************************************************************/
-/*>void ShowTotals(int *FirstTotal, int *SecondTotal)
-   --------------------------------------------------
+/*>void ShowTotals(int *FirstTotal, int *SecondTotal, FILE *out)
+   --------------------------------------------------------------
    Display total occurences of residue types
 
    03.02.94 Original   By: ACRM
+   16.10.26 Writes to out
 */
-void ShowTotals(int *FirstTotal, int *SecondTotal)
+void ShowTotals(int *FirstTotal, int *SecondTotal, FILE *out)
 {
    int i;
    
-   printf("\nTotals at first position:\n=========================\n");
+   fprintf(out,"\nTotals at first position:\n=========================\n");
    for(i=0;i<MAXAA;i++)
       if(FirstTotal[i]) 
-         printf("%c: %d\n",LookDown(i),FirstTotal[i]);
+         fprintf(out,"%c: %d\n",LookDown(i),FirstTotal[i]);
 
-   printf("\nTotals at second position:\n==========================\n");
+   fprintf(out,"\nTotals at second position:\n==========================\n");
    for(i=0;i<MAXAA;i++)
       if(SecondTotal[i]) 
-         printf("%c: %d\n",LookDown(i),SecondTotal[i]);
+         fprintf(out,"%c: %d\n",LookDown(i),SecondTotal[i]);
 }
 
 /***********************************************************************/
-/*>void PrintObsExpTable(double Expected[MAXAA][MAXAA])
-   ----------------------------------------------------
+/*>void PrintObsExpTable(BLOCK *block, double Expected[MAXAA][MAXAA],
+                         FILE *out)
+   -------------------------------------------------------------------
    Print table of observed and expected values
 
    03.02.94 Original   By: ACRM
    09.02.94 Added printing of individual ChiSq values
+   16.10.26 Prints a block to out
 */
-void PrintObsExpTable(double Expected[MAXAA][MAXAA])
+void PrintObsExpTable(BLOCK *block, double Expected[MAXAA][MAXAA], 
+                      FILE *out)
 {
    int i,
        j;
    
-   printf("\nObserved & expected values:\n===========================\n");
-   if(gWide) printf("        A     C     D     E     F     G     H     \
+   fprintf(out,"\nObserved & expected values:\n===========================\n");
+   if(block->Options->Wide)
+      fprintf(out,"        A     C     D     E     F     G     H     \
 I     K     L     M     N     P     Q     R     S     T     V     W     \
 Y     B\n");
-   else      printf("     A  C  D  E  F  G  H  I  K  L  M  N  P  Q  R  \
+   else
+      fprintf(out,"     A  C  D  E  F  G  H  I  K  L  M  N  P  Q  R  \
 S  T  V  W  Y  B\n");
    for(i=0; i<MAXAA; i++)
    {
-      printf("%c  ",LookDown(i));
+      fprintf(out,"%c  ",LookDown(i));
       
       for(j=0; j<MAXAA; j++)
       {
-         if(gWide) printf("%6d",gData[i][j]);
-         else      printf("%3d",gData[i][j]);
+         if(block->Options->Wide) fprintf(out,"%6d",block->Data[i][j]);
+         else      fprintf(out,"%3d",block->Data[i][j]);
       }
-      printf("\n   ");
+      fprintf(out,"\n   ");
 
       for(j=0; j<MAXAA; j++)
       {
-         if(gWide) printf("%6.1lf",Expected[i][j]);
-         else      printf("%3d",(int)Expected[i][j]);
+         if(block->Options->Wide) fprintf(out,"%6.1lf",Expected[i][j]);
+         else      fprintf(out,"%3d",(int)Expected[i][j]);
       }
-      printf("\n   ");
+      fprintf(out,"\n   ");
 
-      if(gIndividual)
+      if(block->Options->Individual)
       {
          for(j=0; j<MAXAA; j++)
          {
@@ -564,20 +1065,20 @@ S  T  V  W  Y  B\n");
 
             if(Expected[i][j] > SMALL)
             {
-               ChiSq = (gData[i][j] - Expected[i][j]) *
-                       (gData[i][j] - Expected[i][j]) /
+               ChiSq = (block->Data[i][j] - Expected[i][j]) *
+                       (block->Data[i][j] - Expected[i][j]) /
                        Expected[i][j];
             
-               printf("%6.1lf",ChiSq);
+               fprintf(out,"%6.1lf",ChiSq);
             }
             else
             {
-               printf("   ---");
+               fprintf(out,"   ---");
             }
          }
-         printf("\n");
+         fprintf(out,"\n");
       }
-      printf("\n");
+      fprintf(out,"\n");
    }
 }
 
@@ -608,34 +1109,35 @@ void CalcExpected(int *FirstTotal, int *SecondTotal, int NObs,
 }
 
 /***********************************************************************/
-/*>void BinResidues(int flag, int *totals)
-   ---------------------------------------
+/*>void BinResidues(BLOCK *block, int flag, int *totals, FILE *out)
+   -----------------------------------------------------------------
    Place low frequency residues into a single bin
 
    03.02.94 Original   By: ACRM
+   16.10.26 Bins the data in a block and writes to out
 */
-void BinResidues(int flag, int *totals)
+void BinResidues(BLOCK *block, int flag, int *totals, FILE *out)
 {
    int i,
        j;
    
    for(i=0; i<MAXAA-1; i++)
    {
-      if(totals[i] && totals[i] < gMinBin)
+      if(totals[i] && totals[i] < block->Options->MinBin)
       {
-         printf("%c ",LookDown(i));
+         fprintf(out,"%c ",LookDown(i));
          
          for(j=0; j<MAXAA; j++)
          {
             if(flag == BIN_FIRST)
             {
-               gData[MAXAA-1][j] += gData[i][j];
-               gData[i][j] = 0;
+               block->Data[MAXAA-1][j] += block->Data[i][j];
+               block->Data[i][j] = 0;
             }
             else
             {
-               gData[j][MAXAA-1] += gData[j][i];
-               gData[j][i] = 0;
+               block->Data[j][MAXAA-1] += block->Data[j][i];
+               block->Data[j][i] = 0;
             }
          }
 
@@ -643,7 +1145,7 @@ void BinResidues(int flag, int *totals)
          totals[i] = 0;
       }
    }
-   printf("\n");
+   fprintf(out,"\n");
 }
 
 
@@ -654,10 +1156,11 @@ void BinResidues(int flag, int *totals)
 
    03.02.94 Original   By: ACRM
    09.02.94 Ammended for -i option
+   17.10.26 Prints the current version
 */
 void PrintHeader(void)
 {
-   printf("chisq V1.2 (c) 1994 Dr. Andrew C.R. Martin, UCL\n\n");
+   printf("chisq V1.4 (c) 1994 Dr. Andrew C.R. Martin, UCL\n\n");
    printf("Takes results from seqan analysis and prints a contingency \
 table containing\n");
    printf("observed and expected values for each residue pair together \
@@ -0,0 +1,566 @@
+/*************************************************************************
+
+   Program:    genproteome
+   File:       genproteome.c
+
+   Version:    V1.0
+   Date:       16.10.26
+   Function:   Generate a synthetic proteome for benchmarking
+               indirectrepeats
+
+   Copyright:  (c) UCL / Dr. Andrew C. R. Martin 2026
+   Author:     Dr. Andrew C. R. Martin
+   Address:    Biomolecular Structure & Modelling Unit,
+               Institute of Structural & Molecular Biology,
+               University College,
+               Gower Street,
+               London.
+               WC1E 6BT.
+   EMail:      andrew.martin@ucl.ac.uk
+               andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain, but it may be copied
+   according to the conditions laid out in the accompanying file
+   COPYING.DOC
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If someone
+   else breaks this code, I don't want to be blamed for code that does not
+   work!
+
+   The code may not be sold commercially or included as part of a
+   commercial product except as described in the file COPYING.DOC.
+
+**************************************************************************
+
+   Description:
+   ============
+   Writes a FASTA file of random protein sequences of a given total
+   size. Residues are drawn from the background composition of
+   UniProtKB/Swiss-Prot. Low complexity regions (drawn from one to three
+   residues) and alternating repeats (cXcX...c) are mixed in to give the
+   proportions requested, and some records may be made very long or
+   very short. The output is the same for the same options and seed,
+   so it may be used to time and check indirectrepeats --benchmark.
+
+**************************************************************************
+
+   Usage:
+   ======
+   genproteome -s 1G -c 10 -a 10 -L 2 -t 20 big.faa
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0   16.10.26 Original   By: ACRM
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "bioplib/general.h"
+#include "bioplib/macros.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define MAXBUFF      512
+#define NRESIDUES    20
+#define RESIDUES     "ACDEFGHIKLMNPQRSTVWY"
+#define TABLESIZE    4096      /* Size of the residue lookup table      */
+#define LINELEN      60        /* Residues on each line of output       */
+#define MAXTINY      20        /* Longest tiny record                   */
+#define BGSEGMENT    50        /* Mean length of a background segment   */
+#define LCSEGMENT    40        /* Mean length of a low complexity region*/
+#define MAXALTERNATE 40        /* Most residues in an alternating repeat*/
+
+/************************************************************************/
+/* Type definitions
+*/
+typedef struct
+{
+   uint64_t size,            /* Total residues to write                 */
+            seed,            /* Random number seed                      */
+            longlen;         /* Length of each very long record         */
+   int      meanlen,         /* Mean length of a normal record          */
+            nlong,           /* Number of very long records             */
+            lowcomplexity,   /* Percentage in low complexity regions    */
+            alternating,     /* Percentage in alternating repeats       */
+            tiny;            /* Percentage of records that are tiny     */
+}  GENOPTIONS;
+
+/************************************************************************/
+/* Globals
+*/
+/* Background composition of UniProtKB/Swiss-Prot (percent) in the
+   order of RESIDUES
+*/
+double gComposition[NRESIDUES] =
+{  8.25, 1.38, 5.46, 6.72, 3.86, 7.07, 2.27, 5.91, 5.80, 9.65,
+   2.41, 4.06, 4.74, 3.93, 5.53, 6.63, 5.35, 6.86, 1.10, 2.92  };
+
+/************************************************************************/
+/* Prototypes
+*/
+int main(int argc, char **argv);
+void WriteProteome(FILE *out, GENOPTIONS *opts);
+int FillSequence(char *sequence, int seqlen, GENOPTIONS *opts,
+                 char *table, uint64_t *state);
+void BuildResidueTable(char *table);
+void WriteRecord(FILE *out, uint64_t seqnum, char *sequence, int seqlen);
+uint64_t NextRandom(uint64_t *state);
+BOOL ParseSize(char *string, uint64_t *size);
+void Usage(void);
+BOOL ParseCmdLine(int argc, char **argv, char *outfile,
+                  GENOPTIONS *opts);
+
+/************************************************************************/
+int main(int argc, char **argv)
+{
+   char       OutFile[MAXBUFF];
+   FILE       *out = stdout;
+   GENOPTIONS opts;
+
+   if(ParseCmdLine(argc, argv, OutFile, &opts))
+   {
+      if(OpenStdFiles(NULL, OutFile, NULL, &out))
+      {
+         WriteProteome(out, &opts);
+         if(ferror(out) | fclose(out))
+         {
+            fprintf(stderr, "Unable to write output file\n");
+            return(1);
+         }
+      }
+      else
+      {
+         fprintf(stderr, "Unable to open output file: %s\n", OutFile);
+         return(1);
+      }
+   }
+   else
+   {
+      Usage();
+   }
+
+   return(0);
+}
+
+/************************************************************************/
+/*>void WriteProteome(FILE *out, GENOPTIONS *opts)
+   -----------------------------------------------
+   Input:   FILE       *out     Output file
+            GENOPTIONS *opts    Generator options
+
+   Writes records until opts->size residues have been written. The very
+   long records come first; the rest are tiny (1..MAXTINY residues) or
+   have lengths spread evenly up to twice the mean length.
+
+   16.10.26  Original   By: ACRM
+*/
+void WriteProteome(FILE *out, GENOPTIONS *opts)
+{
+   char     table[TABLESIZE],
+            *sequence;
+   uint64_t state   = opts->seed,
+            written = 0,
+            seqnum  = 0,
+            maxlen, len;
+
+   BuildResidueTable(table);
+
+   maxlen = 2 * (uint64_t)opts->meanlen;
+   if(maxlen < MAXTINY)
+      maxlen = MAXTINY;
+   if(opts->nlong && (opts->longlen > maxlen))
+      maxlen = opts->longlen;
+   if(maxlen > INT_MAX)
+      maxlen = INT_MAX;
+   if((sequence = (char *)malloc(maxlen)) == NULL)
+   {
+      fprintf(stderr, "No memory for sequence of length %llu\n",
+              (unsigned long long)maxlen);
+      exit(1);
+   }
+
+   /* Avoid a state of zero which xorshift never leaves                 */
+   if(state == 0)
+      state = 1;
+
+   while(written < opts->size)
+   {
+      if(seqnum < (uint64_t)opts->nlong)
+         len = opts->longlen;
+      else if((NextRandom(&state) % 100) < (uint64_t)opts->tiny)
+         len = 1 + NextRandom(&state) % MAXTINY;
+      else
+         len = 1 + NextRandom(&state) % (2 * (uint64_t)opts->meanlen);
+
+      if(len > maxlen)
+         len = maxlen;
+      if(len > opts->size - written)
+         len = opts->size - written;
+
+      FillSequence(sequence, (int)len, opts, table, &state);
+      WriteRecord(out, ++seqnum, sequence, (int)len);
+      written += len;
+   }
+
+   free(sequence);
+}
+
+/************************************************************************/
+/*>int FillSequence(char *sequence, int seqlen, GENOPTIONS *opts,
+                    char *table, uint64_t *state)
+   -------------------------------------------------------------
+   Input:   int        seqlen   Length of the sequence
+            GENOPTIONS *opts    Generator options
+            char       *table   Residue lookup table
+   Output:  char       *sequence The sequence (not terminated)
+   I/O:     uint64_t   *state   Random number state
+   Returns: int                 Number of alternating repeats added
+
+   Fills a sequence with segments of background, low complexity and
+   alternating repeats. Segments are chosen in proportion to the
+   percentages requested divided by their mean lengths, so the
+   proportions of residues are close to those requested. An alternating
+   repeat has 2..MAXALTERNATE occurrences of the repeated residue and
+   spacers that are not the repeated residue.
+
+   16.10.26  Original   By: ACRM
+*/
+int FillSequence(char *sequence, int seqlen, GENOPTIONS *opts,
+                 char *table, uint64_t *state)
+{
+   int    pos = 0,
+          nalternate = 0,
+          i, len, nres;
+   char   res[3], c;
+   double pbg, plc, palt, total, r;
+
+   pbg   = (100.0 - opts->lowcomplexity - opts->alternating) / BGSEGMENT;
+   plc   = (double)opts->lowcomplexity / LCSEGMENT;
+   palt  = (double)opts->alternating   / MAXALTERNATE;
+   total = pbg + plc + palt;
+
+   while(pos < seqlen)
+   {
+      r = total * (NextRandom(state) >> 11) / 9007199254740992.0;
+
+      if(r < palt)
+      {
+         /* Alternating repeat cXcX...c                                 */
+         c   = table[NextRandom(state) % TABLESIZE];
+         len = 2 * (2 + NextRandom(state) % (MAXALTERNATE - 1)) - 1;
+         for(i=0; (i<len) && (pos<seqlen); i++, pos++)
+         {
+            if(i & 1)
+            {
+               while((sequence[pos] =
+                      table[NextRandom(state) % TABLESIZE]) == c);
+            }
+            else
+            {
+               sequence[pos] = c;
+            }
+         }
+         nalternate++;
+      }
+      else if(r < palt + plc)
+      {
+         /* Low complexity region from one to three residues            */
+         nres = 1 + NextRandom(state) % 3;
+         for(i=0; i<nres; i++)
+            res[i] = table[NextRandom(state) % TABLESIZE];
+         len = 1 + NextRandom(state) % (2 * LCSEGMENT);
+         for(i=0; (i<len) && (pos<seqlen); i++, pos++)
+            sequence[pos] = res[NextRandom(state) % nres];
+      }
+      else
+      {
+         /* Background                                                  */
+         len = 1 + NextRandom(state) % (2 * BGSEGMENT);
+         for(i=0; (i<len) && (pos<seqlen); i++, pos++)
+            sequence[pos] = table[NextRandom(state) % TABLESIZE];
+      }
+   }
+
+   return(nalternate);
+}
+
+/************************************************************************/
+/*>void BuildResidueTable(char *table)
+   -----------------------------------
+   Output:  char   *table       TABLESIZE residues
+
+   Fills a table with residues in the proportions given by
+   gComposition so that a residue may be drawn with a single random
+   index.
+
+   16.10.26  Original   By: ACRM
+*/
+void BuildResidueTable(char *table)
+{
+   double total = 0.0,
+          sum   = 0.0;
+   int    i, j, last;
+
+   for(i=0; i<NRESIDUES; i++)
+      total += gComposition[i];
+
+   for(i=0, j=0; i<NRESIDUES; i++)
+   {
+      sum += gComposition[i];
+      last = (i == NRESIDUES-1) ? TABLESIZE :
+             (int)(TABLESIZE * sum / total + 0.5);
+      for(; j<last; j++)
+         table[j] = RESIDUES[i];
+   }
+}
+
+/************************************************************************/
+/*>void WriteRecord(FILE *out, uint64_t seqnum, char *sequence,
+                    int seqlen)
+   ------------------------------------------------------------
+   Input:   FILE     *out       Output file
+            uint64_t seqnum     Record number
+            char     *sequence  The sequence (not terminated)
+            int      seqlen     Length of the sequence
+
+   Writes a FASTA record with LINELEN residues on each line
+
+   16.10.26  Original   By: ACRM
+*/
+void WriteRecord(FILE *out, uint64_t seqnum, char *sequence, int seqlen)
+{
+   int i;
+
+   fprintf(out, ">SYN%09llu synthetic protein length=%d\n",
+           (unsigned long long)seqnum, seqlen);
+   for(i=0; i<seqlen; i+=LINELEN)
+   {
+      fwrite(sequence+i, 1, (seqlen-i < LINELEN) ? seqlen-i : LINELEN,
+             out);
+      putc('\n', out);
+   }
+}
+
+/************************************************************************/
+/*>uint64_t NextRandom(uint64_t *state)
+   ------------------------------------
+   I/O:     uint64_t *state     Random number state (not zero)
+   Returns: uint64_t            Random number
+
+   xorshift64* random number generator. This is used rather than rand()
+   so that the output does not depend on the C library.
+
+   16.10.26  Original   By: ACRM
+*/
+uint64_t NextRandom(uint64_t *state)
+{
+   uint64_t x = *state;
+
+   x ^= x >> 12;
+   x ^= x << 25;
+   x ^= x >> 27;
+   *state = x;
+   return(x * 2685821657736338717ULL);
+}
+
+/************************************************************************/
+/*>BOOL ParseSize(char *string, uint64_t *size)
+   --------------------------------------------
+   Input:   char     *string    Size with an optional K, M or G suffix
+   Output:  uint64_t *size      The size
+   Returns: BOOL                Valid?
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL ParseSize(char *string, uint64_t *size)
+{
+   unsigned long long value;
+   char               suffix = '\0';
+
+   if(sscanf(string, "%llu%c", &value, &suffix) < 1)
+      return(FALSE);
+
+   switch(suffix)
+   {
+   case '\0':
+      break;
+   case 'k':
+   case 'K':
+      value *= 1000ULL;
+      break;
+   case 'm':
+   case 'M':
+      value *= 1000000ULL;
+      break;
+   case 'g':
+   case 'G':
+      value *= 1000000000ULL;
+      break;
+   default:
+      return(FALSE);
+   }
+
+   *size = value;
+   return(value > 0);
+}
+
+/************************************************************************/
+void Usage(void)
+{
+   fprintf(stderr,"genproteome V1.0, (c) 2026, \
+Dr. Andrew C.R. Martin, UCL\n");
+   fprintf(stderr,"\n");
+   fprintf(stderr,"Usage: genproteome [-s size][-r seed][-l meanlen]\
+[-c lowcomplexity]\n");
+   fprintf(stderr,"                   [-a alternating][-L nlong]\
+[-M longlen][-t tiny]\n");
+   fprintf(stderr,"                   [output.faa]\n");
+   fprintf(stderr,"       -s Total residues to write; may end in K, M \
+or G (default: 10M)\n");
+   fprintf(stderr,"       -r Random number seed (default: 1)\n");
+   fprintf(stderr,"       -l Mean length of a record (default: 350)\n");
+   fprintf(stderr,"       -c Percentage of residues in low complexity \
+regions (default: 5)\n");
+   fprintf(stderr,"       -a Percentage of residues in alternating \
+repeats (default: 5)\n");
+   fprintf(stderr,"       -L Number of very long records \
+(default: 0)\n");
+   fprintf(stderr,"       -M Length of a very long record; may end in \
+K or M (default: 1M)\n");
+   fprintf(stderr,"       -t Percentage of records of 1..%d residues \
+(default: 0)\n", MAXTINY);
+   fprintf(stderr,"\n");
+   fprintf(stderr,"Writes a FASTA file of random protein sequences \
+drawn from the\n");
+   fprintf(stderr,"Swiss-Prot background composition with low \
+complexity regions and\n");
+   fprintf(stderr,"alternating repeats (cXcX...c) mixed in. The same \
+options and seed\n");
+   fprintf(stderr,"always give the same file. Time indirectrepeats on \
+the output with\n");
+   fprintf(stderr,"--benchmark.\n");
+   fprintf(stderr,"\n");
+}
+
+/************************************************************************/
+/*>BOOL ParseCmdLine(int argc, char **argv, char *outfile,
+                     GENOPTIONS *opts)
+   -------------------------------------------------------
+   Input:   int        argc     Argument count
+            char       **argv   Argument array
+   Output:  char       *outfile Output file (or blank string)
+            GENOPTIONS *opts    Generator options
+   Returns: BOOL                Success?
+
+   Parse the command line
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL ParseCmdLine(int argc, char **argv, char *outfile,
+                  GENOPTIONS *opts)
+{
+   unsigned long long seed;
+
+   argc--;
+   argv++;
+
+   outfile[0]          = '\0';
+   opts->size          = 10000000ULL;
+   opts->seed          = 1;
+   opts->longlen       = 1000000ULL;
+   opts->meanlen       = 350;
+   opts->nlong         = 0;
+   opts->lowcomplexity = 5;
+   opts->alternating   = 5;
+   opts->tiny          = 0;
+
+   while(argc)
+   {
+      if(argv[0][0] == '-')
+      {
+         if(argv[0][2] != '\0')
+            return(FALSE);
+
+         /* Every option takes a value                                  */
+         if(argv[0][1] == 'h')
+            return(FALSE);
+         if(argc < 2)
+            return(FALSE);
+
+         switch(argv[0][1])
+         {
+         case 's':
+            if(!ParseSize(argv[1], &(opts->size)))
+               return(FALSE);
+            break;
+         case 'r':
+            if(!sscanf(argv[1], "%llu", &seed))
+               return(FALSE);
+            opts->seed = seed;
+            break;
+         case 'l':
+            if(!sscanf(argv[1], "%d", &(opts->meanlen)) ||
+               (opts->meanlen < 1))
+               return(FALSE);
+            break;
+         case 'c':
+            if(!sscanf(argv[1], "%d", &(opts->lowcomplexity)) ||
+               (opts->lowcomplexity < 0) || (opts->lowcomplexity > 100))
+               return(FALSE);
+            break;
+         case 'a':
+            if(!sscanf(argv[1], "%d", &(opts->alternating)) ||
+               (opts->alternating < 0) || (opts->alternating > 100))
+               return(FALSE);
+            break;
+         case 'L':
+            if(!sscanf(argv[1], "%d", &(opts->nlong)) ||
+               (opts->nlong < 0))
+               return(FALSE);
+            break;
+         case 'M':
+            if(!ParseSize(argv[1], &(opts->longlen)))
+               return(FALSE);
+            break;
+         case 't':
+            if(!sscanf(argv[1], "%d", &(opts->tiny)) ||
+               (opts->tiny < 0) || (opts->tiny > 100))
+               return(FALSE);
+            break;
+         default:
+            return(FALSE);
+            break;
+         }
+         argc -= 2;
+         argv += 2;
+      }
+      else
+      {
+         /* Check that there is only 1 argument left                    */
+         if(argc > 1)
+            return(FALSE);
+
+         strcpy(outfile, argv[0]);
+         argc--;
+         argv++;
+      }
+   }
+
+   /* The percentages must leave room for the background                */
+   if(opts->lowcomplexity + opts->alternating > 100)
+      return(FALSE);
+
+   return(TRUE);
+}
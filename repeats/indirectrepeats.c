@@ -3,8 +3,8 @@
    Program:    indirectrepeats
    File:       indirectrepeats.c
    
-   Version:    V2.0
-   Date:       07.03.13
+   Version:    V2.23
+   Date:       16.10.26
    Function:   Identify indirect repeats in a FASTA file
    
    Copyright:  (c) UCL / Dr. Andrew C. R. Martin 2004-2013
@@ -50,6 +50,67 @@
    V1.1   19.02.13 Perl version modified for indirect repeats 
                    By: Rashmi Rajasabhai
    V2.0   07.03.13 C version   By: ACRM
+   V2.1   16.10.26 SearchAllPatterns() now finds all maximal alternating
+                   runs for every residue in a single pass over the file
+                   rather than rescanning the file for each pattern
+   V2.2   16.10.26 Input files are memory mapped and records are handed
+                   out as views into the mapping rather than copied 
+                   through GetFASTASequence()
+   V2.3   16.10.26 Removed the MAXSEQ limit on sequence length. Records
+                   are built in an arena that is reused for each record.
+                   GetFASTASequence() replaced by ReadFASTAStream()
+   V2.4   16.10.26 Added -t to search record-aligned chunks of the file
+                   on several threads. Options are now held in OPTIONS
+   V2.5   16.10.26 -s patterns are matched with a bitmask kernel which
+                   finds all the starts in one pass. Added -T self-test
+   V2.6   16.10.26 Exact matching of -s patterns is done on whole blocks
+                   of starts using the residue mask rather than by
+                   calling CheckBounds() for each hit
+   V2.7   16.10.26 Added -H to give the distribution of run lengths for
+                   every residue and -b to write it in binary
+   V2.8   16.10.26 Added -S to search for a file of patterns in one pass
+   V2.9   16.10.26 Patterns may have longer spacers (AXXA) and classes of
+                   residues ([ST]X[ST]). These are compiled to a PERIODIC
+                   pattern and matched with the bitmask kernel
+   V2.10  16.10.26 Added --build-index to write a binary corpus file 
+                   which is mapped and searched in place of the FASTA
+   V2.11  16.10.26 Input may be read from stdin or from gzip or zstd 
+                   compressed files. Streamed input is read into a ring 
+                   of buffers by a separate thread
+   V2.12  16.10.26 Added --shard to search part of a file and write the
+                   results to a partial file, and --merge to combine the
+                   partial files. Searching and reporting are separated
+   V2.13  16.10.26 Added --incremental to keep a checkpoint of the part
+                   of the file searched so that a rerun only searches 
+                   sequences appended since, or resumes a killed run
+   V2.14  16.10.26 Added --hits to write the position of every match as
+                   TSV (or BED with --bed) from a separate writer thread
+   V2.15  16.10.26 Added --metrics to write progress and a summary of 
+                   the time in each phase, throughput and memory use as
+                   JSON lines
+   V2.16  16.10.26 Added --benchmark to time the original scalar search,
+                   the bitmask kernel and the run scanner and check that
+                   they give the same counts
+   V2.17  16.10.26 The matching code is moved to librepeats.c, which
+                   must be compiled and linked with this file. 
+                   librepeats also gives other programs a scanner with
+                   no global state
+   V2.18  16.10.26 Added --serve to load a file once and answer pattern
+                   and histogram queries on a Unix socket from a pool of
+                   threads
+   V2.19  16.10.26 --build-index also writes an index of the alternating
+                   runs so that a single simple pattern is found without
+                   scanning the corpus
+   V2.20  16.10.26 Added --null to compare counts with shuffled 
+                   sequences
+   V2.21  16.10.26 Added --dna to count runs of nucleotides, streaming 
+                   each sequence through a fixed window of 2-bit 
+                   packed bases
+   V2.22  16.10.26 Added -k to allow substitutions in -s and -S 
+                   patterns
+   V2.23  16.10.26 Added --organisms to count the patterns in many files
+                   on a pool of threads and write a matrix normalised by
+                   the number of residues
 
 *************************************************************************/
 /* Includes
@@ -57,71 +118,754 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <math.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <dirent.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "bioplib/general.h"
 #include "bioplib/macros.h"
+#include "rpkernels.h"
 
 /************************************************************************/
 /* Defines and macros
 */
 #define MAXBUFF    512
-#define MAXAA      24
 #define MAXPATLEN  360
-#define MAXSEQ     100000
+#define ARENASIZE  65536
+#define MINCHUNK   (1024*1024)  /* Smallest chunk of file for a thread  */
+#define THREADCHUNKS 8          /* Target number of chunks per thread   */
+#define MAXTHREADS 1024
+#define NSELFTEST  20000        /* Number of random self-test cases     */
+#define HISTMAGIC  "IRHIST01"   /* Start of a binary histogram file     */
+#define CORPUSMAGIC "IRCORP02"  /* Start of a binary corpus file        */
+#define CORPUSMAGIC1 "IRCORP01" /* Corpus file with no run index        */
+#define RUNBUCKETS 32           /* Run lengths indexed separately       */
+#define RINGBUFFERS 8           /* Buffers in the input ring            */
+#define RINGBUFFSIZE (1024*1024) /* Size of each input ring buffer      */
+#define PARTMAGIC  "IRPART01"   /* Start of a partial result file       */
+#define PARTEXACT     1         /* Partial file flags                   */
+#define PARTVERBOSE   2
+#define PARTHISTOGRAM 4
+#define CKPTMAGIC  "IRCKPT02"   /* Start of a checkpoint file           */
+#define CKPTSIZE   (256*1024*1024) /* Bytes searched between checkpoints*/
+#define FNVBASIS   14695981039346656037ULL /* FNV-1a hash of the prefix */
+#define FNVPRIME   1099511628211ULL
+#define HASHBUFFSIZE (64*1024) /* Bytes hashed at once by HashStream() */
+#define HITBUFFSIZE (1024*1024) /* Hit output passed to the writer      */
+#define BENCHBATCH (64*1024*1024) /* Residues in each benchmark batch   */
+#define BENCHLEGACY 0           /* Engines compared by Benchmark()      */
+#define BENCHKERNEL 1
+#define BENCHRUNS   2
+#define NENGINES    3
+#define MAXQUEUE   64           /* Connections waiting for a thread     */
+#define STOPCHECK  1000         /* ms between checks for a stop signal  */
+#define ENDREPLY   ".\n"        /* Ends each reply from the server      */
+#define NULLSEED   0x5eed1e55ULL /* Seed for the shuffles from --null   */
+#define NBASES     4            /* Nucleotides for --dna                */
+#define BASES      "ACGT"
+#define DNAWINDOW  (1024*1024)  /* Bases held at once by --dna          */
+#define DNACHUNK   (4*1024*1024) /* Bytes of a mapped file per step     */
+#define ORGBATCH   (8*1024*1024) /* Bytes of small files in one job     */
+
+/************************************************************************/
+/* Type definitions
+*/
+typedef struct
+{
+   long count;       /* Number of matches to this pattern               */
+   int  *seqs,       /* Indexes of matching sequences (verbose only)    */
+        nseqs,       /* Number of sequences stored in seqs              */
+        maxseqs,     /* Allocated size of seqs                          */
+        lastseq;     /* Last sequence index added to seqs               */
+}  PATHITS;
+
+typedef struct
+{
+   char *buffer;     /* Concatenated NUL-terminated strings             */
+   long *offsets;    /* Offset of each string in buffer                 */
+   long used,        /* Bytes used in buffer                            */
+        size;        /* Bytes allocated for buffer                      */
+   int  nstrings,    /* Number of strings stored                        */
+        maxstrings;  /* Allocated size of offsets                       */
+}  STRPOOL;
+
+typedef struct
+{
+   char *label,      /* Header line including the '>' (not terminated)  */
+        *sequence;   /* Upper case sequence (not terminated)            */
+   int  labellen,    /* Length of label                                 */
+        seqlen;      /* Length of sequence                              */
+}  FASTAREC;
+
+typedef struct
+{
+   char   *data;     /* Arena memory                                    */
+   size_t used,      /* Bytes in use                                    */
+          size;      /* Bytes allocated                                 */
+}  ARENA;
+
+typedef struct
+{
+   char     magic[8];        /* CORPUSMAGIC                             */
+   uint64_t nseq,            /* Number of sequences                     */
+            residues,        /* File offset of the residues             */
+            nresidues,       /* Bytes of residues                       */
+            labels,          /* File offset of the label pool           */
+            nlabels,         /* Bytes of labels                         */
+            seqoffsets,      /* File offset of the sequence offsets     */
+            labeloffsets,    /* File offset of the label offsets        */
+            runs,            /* File offset of the run index (0 if none)*/
+            nruns,           /* Entries in the run index                */
+            runfirst;        /* File offset of the run index buckets    */
+}  CORPUSHEADER;
+
+typedef struct
+{
+   uint32_t seq,             /* Sequence containing the run             */
+            start,           /* Offset of the first residue of the run  */
+            len;             /* Occurrences of the residue in the run   */
+}  RUNENTRY;
+
+typedef struct
+{
+   char     *map,            /* Mapped corpus file                      */
+            *residues,       /* Upper case sequences, end to end        */
+            *labels;         /* NUL-terminated labels, end to end       */
+   uint64_t *seqoffsets,     /* Start of each sequence in residues 
+                                (nseq+1 entries)                        */
+            *labeloffsets,   /* Start of each label in labels 
+                                (nseq+1 entries)                        */
+            *runfirst;       /* Start of each bucket in runs 
+                                (NRESIDUES*RUNBUCKETS+1 entries)        */
+   RUNENTRY *runs;           /* Runs of 2 or more occurrences by residue
+                                and length (NULL if there is no index)  */
+   size_t   mapsize,         /* Size of the mapping                     */
+            nseq,            /* Number of sequences                     */
+            nruns;           /* Entries in runs                         */
+}  CORPUS;
+
+typedef struct
+{
+   char     magic[8];        /* PARTMAGIC                               */
+   uint32_t shard,           /* This shard (1..nshards)                 */
+            nshards,         /* Number of shards                        */
+            flags,           /* PARTEXACT, PARTVERBOSE, PARTHISTOGRAM   */
+            minpat,          /* Options used for the search             */
+            maxpat,
+            npat,            /* Patterns in each result                 */
+            nresults,        /* Number of results                       */
+            npatterns,       /* Patterns from -S (0 if none)            */
+            longsize;        /* sizeof(long) of the writing machine     */
+}  PARTIALHEADER;
+
+typedef struct
+{
+   char     magic[8];        /* CKPTMAGIC                               */
+   uint64_t offset,          /* Bytes of the FASTA file searched        */
+            hash,            /* FNV-1a hash of those bytes              */
+            payload;         /* FNV-1a hash of the results which follow */
+}  CKPTHEADER;
+
+typedef struct
+{
+   FILE            *fp;      /* Input stream                            */
+   char            *buffers[RINGBUFFERS]; /* Ring of input buffers      */
+   size_t          lengths[RINGBUFFERS];  /* Bytes in each buffer       */
+   int             head,     /* Next buffer to be filled                */
+                   tail,     /* Next buffer to be used                  */
+                   count;    /* Filled buffers, including the one in use*/
+   uint64_t        bytes;    /* Total bytes read from the stream        */
+   BOOL            eof,      /* Input thread has reached the end        */
+                   error,    /* Input thread stopped on a read error    */
+                   stop,     /* Input thread should stop                */
+                   inuse;    /* Buffer at tail is in use by the reader  */
+   pthread_t       thread;   /* Input thread                            */
+   pthread_mutex_t lock;     /* Protects head, tail, count and flags    */
+   pthread_cond_t  filled,   /* Signalled when a buffer is filled       */
+                   emptied;  /* Signalled when a buffer is released     */
+}  RING;
+
+typedef struct
+{
+   FILE   *fp;       /* Input file                                      */
+   char   *map,      /* Mapped file (NULL if the file is not mapped)    */
+          *data,     /* Part of the mapped file to be read              */
+          *line,     /* Line buffer when the file is not mapped         */
+          *buffer;   /* Ring buffer being read                          */
+   size_t mapsize,   /* Size of the mapped file                         */
+          size,      /* Size of data, or one past the last record to 
+                        read from a corpus                              */
+          pos,       /* Offset of the next record in the mapped file, or
+                        number of the next record in a corpus           */
+          linesize,  /* Allocated size of line                          */
+          buflen,    /* Bytes in buffer                                 */
+          bufpos;    /* Next byte to be read from buffer                */
+   ARENA  record,    /* Holds the current record when it is copied      */
+          header;    /* Next header line when the file is not mapped    */
+   BOOL   haveheader;/* Has the next header been read?                  */
+   CORPUS *corpus;   /* Binary corpus (NULL for a FASTA file)           */
+   RING   *ring;     /* Input ring when the file is not mapped          */
+}  FASTAREADER;
+
+typedef struct
+{
+   long *runs,       /* Maximal runs of each length [res*size + length] */
+        *exact;      /* Runs which are also exact matches               */
+   int  size,        /* Allocated lengths for each residue              */
+        maxlen;      /* Longest run seen                                */
+}  HISTOGRAM;
+
+typedef struct
+{
+   int  pattern,     /* Index of the pattern in the hits array          */
+        start,       /* First residue of the match (from 0)             */
+        end;         /* Last residue of the match                       */
+   BOOL exact;       /* Would the match count with exact matching?      */
+}  HIT;
+
+typedef struct
+{
+   HIT  *hits;       /* Positions of the matches in one sequence        */
+   int  nhits,       /* Number of matches                               */
+        maxhits;     /* Allocated size of hits                          */
+}  HITLIST;
+
+typedef struct hitblock
+{
+   struct hitblock *next;
+   char            *data;    /* Formatted hit records                   */
+   size_t          used;     /* Bytes in data                           */
+}  HITBLOCK;
+
+typedef struct
+{
+   FILE            *fp;      /* Hit output file                         */
+   HITBLOCK        **first,  /* Blocks waiting for each chunk           */
+                   **last;
+   BOOL            *done;    /* Chunk has been searched                 */
+   int             nchunks,  /* Number of chunks                        */
+                   next;     /* Next chunk to be written                */
+   double          writetime;/* Seconds spent writing                   */
+   pthread_t       thread;   /* Writer thread                           */
+   pthread_mutex_t lock;     /* Protects the blocks, done and next      */
+   pthread_cond_t  ready;    /* Signalled when a block is queued        */
+}  HITWRITER;
+
+typedef struct
+{
+   char **patterns;  /* Patterns in the order they were read            */
+   PERIODIC **periodic; /* Compiled patterns (NULL for simple ones)     */
+   int  *patlen,     /* Length of each pattern                          */
+        *nrepeat,    /* Number of repeated residues in each pattern     */
+        *order,      /* Patterns sorted by residue and nrepeat          */
+        first[NRESIDUES+1], /* Start of each residue's patterns in order;
+                        others follow first[NRESIDUES]                  */
+        npatterns;   /* Number of patterns                              */
+}  PATTERNSET;
+
+typedef struct
+{
+   double   read,            /* Seconds reading and parsing records     */
+            scan,            /* Seconds scanning sequences              */
+            format,          /* Seconds formatting hit records          */
+            wall;            /* Seconds in searches using this thread   */
+   uint64_t nseq,            /* Sequences searched                      */
+            residues;        /* Residues searched                       */
+}  THREADSTATS;
+
+typedef struct
+{
+   FILE        *fp;          /* JSON lines output                       */
+   THREADSTATS *threads;     /* Statistics for each thread              */
+   double      start,        /* Time the run started                    */
+               search,       /* Seconds in RunSearch()                  */
+               output;       /* Seconds reporting and writing hits      */
+   uint64_t    bytes,        /* Input bytes searched                    */
+               hits;         /* Matches found                           */
+   int         nthreads;     /* Size of threads                         */
+}  METRICS;
+
+typedef struct
+{
+   char pattern[MAXPATLEN],  /* Pattern from -s (blank for all)         */
+        patfile[MAXBUFF],    /* File of patterns from -S                */
+        corpusfile[MAXBUFF], /* Corpus file from --build-index          */
+        ckptfile[MAXBUFF],   /* Checkpoint file from --incremental      */
+        histfile[MAXBUFF];   /* Binary histogram file from -b           */
+   BOOL exact,               /* Do exact matching                       */
+        verbose,             /* Report labels of matching sequences     */
+        quiet,               /* Do not report progress                  */
+        selftest,            /* Run the self-test                       */
+        benchmark,           /* Time and check the search engines       */
+        histogram;           /* Give the distribution of run lengths    */
+   int  minpat,              /* Minimum number of repeated residues     */
+        maxpat,              /* Maximum number of repeated residues     */
+        nthreads;            /* Number of threads                       */
+   PATTERNSET *patset;       /* Patterns read from patfile              */
+   PERIODIC   *periodic;     /* Compiled -s pattern (NULL if simple)    */
+   int        shard,         /* Shard to search from --shard (1..)      */
+              nshards,       /* Number of shards (0 for the whole file) */
+              npartfiles;    /* Number of files for --merge             */
+   BOOL       merge,         /* Merge partial files                     */
+              nullcorpus;    /* Shuffle across the corpus for --null    */
+   int        nnull;         /* Number of shuffles for --null           */
+   BOOL       dna;           /* Search nucleotides with --dna           */
+   int        mismatches;    /* Substitutions allowed by -k             */
+   char       **partfiles;   /* Partial files for --merge               */
+   BOOL       organisms;     /* Compare many files with --organisms     */
+   int        norgfiles;     /* Number of files for --organisms         */
+   char       **orgfiles;    /* Files and directories for --organisms   */
+   char       hitsfile[MAXBUFF]; /* Hit output file from --hits         */
+   BOOL       bed;           /* Write hits as BED rather than TSV       */
+   FILE       *hitsfp;       /* Open hit output file (NULL if none)     */
+   char       metricsfile[MAXBUFF]; /* Metrics file from --metrics      */
+   char       socketfile[MAXBUFF];  /* Server socket from --serve       */
+   METRICS    *metrics;      /* Run metrics (NULL if not wanted)        */
+}  OPTIONS;
+
+typedef struct
+{
+   PATHITS   *hits;  /* Hits for each pattern                           */
+   STRPOOL   labels; /* Labels of matching sequences (verbose only)     */
+   HISTOGRAM hist;   /* Run length distribution (-H)                    */
+   ARENA     maxima; /* Longest run of each residue in each sequence 
+                        (-H -v)                                         */
+}  SEARCHRESULT;
+
+typedef struct
+{
+   pthread_mutex_t lock;
+   int             next,     /* Next chunk to be taken by the owner     */
+                   last;     /* One past the last chunk in the queue    */
+}  WORKQUEUE;
+
+typedef struct
+{
+   OPTIONS         *opts;    /* Search options                          */
+   char            *data;    /* Mapped file                             */
+   CORPUS          *corpus;  /* Binary corpus (instead of data)         */
+   size_t          *bounds;  /* Start of each chunk (nchunks+1 entries) */
+   int             npat,     /* Number of patterns in each result       */
+                   nchunks,  /* Number of chunks                        */
+                   nseq;     /* Sequences processed (for progress)      */
+   uint64_t        residues; /* Residues processed (for progress)       */
+   SEARCHRESULT    *results; /* Results for each chunk                  */
+   WORKQUEUE       *queues;  /* Chunk queue for each thread             */
+   HITWRITER       *writer;  /* Writes hit records (NULL if none)       */
+   pthread_mutex_t lock;     /* Protects nseq and residues              */
+}  SEARCH;
+
+typedef struct
+{
+   SEARCH          *search;
+   int             id;       /* Thread number                           */
+}  WORKER;
+
+typedef struct
+{
+   OPTIONS      *opts;       /* Search options                          */
+   SEARCHRESULT *result;     /* Counts and labels of matching sequences */
+   ARENA        label,       /* Label of the current sequence           */
+                header;      /* Header line being read                  */
+   uint64_t     *lo,         /* Low bit of each base in the window      */
+                *hi,         /* High bit of each base in the window     */
+                *other,      /* Bit set for each base which is not ACGT */
+                cont[NBASES],/* Run continuation bits of the last block
+                                for each base                           */
+                runstart[NBASES], /* Start of the open run of each base */
+                start,       /* Position in the sequence of the window  */
+                seqlen;      /* Bases in the sequence (when it is ended)*/
+   size_t       nbases;      /* Bases in the window                     */
+   int          seqnum,      /* Index of the sequence for hit lists     */
+                first,       /* Base index at position 0 (-1 if other)  */
+                last,        /* Base index at the last position         */
+                nseq;        /* Sequences processed                     */
+   BOOL         linestart,   /* At the start of a line                  */
+                inheader,    /* Reading a header line                   */
+                insequence,  /* A sequence has been started             */
+                matched;     /* A pattern matched the sequence          */
+}  DNASCAN;
+
+typedef struct
+{
+   CORPUS          *corpus;  /* Sequences being shuffled                */
+   OPTIONS         *opts;    /* Search options                          */
+   long            *counts;  /* Count of each pattern in each shuffle   */
+   int             npat,     /* Patterns in each shuffle                */
+                   next;     /* Next shuffle to be done                 */
+   pthread_mutex_t lock;     /* Protects next                           */
+}  NULLMODEL;
+
+typedef struct
+{
+   char     *filename,       /* Input file                              */
+            name[MAXBUFF];   /* Organism name from the file name        */
+   off_t    size;            /* Size of the file                        */
+   long     *counts,         /* Count of each pattern                   */
+            nseq;            /* Number of sequences                     */
+   uint64_t residues;        /* Number of residues                      */
+   BOOL     ok;              /* The file was read                       */
+}  ORGANISM;
+
+typedef struct
+{
+   OPTIONS         *opts;    /* Search options                          */
+   ORGANISM        *organisms, /* Each file in the order given          */
+                   **bysize; /* The files from largest to smallest      */
+   int             norganisms,
+                   *jobs,    /* First file in bysize of each job        */
+                   njobs,    /* Number of jobs                          */
+                   next,     /* Next job to be done                     */
+                   ndone,    /* Files done                              */
+                   maxorganisms, /* Allocated size of organisms         */
+                   npat;     /* Patterns counted in each file           */
+   pthread_mutex_t lock;     /* Protects next and ndone                 */
+}  ORGSEARCH;
+
+typedef struct
+{
+   CORPUS          *corpus;  /* Sequences being served                  */
+   HISTOGRAM       hist;     /* Run lengths for the whole corpus        */
+   BOOL            quiet;    /* Do not log queries                      */
+   BOOL            stop;     /* Set when the server is stopping         */
+   int             queue[MAXQUEUE], /* Connections waiting              */
+                   head,     /* Next connection to be served            */
+                   count,    /* Connections in the queue                */
+                   *active,  /* Connection served by each thread (-1 if
+                                idle)                                   */
+                   nthreads; /* Size of active                          */
+   pthread_mutex_t lock;     /* Protects the queue                      */
+   pthread_cond_t  ready,    /* Signalled when a connection is queued   */
+                   space;    /* Signalled when a connection is taken    */
+}  SERVER;
 
 /************************************************************************/
 /* Globals
 */
+int gResIndex[256];          /* Residue to index in RESIDUES (or -1)    */
+int gBaseIndex[256];         /* Nucleotide to index in BASES (or -1)    */
+volatile sig_atomic_t gStopServer = 0; /* Set by SIGINT or SIGTERM      */
 
 /************************************************************************/
 /* Prototypes
 */
 int main(int argc, char **argv);
-void SearchAllPatterns(FILE *in, BOOL exact, int minpat, int maxpat, 
-                       BOOL verbose, BOOL quiet);
-void SearchFileForPattern(char *pattern, FILE *in, BOOL exact, 
-                          BOOL verbose, BOOL quiet);
-BOOL CheckBounds(char *sequence, char *pattern, int offset);
-int SearchSequenceForPattern(char *sequence, char *pattern, int offset);
-BOOL GetFASTASequence(FILE *in, char *label, char *sequence);
+BOOL SearchFile(FASTAREADER *reader, OPTIONS *opts, FILE *out);
+int CountPatterns(OPTIONS *opts);
+void ReportResults(SEARCHRESULT *results, int nresults, OPTIONS *opts);
+void ReportAllPatterns(SEARCHRESULT *results, int nresults, 
+                       OPTIONS *opts);
+void ReportPattern(SEARCHRESULT *results, int nresults, OPTIONS *opts);
+void ReportHistogram(SEARCHRESULT *results, int nresults, OPTIONS *opts);
+void ReportPatternSet(SEARCHRESULT *results, int nresults, 
+                      OPTIONS *opts);
+BOOL SelectShard(FASTAREADER *reader, int shard, int nshards);
+size_t NextHeader(char *data, size_t size, size_t pos);
+size_t FirstCorpusRecord(CORPUS *corpus, uint64_t offset);
+BOOL WritePartial(FILE *fp, OPTIONS *opts, SEARCHRESULT *results, 
+                  int nresults, int npat);
+void SetPartialHeader(PARTIALHEADER *header, OPTIONS *opts, 
+                      int nresults, int npat);
+BOOL WritePartialString(FILE *fp, char *string);
+BOOL ReadPartial(FILE *fp, PARTIALHEADER *header, char *pattern,
+                 PATTERNSET **patset, SEARCHRESULT **results);
+BOOL ReadPartialString(FILE *fp, char *string);
+BOOL PartialFits(FILE *fp, int64_t nitems, size_t itemsize);
+BOOL CheckPartialResult(SEARCHRESULT *r, PARTIALHEADER *header);
+BOOL SamePartialSearch(PARTIALHEADER *header1, char *pattern1, 
+                       PATTERNSET *patset1, PARTIALHEADER *header2, 
+                       char *pattern2, PATTERNSET *patset2);
+BOOL MergePartials(OPTIONS *opts);
+int SearchIncremental(FASTAREADER *reader, OPTIONS *opts, int npat, 
+                      SEARCHRESULT **results);
+int ReadCheckpoint(char *filename, OPTIONS *opts, int npat, 
+                   CKPTHEADER *ckpt, SEARCHRESULT **results);
+BOOL WriteCheckpoint(char *filename, OPTIONS *opts, CKPTHEADER *ckpt,
+                     SEARCHRESULT *results, int nresults, int npat);
+int AppendResults(SEARCHRESULT **results, int nresults, 
+                  SEARCHRESULT *more, int nmore);
+uint64_t HashBytes(uint64_t hash, char *data, size_t size);
+BOOL HashStream(FILE *fp, uint64_t *hash);
+PATTERNSET *ReadPatternSet(char *filename, int mismatches);
+void FreePatternSet(PATTERNSET *patset);
+void ScanSequenceForPatternSet(char *sequence, int seqlen, int seqnum, 
+                               PATTERNSET *patset, BOOL exact, 
+                               PATHITS *hits, BOOL *matched, 
+                               MATCHMASKS *masks, HITLIST *hitlist);
+void ScanSequenceHistogram(char *sequence, int seqlen, BOOL exact,
+                           HISTOGRAM *hist, int *maxima);
+void GrowHistogram(HISTOGRAM *hist, int size);
+void AddHistogram(HISTOGRAM *total, HISTOGRAM *hist);
+void FreeHistogram(HISTOGRAM *hist);
+void GetHistogramCounts(HISTOGRAM *hist, BOOL exact, long *counts);
+BOOL WriteHistogram(char *filename, HISTOGRAM *hist, BOOL exact);
+void WriteHistogramTable(FILE *out, HISTOGRAM *hist, BOOL exact);
+int RunSearch(FASTAREADER *reader, OPTIONS *opts, int npat, 
+              SEARCHRESULT **results);
+void SearchRecords(FASTAREADER *reader, SEARCH *search, 
+                   SEARCHRESULT *result, THREADSTATS *stats);
+void CountProgress(SEARCH *search, int seqlen);
+double GetTime(void);
+METRICS *StartMetrics(char *filename, int nthreads);
+void WriteProgress(METRICS *metrics, int nseq, uint64_t residues);
+BOOL WriteMetrics(METRICS *metrics);
+void AddHit(HITLIST *hitlist, int pattern, int start, int end, 
+            BOOL exact);
+void FormatHits(FASTAREC *rec, OPTIONS *opts, HITLIST *hitlist, 
+                ARENA *text);
+void ScanSequenceForRuns(char *sequence, int seqlen, int seqnum, 
+                         BOOL exact, int minpat, int maxpat, 
+                         PATHITS *hits, BOOL *matched, 
+                         HITLIST *hitlist);
+void ScanSequenceForPattern(char *sequence, int seqlen, int seqnum, 
+                            char *pattern, PERIODIC *periodic, 
+                            BOOL exact, PATHITS *hits, 
+                            BOOL *matched, MATCHMASKS *masks,
+                            HITLIST *hitlist);
+BOOL SelfTest(void);
+BOOL Benchmark(FASTAREADER *reader, OPTIONS *opts, FILE *out);
+void BenchmarkBatch(int engine, char *data, size_t *bounds, int nseq,
+                    char *patterns, OPTIONS *opts, PATHITS **hits,
+                    MATCHMASKS *masks);
+BOOL AddHitSequence(PATHITS *hits, int seqnum);
+SEARCHRESULT *AllocSearchResults(int nresults, int npat);
+void FreeSearchResults(SEARCHRESULT *results, int nresults, int npat);
+void InitResidueIndex(void);
+int SplitIntoChunks(char *data, size_t size, int nthreads, 
+                    size_t **bounds);
+int SplitCorpus(CORPUS *corpus, size_t first, size_t last, 
+                int nthreads, size_t **bounds);
+void *SearchWorker(void *arg);
+int GetChunk(SEARCH *search, int id, int nthreads);
+int StoreString(STRPOOL *pool, char *string, int len);
+void FreeStringPool(STRPOOL *pool);
+int SearchSequenceForPattern(char *sequence, int seqlen, char *pattern, 
+                             int offset);
+FASTAREADER *OpenFASTAReader(FILE *in);
+BOOL ReadFASTARecord(FASTAREADER *reader, FASTAREC *rec);
+BOOL ReadFASTAStream(FASTAREADER *reader, FASTAREC *rec);
+BOOL ReadCorpusRecord(FASTAREADER *reader, FASTAREC *rec);
+ssize_t ReadLine(FASTAREADER *reader);
+RING *StartRing(FILE *fp);
+void *RingReader(void *arg);
+size_t RingNext(RING *ring, char **data);
+void StopRing(RING *ring);
+BOOL ReaderError(FASTAREADER *reader);
+HITWRITER *StartHitWriter(FILE *fp, int nchunks);
+void *HitWriterThread(void *arg);
+void QueueHits(HITWRITER *writer, int chunk, ARENA *text, BOOL done);
+double StopHitWriter(HITWRITER *writer);
+BOOL SearchDNA(FASTAREADER *reader, OPTIONS *opts);
+void ScanDNAText(DNASCAN *scan, char *text, size_t len);
+void StartDNASequence(DNASCAN *scan, char *label, size_t len);
+void AddDNABases(DNASCAN *scan, char *bases, size_t len);
+void EndDNASequence(DNASCAN *scan);
+void ScanDNABlocks(DNASCAN *scan, BOOL final);
+void CountDNARun(DNASCAN *scan, int base, uint64_t p, uint64_t q);
+BOOL NullModel(FASTAREADER *reader, OPTIONS *opts);
+void *NullWorker(void *arg);
+void CountCorpus(CORPUS *corpus, char *residues, OPTIONS *opts, 
+                 PATHITS *hits, int npat, MATCHMASKS *masks);
+void ShuffleResidues(char *residues, size_t len, uint64_t *state);
+uint64_t NextRandom(uint64_t *state);
+void ReportNullModel(NULLMODEL *model, long *observed);
+BOOL PatternName(OPTIONS *opts, int p, char *pat);
+BOOL PreparePatterns(OPTIONS *opts, PERIODIC *periodic);
+BOOL CompareOrganisms(OPTIONS *opts);
+BOOL AddOrganism(ORGSEARCH *search, char *filename);
+BOOL AddOrganismDir(ORGSEARCH *search, char *dirname);
+int CompareNames(const void *a, const void *b);
+int CompareOrganismSizes(const void *a, const void *b);
+BOOL NameOrganisms(ORGSEARCH *search);
+int CompareOrganismNames(const void *a, const void *b);
+void *OrganismWorker(void *arg);
+BOOL CountOrganism(ORGANISM *org, OPTIONS *opts, PATHITS *hits, 
+                   MATCHMASKS *masks);
+void ReportOrganisms(ORGSEARCH *search);
+BOOL RunServer(FASTAREADER *reader, OPTIONS *opts);
+void StopServer(int sig);
+CORPUS *LoadCorpus(FASTAREADER *reader);
+void FreeLoadedCorpus(CORPUS *corpus);
+void *ServerThread(void *arg);
+void ServeConnection(SERVER *server, int fd);
+void ServePattern(SERVER *server, char *args, FILE *out, 
+                  MATCHMASKS *masks);
+FILE *OpenInputFile(char *filename, BOOL *piped);
+CORPUS *OpenCorpus(char *data, size_t size);
+BOOL BuildCorpus(FASTAREADER *reader, char *filename);
+BOOL WriteRunIndex(FILE *fp, ARENA *runs, ARENA *runres, 
+                   CORPUSHEADER *header, uint64_t *offset);
+int RunBucket(int res, int len);
+int SearchIndexedCorpus(FASTAREADER *reader, OPTIONS *opts, 
+                        SEARCHRESULT **results);
+BOOL SearchRunIndex(CORPUS *corpus, char *pattern, BOOL exact, 
+                    BOOL verbose, PATHITS *hits);
+int CompareInts(const void *a, const void *b);
+BOOL WritePadding(FILE *fp, uint64_t *offset);
+void CloseFASTAReader(FASTAREADER *reader);
+void FoldToUpper(char *string, int len);
+size_t ArenaAppend(ARENA *arena, char *data, size_t len);
+void ArenaReset(ARENA *arena);
+void ArenaFree(ARENA *arena);
 void Usage(void);
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                  int *minpat, int *maxpat, char *pattern, BOOL *verbose,
-                  BOOL *quiet, BOOL *exact);
+                  OPTIONS *opts);
 
 /************************************************************************/
 int main(int argc, char **argv)
 {
-   char pattern[MAXPATLEN],
-        InFile[MAXBUFF], OutFile[MAXBUFF];
-   BOOL exact = TRUE,
-        verbose = FALSE,
-        quiet = FALSE;
-   int  maxpat = 10, 
-        minpat = 1;
-   FILE *in  = stdin,
-        *out = stdout;
+   char        InFile[MAXBUFF], 
+               OutFile[MAXBUFF];
+   FILE        *in  = stdin,
+               *out = stdout;
+   FASTAREADER *reader;
+   OPTIONS     opts;
+   PERIODIC    periodic;
+   BOOL        piped = FALSE;
 
-   if(ParseCmdLine(argc, argv, InFile, OutFile, &minpat, &maxpat, 
-                   pattern, &verbose, &quiet, &exact))
+   if(ParseCmdLine(argc, argv, InFile, OutFile, &opts))
    {
-      if(OpenStdFiles(InFile, OutFile, &in, &out))
+      if(opts.selftest)
+      {
+         return(SelfTest() ? 0 : 1);
+      }
+      else if(opts.merge)
+      {
+         return(MergePartials(&opts) ? 0 : 1);
+      }
+      else if(opts.organisms)
       {
-         if(in == stdin)
+         return(CompareOrganisms(&opts) ? 0 : 1);
+      }
+      else if((in = OpenInputFile(InFile, &piped)) == NULL)
+      {
+         fprintf(stderr, "Unable to open input file: %s\n", InFile);
+         return(1);
+      }
+      else if(OpenStdFiles(NULL, OutFile, NULL, &out))
+      {
+         if((in == stdin) && isatty(fileno(stdin)))
          {
             Usage();
          }
+         else if((reader = OpenFASTAReader(in)) == NULL)
+         {
+            fprintf(stderr, "Unable to read input file\n");
+            return(1);
+         }
          else
          {
-            if(pattern[0])
+            InitResidueIndex();
+            
+            if(opts.corpusfile[0])
+            {
+               if(!BuildCorpus(reader, opts.corpusfile))
+               {
+                  fprintf(stderr, "Unable to write corpus file %s\n",
+                          opts.corpusfile);
+                  return(1);
+               }
+            }
+            else if(opts.benchmark)
+            {
+               if(!Benchmark(reader, &opts, out))
+                  return(1);
+            }
+            else if(opts.socketfile[0])
             {
-               SearchFileForPattern(pattern, in, exact, verbose, quiet);
+               if(!RunServer(reader, &opts))
+                  return(1);
             }
             else
             {
-               SearchAllPatterns(in, exact, minpat, maxpat, 
-                                 verbose, quiet);
+               if(!PreparePatterns(&opts, &periodic))
+                  return(1);
+
+               if(opts.hitsfile[0])
+               {
+                  if(!strcmp(opts.hitsfile, "-"))
+                     opts.hitsfp = stdout;
+                  else if((opts.hitsfp = fopen(opts.hitsfile, "w")) 
+                          == NULL)
+                  {
+                     fprintf(stderr, "Unable to open hit file %s\n",
+                             opts.hitsfile);
+                     return(1);
+                  }
+                  if(!opts.bed)
+                     fprintf(opts.hitsfp, 
+                             "#label\tpattern\tstart\tend\tmatch\n");
+               }
+
+               if(opts.metricsfile[0] &&
+                  ((opts.metrics = StartMetrics(opts.metricsfile, 
+                                                opts.nthreads)) == NULL))
+               {
+                  fprintf(stderr, "Unable to open metrics file %s\n",
+                          opts.metricsfile);
+                  return(1);
+               }
+
+               if(opts.nshards && 
+                  !SelectShard(reader, opts.shard, opts.nshards))
+               {
+                  fprintf(stderr, "Sharding needs a FASTA or corpus \
+file, not a stream\n");
+                  return(1);
+               }
+               if(opts.dna)
+               {
+                  if(!SearchDNA(reader, &opts))
+                     return(1);
+               }
+               else if(opts.nnull)
+               {
+                  if(!NullModel(reader, &opts))
+                     return(1);
+               }
+               else if(!SearchFile(reader, &opts, out))
+               {
+                  return(1);
+               }
+               if((opts.hitsfp != NULL) && 
+                  (ferror(opts.hitsfp) | 
+                   ((opts.hitsfp == stdout) ? fflush(opts.hitsfp) 
+                                            : fclose(opts.hitsfp))))
+               {
+                  fprintf(stderr, "Unable to write hit file %s\n",
+                          opts.hitsfile);
+                  return(1);
+               }
+               if((opts.metrics != NULL) && !WriteMetrics(opts.metrics))
+               {
+                  fprintf(stderr, "Unable to write metrics file %s\n",
+                          opts.metricsfile);
+                  return(1);
+               }
+               if(opts.patset != NULL)
+                  FreePatternSet(opts.patset);
+            }
+            CloseFASTAReader(reader);
+            
+            if(piped && pclose(in))
+            {
+               fprintf(stderr, "Unable to decompress input file: %s\n",
+                       InFile);
+               return(1);
             }
          }
       }
@@ -130,254 +874,7062 @@ int main(int argc, char **argv)
    {
       Usage();
    }
-   
-   return(0);
+   
+   return(0);
+}
+
+/************************************************************************/
+/*>BOOL PreparePatterns(OPTIONS *opts, PERIODIC *periodic)
+   -------------------------------------------------------
+   I/O:     OPTIONS  *opts      Search options. The pattern set is read
+                                or the -s pattern compiled
+   Output:  PERIODIC *periodic  Space for the compiled -s pattern
+   Returns: BOOL                Success?
+
+   Reads the -S patterns or compiles the -s pattern, reporting any 
+   error. InitResidueIndex() must have been called.
+
+   16.10.26  Original (from main())   By: ACRM
+*/
+BOOL PreparePatterns(OPTIONS *opts, PERIODIC *periodic)
+{
+   if(opts->histogram)
+   {
+      /* Patterns are ignored for the histogram                         */
+      opts->patfile[0] = opts->pattern[0] = '\0';
+   }
+   else if(opts->patfile[0])
+   {
+      if((opts->patset = ReadPatternSet(opts->patfile, opts->mismatches))
+         == NULL)
+      {
+         fprintf(stderr, "Unable to read patterns from %s\n",
+                 opts->patfile);
+         return(FALSE);
+      }
+   }
+   else if(opts->pattern[0])
+   {
+      switch(rpCompilePattern(opts->pattern, periodic))
+      {
+      case 1:
+         opts->periodic = periodic;
+         break;
+      case (-1):
+         fprintf(stderr, "Invalid pattern: %s\n", opts->pattern);
+         return(FALSE);
+      }
+
+      /* Approximate matches are found with the PERIODIC kernel, which 
+         needs a regular pattern
+      */
+      if(opts->mismatches)
+      {
+         if(!periodic->patlen)
+         {
+            fprintf(stderr, "Pattern cannot be used with -k: %s\n", 
+                    opts->pattern);
+            return(FALSE);
+         }
+         periodic->mismatches = opts->mismatches;
+         opts->periodic       = periodic;
+      }
+   }
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>BOOL SearchFile(FASTAREADER *reader, OPTIONS *opts, FILE *out)
+   ---------------------------------------------------------------
+   Input:   FASTAREADER *reader Input FASTA file
+            OPTIONS     *opts   Search options
+            FILE        *out    File for partial results
+   Returns: BOOL                Success (FALSE if the partial results
+                                or checkpoint could not be written)
+
+   Searches the file. Searching is done by RunSearch() so it may be 
+   threaded. The results are reported, or written as a partial result
+   file when searching one shard of the file.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Added checkpoints with --incremental
+   16.10.26  Reporting is timed for --metrics
+   16.10.26  Uses the run index of a corpus for a single pattern
+*/
+BOOL SearchFile(FASTAREADER *reader, OPTIONS *opts, FILE *out)
+{
+   SEARCHRESULT *results;
+   int          nresults, npat;
+   BOOL         ok = TRUE;
+   double       start = GetTime();
+
+   if(opts->minpat < 1)
+      opts->minpat = 1;
+   if(opts->maxpat < opts->minpat)
+      opts->maxpat = opts->minpat - 1;
+   npat = CountPatterns(opts);
+
+   if(opts->ckptfile[0])
+   {
+      if((nresults = SearchIncremental(reader, opts, npat, &results)) 
+         < 0)
+         return(FALSE);
+   }
+   else if((nresults = SearchIndexedCorpus(reader, opts, &results)) 
+           == 0)
+   {
+      nresults = RunSearch(reader, opts, npat, &results);
+   }
+   start = GetTime();
+   
+   if(opts->nshards)
+   {
+      if(!WritePartial(out, opts, results, nresults, npat) || 
+         fflush(out))
+      {
+         fprintf(stderr, "Unable to write partial results\n");
+         ok = FALSE;
+      }
+   }
+   else
+   {
+      ReportResults(results, nresults, opts);
+   }
+   fflush(stdout);
+   if(opts->metrics != NULL)
+      opts->metrics->output += GetTime() - start;
+   
+   FreeSearchResults(results, nresults, npat);
+   return(ok);
+}
+
+/************************************************************************/
+/*>int SearchIndexedCorpus(FASTAREADER *reader, OPTIONS *opts, 
+                           SEARCHRESULT **results)
+   ------------------------------------------------------------
+   Input:   FASTAREADER  *reader   Input file
+            OPTIONS      *opts     Search options
+   Output:  SEARCHRESULT **results Results (one) of the search
+   Returns: int                    Number of results: 0 if the search
+                                   cannot use a run index
+
+   Searches a whole corpus for a single pattern with the run index. The
+   search must be done by RunSearch() if the input is not an indexed 
+   corpus, if it is sharded or resumed, or if hits or metrics are 
+   wanted.
+
+   16.10.26  Original   By: ACRM
+*/
+int SearchIndexedCorpus(FASTAREADER *reader, OPTIONS *opts, 
+                        SEARCHRESULT **results)
+{
+   CORPUS  *corpus = reader->corpus;
+   PATHITS hits;
+   int     k;
+
+   if((corpus == NULL) || (corpus->runs == NULL) || 
+      opts->histogram || (opts->patset != NULL) || !opts->pattern[0] ||
+      opts->mismatches ||
+      (opts->hitsfp != NULL) || (opts->metrics != NULL) ||
+      (reader->pos != 0) || (reader->size != corpus->nseq))
+      return(0);
+
+   memset(&hits, 0, sizeof(PATHITS));
+   hits.lastseq = (-1);
+   if(!SearchRunIndex(corpus, opts->pattern, opts->exact, opts->verbose,
+                      &hits))
+      return(0);
+
+   /* Labels are stored for the matching sequences only                 */
+   *results = AllocSearchResults(1, 1);
+   (*results)[0].hits[0].count = hits.count;
+   for(k=0; k<hits.nseqs; k++)
+   {
+      if((StoreString(&((*results)[0].labels), corpus->labels + 
+                      corpus->labeloffsets[hits.seqs[k]],
+                      (int)(corpus->labeloffsets[hits.seqs[k]+1] - 
+                            corpus->labeloffsets[hits.seqs[k]] - 1)) 
+          < 0) ||
+         !AddHitSequence(&((*results)[0].hits[0]), k))
+      {
+         fprintf(stderr, "No memory for sequence labels\n");
+         exit(1);
+      }
+   }
+   free(hits.seqs);
+   return(1);
+}
+
+/************************************************************************/
+/*>BOOL SearchRunIndex(CORPUS *corpus, char *pattern, BOOL exact, 
+                       BOOL verbose, PATHITS *hits)
+   --------------------------------------------------------------
+   Input:   CORPUS  *corpus     Corpus with a run index
+            char    *pattern    The pattern
+            BOOL    exact       Do exact matching
+            BOOL    verbose     Record the matching sequences
+   I/O:     PATHITS *hits       Count and (if verbose) the corpus index
+                                of each matching sequence, in order
+   Returns: BOOL                FALSE if the pattern cannot be searched
+                                with the index
+
+   A simple pattern (see rpCompilePattern()) with n repeated residues 
+   matches only in runs of that residue with n or more occurrences, so 
+   only the buckets of the run index for those runs are visited and 
+   the matches in each run are counted as in 
+   ScanSequenceForPatternSet(). The work depends on the number of runs
+   which can match rather than the size of the corpus. Runs of one
+   occurrence are not indexed, so patterns with n of 1, as well as 
+   PERIODIC patterns, must be searched by scanning.
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL SearchRunIndex(CORPUS *corpus, char *pattern, BOOL exact, 
+                    BOOL verbose, PATHITS *hits)
+{
+   PERIODIC periodic;
+   RUNENTRY *run;
+   uint64_t i;
+   char     *sequence;
+   int      *seqs = NULL,
+            nseqs = 0,
+            patlen, n, r, b, seqlen, kmax, k;
+   long     count = 0;
+
+   patlen = strlen(pattern);
+   n      = (patlen + 1) / 2;
+   if((corpus->runs == NULL) || (n < 2) ||
+      ((r = gResIndex[(unsigned char)pattern[0]]) < 0) ||
+      (rpCompilePattern(pattern, &periodic) != 0))
+      return(FALSE);
+
+   if(verbose &&
+      ((seqs = (int *)malloc((corpus->nruns ? corpus->nruns : 1) * 
+                             sizeof(int))) == NULL))
+   {
+      fprintf(stderr, "No memory for matching sequences\n");
+      exit(1);
+   }
+   
+   for(b=RunBucket(r, n); b<(r+1)*RUNBUCKETS; b++)
+   {
+      for(i=corpus->runfirst[b]; i<corpus->runfirst[b+1]; i++)
+      {
+         run = corpus->runs + i;
+         if(run->len < (uint32_t)n)
+            continue;
+
+         if((run->seq >= corpus->nseq) ||
+            (run->start >= corpus->seqoffsets[run->seq+1] - 
+                           corpus->seqoffsets[run->seq]))
+         {
+            fprintf(stderr, "Corpus run index is corrupt\n");
+            free(seqs);
+            return(FALSE);
+         }
+         sequence = corpus->residues + corpus->seqoffsets[run->seq];
+         seqlen   = (int)(corpus->seqoffsets[run->seq+1] - 
+                          corpus->seqoffsets[run->seq]);
+
+         /* Last start in this run which fits in the sequence           */
+         if((kmax = seqlen - patlen - (int)run->start) < 0)
+            continue;
+         kmax /= 2;
+         if(kmax > (int)run->len - n)
+            kmax = (int)run->len - n;
+         
+         if(exact)
+            k = rpCheckBounds(sequence, seqlen, pattern, patlen,
+                              (int)run->start) ? 1 : 0;
+         else
+            k = kmax + 1;
+
+         if(k)
+         {
+            count += k;
+            if(verbose)
+               seqs[nseqs++] = (int)run->seq;
+         }
+      }
+   }
+
+   /* Runs come by length so the sequences must be put in order         */
+   if(verbose)
+   {
+      qsort(seqs, nseqs, sizeof(int), CompareInts);
+      for(k=0; k<nseqs; k++)
+      {
+         if(!AddHitSequence(hits, seqs[k]))
+         {
+            fprintf(stderr, "No memory for matching sequences\n");
+            exit(1);
+         }
+      }
+      free(seqs);
+   }
+   hits->count += count;
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>int CompareInts(const void *a, const void *b)
+   ---------------------------------------------
+   qsort() comparison for ints
+
+   16.10.26  Original   By: ACRM
+*/
+int CompareInts(const void *a, const void *b)
+{
+   int x = *(const int *)a,
+       y = *(const int *)b;
+   
+   return((x > y) - (x < y));
+}
+
+/************************************************************************/
+/*>int CountPatterns(OPTIONS *opts)
+   --------------------------------
+   Input:   OPTIONS *opts       Search options
+   Returns: int                 Number of patterns in each result
+
+   Gives the number of PATHITS needed in each result for the type of 
+   search
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Added --dna
+*/
+int CountPatterns(OPTIONS *opts)
+{
+   if(opts->dna)
+      return(NBASES * (opts->maxpat + 1));
+   if(opts->histogram)
+      return(1);
+   if(opts->patset != NULL)
+      return(opts->patset->npatterns);
+   if(opts->pattern[0])
+      return(1);
+   return(NRESIDUES * (opts->maxpat + 1));
+}
+
+/************************************************************************/
+/*>void ReportResults(SEARCHRESULT *results, int nresults, OPTIONS *opts)
+   ----------------------------------------------------------------------
+   Input:   SEARCHRESULT *results  Results for each part of the file
+            int          nresults  Number of results
+            OPTIONS      *opts     Search options
+
+   Reports the results for the type of search
+
+   16.10.26  Original   By: ACRM
+*/
+void ReportResults(SEARCHRESULT *results, int nresults, OPTIONS *opts)
+{
+   if(opts->histogram)
+      ReportHistogram(results, nresults, opts);
+   else if(opts->patset != NULL)
+      ReportPatternSet(results, nresults, opts);
+   else if(opts->pattern[0])
+      ReportPattern(results, nresults, opts);
+   else
+      ReportAllPatterns(results, nresults, opts);
+}
+
+/************************************************************************/
+/*>void ReportAllPatterns(SEARCHRESULT *results, int nresults, 
+                          OPTIONS *opts)
+   ---------------------------------------------------------------
+   Input:   SEARCHRESULT *results  Results for each part of the file
+            int          nresults  Number of results
+            OPTIONS      *opts     Search options
+
+   Tests every pattern of the form cXcX...c for each residue c and for
+   minpat..maxpat occurrences of c. Rather than scanning the file once
+   per pattern, each sequence is read once and all the maximal 
+   alternating runs in it are found and used to update the counts for
+   every pattern. Results are reported in the same order as scanning
+   the patterns one at a time.
+
+   07.03.13  Original   By: ACRM
+   16.10.26  Rewritten as a single pass over the file
+   16.10.26  Takes a FASTAREADER and OPTIONS. Searching is done by 
+             RunSearch() so it may be threaded
+   16.10.26  Renamed from SearchAllPatterns(). Only reports the results
+             so that they may come from partial files
+   16.10.26  Reports nucleotides with --dna
+*/
+void ReportAllPatterns(SEARCHRESULT *results, int nresults, 
+                       OPTIONS *opts)
+{
+   char         aa,
+                *letters = (opts->dna ? BASES : RESIDUES),
+                *pat;
+   int          i, j, k, c,
+                npat;
+   long         count;
+
+   npat = opts->maxpat + 1;
+   if((pat = (char *)malloc((2 * npat + 1) * sizeof(char))) == NULL)
+   {
+      fprintf(stderr, "No memory for pattern\n");
+      exit(1);
+   }
+
+   /* Report the results in the order the patterns were always tested.
+      Each result covers a consecutive part of the file, so listing the
+      labels from each result in turn gives them in file order
+   */
+   for(j=0; letters[j]; j++)
+   {
+      aa = letters[j];
+      for(i=opts->minpat; i<=opts->maxpat; i++)
+      {
+         for(k=0; k<i; k++)
+         {
+            pat[k*2] = aa;
+            pat[k*2+1] = 'X';
+         }
+         pat[i*2-1] = '\0';
+
+         fprintf(stdout, "Testing pattern '%s':\n", pat);
+         for(c=0, count=0; c<nresults; c++)
+         {
+            PATHITS *h = &(results[c].hits[j*npat + i]);
+            
+            if(opts->verbose)
+            {
+               for(k=0; k<h->nseqs; k++)
+               {
+                  fprintf(stdout, "%s matches\n", 
+                          results[c].labels.buffer + 
+                          results[c].labels.offsets[h->seqs[k]]);
+               }
+            }
+            count += h->count;
+         }
+         fprintf(stdout, "Total matches: %ld\n", count);
+         fflush(stdout);
+      }
+   }
+
+   free(pat);
+}
+
+/************************************************************************/
+/*>void ReportPattern(SEARCHRESULT *results, int nresults, OPTIONS *opts)
+   ----------------------------------------------------------------------
+   Input:   SEARCHRESULT *results  Results for each part of the file
+            int          nresults  Number of results
+            OPTIONS      *opts     Search options
+
+   Reports the results for the single pattern given with -s
+
+   07.03.13  Original   By: ACRM
+   16.10.26  Takes a FASTAREADER and OPTIONS. Searching is done by 
+             RunSearch() so it may be threaded
+   16.10.26  Renamed from SearchFileForPattern(). Only reports the 
+             results
+*/
+void ReportPattern(SEARCHRESULT *results, int nresults, OPTIONS *opts)
+{
+   int          c, k;
+   long         count = 0;
+
+   for(c=0; c<nresults; c++)
+   {
+      if(opts->verbose)
+      {
+         for(k=0; k<results[c].hits[0].nseqs; k++)
+         {
+            fprintf(stdout, "%s matches\n", 
+                    results[c].labels.buffer + 
+                    results[c].labels.offsets[results[c].hits[0].seqs[k]]);
+         }
+      }
+      count += results[c].hits[0].count;
+   }
+   fprintf(stdout, "Total matches: %ld\n", count);
+}
+
+/************************************************************************/
+/*>void ReportPatternSet(SEARCHRESULT *results, int nresults, 
+                         OPTIONS *opts)
+   --------------------------------------------------------------
+   Input:   SEARCHRESULT *results  Results for each part of the file
+            int          nresults  Number of results
+            OPTIONS      *opts     Search options
+
+   Reports the results for all the patterns read with -S, which are 
+   searched in a single pass. Results for each pattern are given in the
+   order the patterns were read, in the same form as when testing all 
+   patterns.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Renamed from SearchPatternSet(). Only reports the results
+*/
+void ReportPatternSet(SEARCHRESULT *results, int nresults, 
+                      OPTIONS *opts)
+{
+   PATTERNSET   *patset = opts->patset;
+   PATHITS      *h;
+   int          c, i, k;
+   long         count;
+
+   for(i=0; i<patset->npatterns; i++)
+   {
+      fprintf(stdout, "Testing pattern '%s':\n", patset->patterns[i]);
+      for(c=0, count=0; c<nresults; c++)
+      {
+         h = &(results[c].hits[i]);
+         if(opts->verbose)
+         {
+            for(k=0; k<h->nseqs; k++)
+            {
+               fprintf(stdout, "%s matches\n", 
+                       results[c].labels.buffer + 
+                       results[c].labels.offsets[h->seqs[k]]);
+            }
+         }
+         count += h->count;
+      }
+      fprintf(stdout, "Total matches: %ld\n", count);
+   }
+   fflush(stdout);
+}
+
+/************************************************************************/
+/*>PATTERNSET *ReadPatternSet(char *filename, int mismatches)
+   ----------------------------------------------------------
+   Input:   char       *filename  File of patterns
+            int        mismatches Substitutions allowed (-k)
+   Returns: PATTERNSET *          The patterns (NULL on error)
+
+   Reads a file of patterns, one per line. Blank lines and lines 
+   starting with # are ignored. The patterns are sorted by residue and
+   by the number of repeated residues so that, for each run in a 
+   sequence, only the patterns for that residue which are no longer 
+   than the run need to be tested. Patterns for residues other than 
+   the standard 20, and PERIODIC patterns, are placed at the end. With
+   mismatches, every pattern is compiled as a PERIODIC pattern so that
+   it is searched by rpFindApproxStarts().
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Compiles PERIODIC patterns
+   16.10.26  Added mismatches
+*/
+PATTERNSET *ReadPatternSet(char *filename, int mismatches)
+{
+   FILE       *fp;
+   PATTERNSET *patset;
+   PERIODIC   periodic;
+   char       buffer[MAXPATLEN+1],
+              *p;
+   int        max = 0,
+              i, j, k, r, len, tmp;
+   int        *bucket;
+
+   if((fp = fopen(filename, "r")) == NULL)
+      return(NULL);
+   if((patset = (PATTERNSET *)calloc(1, sizeof(PATTERNSET))) == NULL)
+   {
+      fclose(fp);
+      return(NULL);
+   }
+
+   while(fgets(buffer, MAXPATLEN+1, fp))
+   {
+      TERMINATE(buffer);
+      for(p=buffer; *p==' ' || *p=='\t'; p++);
+      for(len=strlen(p); len && (p[len-1]==' ' || p[len-1]=='\t' ||
+                                 p[len-1]=='\r'); len--)
+         p[len-1] = '\0';
+      if(!len || (*p == '#'))
+         continue;
+
+      if(patset->npatterns >= max)
+      {
+         max = max ? 2*max : 64;
+         if((patset->patterns = (char **)realloc(patset->patterns,
+                                                 max * sizeof(char *)))
+            == NULL)
+         {
+            fclose(fp);
+            return(NULL);
+         }
+      }
+      if((patset->patterns[patset->npatterns] = strdup(p)) == NULL)
+      {
+         fclose(fp);
+         return(NULL);
+      }
+      patset->npatterns++;
+   }
+   fclose(fp);
+
+   if(!patset->npatterns)
+   {
+      FreePatternSet(patset);
+      return(NULL);
+   }
+
+   patset->patlen  = (int *)malloc(patset->npatterns * sizeof(int));
+   patset->nrepeat = (int *)malloc(patset->npatterns * sizeof(int));
+   patset->order   = (int *)malloc(patset->npatterns * sizeof(int));
+   patset->periodic = (PERIODIC **)calloc(patset->npatterns, 
+                                          sizeof(PERIODIC *));
+   bucket          = (int *)malloc(patset->npatterns * sizeof(int));
+   if((patset->patlen == NULL) || (patset->nrepeat == NULL) ||
+      (patset->order == NULL) || (patset->periodic == NULL) ||
+      (bucket == NULL))
+   {
+      free(bucket);
+      FreePatternSet(patset);
+      return(NULL);
+   }
+
+   /* Count the patterns for each residue                               */
+   for(r=0; r<=NRESIDUES; r++)
+      patset->first[r] = 0;
+   for(i=0; i<patset->npatterns; i++)
+   {
+      patset->patlen[i]  = strlen(patset->patterns[i]);
+      patset->nrepeat[i] = (patset->patlen[i] + 1) / 2;
+      r = gResIndex[(unsigned char)patset->patterns[i][0]];
+      bucket[i] = (r < 0) ? NRESIDUES : r;
+
+      k = rpCompilePattern(patset->patterns[i], &periodic);
+      if(mismatches && (k >= 0))
+      {
+         k = periodic.patlen ? 1 : (-1);
+         periodic.mismatches = mismatches;
+      }
+      switch(k)
+      {
+      case 1:
+         if((patset->periodic[i] = (PERIODIC *)malloc(sizeof(PERIODIC)))
+            == NULL)
+         {
+            free(bucket);
+            FreePatternSet(patset);
+            return(NULL);
+         }
+         *(patset->periodic[i]) = periodic;
+         bucket[i] = NRESIDUES;
+         break;
+      case (-1):
+         fprintf(stderr, "Invalid pattern: %s\n", patset->patterns[i]);
+         free(bucket);
+         FreePatternSet(patset);
+         return(NULL);
+      }
+      if(bucket[i] < NRESIDUES)
+         patset->first[bucket[i]+1]++;
+   }
+   for(r=0; r<NRESIDUES; r++)
+      patset->first[r+1] += patset->first[r];
+
+   /* Place each pattern in its residue's section, in file order, with
+      the other patterns at the end
+   */
+   for(i=0, k=patset->first[NRESIDUES]; i<patset->npatterns; i++)
+   {
+      if(bucket[i] == NRESIDUES)
+         patset->order[k++] = i;
+   }
+   for(r=0; r<NRESIDUES; r++)
+   {
+      for(i=0, k=patset->first[r]; i<patset->npatterns; i++)
+      {
+         if(bucket[i] == r)
+            patset->order[k++] = i;
+      }
+      
+      /* Insertion sort by number of repeats within the residue         */
+      for(i=patset->first[r]+1; i<patset->first[r+1]; i++)
+      {
+         tmp = patset->order[i];
+         for(j=i; (j>patset->first[r]) && 
+                  (patset->nrepeat[patset->order[j-1]] > 
+                   patset->nrepeat[tmp]); j--)
+            patset->order[j] = patset->order[j-1];
+         patset->order[j] = tmp;
+      }
+   }
+
+   free(bucket);
+   return(patset);
+}
+
+/************************************************************************/
+/*>void FreePatternSet(PATTERNSET *patset)
+   ---------------------------------------
+   I/O:     PATTERNSET *patset  Pattern set
+
+   Frees a set of patterns
+
+   16.10.26  Original   By: ACRM
+*/
+void FreePatternSet(PATTERNSET *patset)
+{
+   int i;
+   
+   for(i=0; i<patset->npatterns; i++)
+   {
+      free(patset->patterns[i]);
+      if(patset->periodic != NULL)
+         free(patset->periodic[i]);
+   }
+   free(patset->patterns);
+   free(patset->periodic);
+   free(patset->patlen);
+   free(patset->nrepeat);
+   free(patset->order);
+   free(patset);
+}
+
+/************************************************************************/
+/*>void ReportHistogram(SEARCHRESULT *results, int nresults, 
+                        OPTIONS *opts)
+   -------------------------------------------------------------
+   Input:   SEARCHRESULT *results  Results for each part of the file
+            int          nresults  Number of results
+            OPTIONS      *opts     Search options
+
+   Finds the distribution of the lengths of alternating runs (cXcX...c)
+   for every residue in one pass with no limit on the length. The 
+   output is a tab-separated table with a row for each residue and a 
+   column for each number of repeated residues giving the number of 
+   matches to that pattern. These are the same counts that are given by
+   testing all patterns with -m set to the longest run. In verbose mode
+   a second table gives the longest match for each residue in each 
+   sequence. With -b the first table is also written in binary.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Renamed from SearchHistogram(). Only reports the results
+   16.10.26  Table is written by WriteHistogramTable()
+*/
+void ReportHistogram(SEARCHRESULT *results, int nresults, OPTIONS *opts)
+{
+   HISTOGRAM    total;
+   int          c, j, k, *maxima;
+   char         *label;
+
+   memset(&total, 0, sizeof(HISTOGRAM));
+   for(c=0; c<nresults; c++)
+      AddHistogram(&total, &(results[c].hist));
+
+   WriteHistogramTable(stdout, &total, opts->exact);
+
+   if(opts->verbose)
+   {
+      fprintf(stdout, "\nSequence");
+      for(j=0; j<NRESIDUES; j++)
+         fprintf(stdout, "\t%c", RESIDUES[j]);
+      fprintf(stdout, "\n");
+      
+      for(c=0; c<nresults; c++)
+      {
+         maxima = (int *)results[c].maxima.data;
+         for(k=0; k<results[c].labels.nstrings; k++)
+         {
+            label = results[c].labels.buffer + 
+                    results[c].labels.offsets[k];
+            if(*label == '>')
+               label++;
+            fprintf(stdout, "%s", label);
+            for(j=0; j<NRESIDUES; j++)
+               fprintf(stdout, "\t%d", maxima[k*NRESIDUES + j]);
+            fprintf(stdout, "\n");
+         }
+      }
+   }
+   fflush(stdout);
+
+   if(opts->histfile[0])
+   {
+      if(!WriteHistogram(opts->histfile, &total, opts->exact))
+      {
+         fprintf(stderr, "Unable to write histogram file %s\n", 
+                 opts->histfile);
+      }
+   }
+
+   FreeHistogram(&total);
+}
+
+/************************************************************************/
+/*>void WriteHistogramTable(FILE *out, HISTOGRAM *hist, BOOL exact)
+   ----------------------------------------------------------------
+   Input:   FILE      *out      Output file
+            HISTOGRAM *hist     Run length distribution
+            BOOL      exact     Give exact rather than non-exact counts
+
+   Writes a tab-separated table with a row for each residue and a 
+   column for each number of repeated residues giving the number of
+   matches to that pattern
+
+   16.10.26  Original (from ReportHistogram())   By: ACRM
+*/
+void WriteHistogramTable(FILE *out, HISTOGRAM *hist, BOOL exact)
+{
+   long *counts;
+   int  i, j;
+
+   if((counts = (long *)malloc(NRESIDUES * (hist->maxlen + 1) * 
+                               sizeof(long))) == NULL)
+   {
+      fprintf(stderr, "No memory for histogram\n");
+      exit(1);
+   }
+   GetHistogramCounts(hist, exact, counts);
+
+   fprintf(out, "Residue");
+   for(i=1; i<=hist->maxlen; i++)
+      fprintf(out, "\t%d", i);
+   fprintf(out, "\n");
+   for(j=0; j<NRESIDUES; j++)
+   {
+      fprintf(out, "%c", RESIDUES[j]);
+      for(i=1; i<=hist->maxlen; i++)
+         fprintf(out, "\t%ld", counts[j*(hist->maxlen+1) + i]);
+      fprintf(out, "\n");
+   }
+
+   free(counts);
+}
+
+/************************************************************************/
+/*>BOOL WritePartial(FILE *fp, OPTIONS *opts, SEARCHRESULT *results, 
+                     int nresults, int npat)
+   ------------------------------------------------------------------
+   Input:   FILE         *fp       File to write
+            OPTIONS      *opts     Search options
+            SEARCHRESULT *results  Results for each part of the shard
+            int          nresults  Number of results
+            int          npat      Number of patterns in each result
+   Returns: BOOL                   Success?
+
+   Writes the results for one shard so that they can be combined with
+   the others by MergePartials(). The file has a PARTIALHEADER, the 
+   pattern(s) searched for and then each result in turn: the count and 
+   matching sequences for each pattern, the label pool, the histogram 
+   and the maxima for each sequence. Numbers are written in the byte 
+   order of the machine, as for WriteHistogram().
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL WritePartial(FILE *fp, OPTIONS *opts, SEARCHRESULT *results, 
+                  int nresults, int npat)
+{
+   PARTIALHEADER header;
+   SEARCHRESULT  *r;
+   int           c, i;
+   int32_t       size[2];
+   int64_t       used;
+   BOOL          ok = TRUE;
+
+   SetPartialHeader(&header, opts, nresults, npat);
+   ok = ok && (fwrite(&header, sizeof(PARTIALHEADER), 1, fp) == 1);
+   ok = ok && WritePartialString(fp, opts->pattern);
+   for(i=0; i<(int)header.npatterns; i++)
+      ok = ok && WritePartialString(fp, opts->patset->patterns[i]);
+
+   for(c=0; ok && (c<nresults); c++)
+   {
+      r = &(results[c]);
+      for(i=0; ok && (i<npat); i++)
+      {
+         ok = ok && (fwrite(&(r->hits[i].count), sizeof(long), 1, fp) 
+                     == 1);
+         ok = ok && (fwrite(&(r->hits[i].nseqs), sizeof(int), 1, fp) 
+                     == 1);
+         ok = ok && (!r->hits[i].nseqs ||
+                     (fwrite(r->hits[i].seqs, sizeof(int), 
+                             r->hits[i].nseqs, fp) == 
+                      (size_t)r->hits[i].nseqs));
+      }
+
+      used = r->labels.used;
+      ok = ok && (fwrite(&(r->labels.nstrings), sizeof(int), 1, fp) == 1);
+      ok = ok && (fwrite(&used, sizeof(int64_t), 1, fp) == 1);
+      if(used)
+      {
+         ok = ok && (fwrite(r->labels.buffer, 1, used, fp) == 
+                     (size_t)used);
+         ok = ok && (fwrite(r->labels.offsets, sizeof(long), 
+                            r->labels.nstrings, fp) == 
+                     (size_t)r->labels.nstrings);
+      }
+
+      size[0] = r->hist.size;
+      size[1] = r->hist.maxlen;
+      ok = ok && (fwrite(size, sizeof(int32_t), 2, fp) == 2);
+      if(r->hist.size)
+      {
+         ok = ok && (fwrite(r->hist.runs, sizeof(long), 
+                            NRESIDUES * r->hist.size, fp) == 
+                     (size_t)(NRESIDUES * r->hist.size));
+         ok = ok && (fwrite(r->hist.exact, sizeof(long), 
+                            NRESIDUES * r->hist.size, fp) == 
+                     (size_t)(NRESIDUES * r->hist.size));
+      }
+
+      used = r->maxima.used;
+      ok = ok && (fwrite(&used, sizeof(int64_t), 1, fp) == 1);
+      ok = ok && (!used || 
+                  (fwrite(r->maxima.data, 1, used, fp) == (size_t)used));
+   }
+
+   return(ok);
+}
+
+/************************************************************************/
+/*>void SetPartialHeader(PARTIALHEADER *header, OPTIONS *opts, 
+                         int nresults, int npat)
+   -----------------------------------------------------------
+   Output:  PARTIALHEADER *header    Header for a partial result file
+   Input:   OPTIONS       *opts      Search options
+            int           nresults   Number of results
+            int           npat       Number of patterns in each result
+
+   Fills in the header of a partial result file for a search
+
+   16.10.26  Original   By: ACRM
+*/
+void SetPartialHeader(PARTIALHEADER *header, OPTIONS *opts, 
+                      int nresults, int npat)
+{
+   memset(header, 0, sizeof(PARTIALHEADER));
+   memcpy(header->magic, PARTMAGIC, 8);
+   header->shard     = opts->shard;
+   header->nshards   = opts->nshards;
+   header->flags     = (opts->exact     ? PARTEXACT     : 0) |
+                       (opts->verbose   ? PARTVERBOSE   : 0) |
+                       (opts->histogram ? PARTHISTOGRAM : 0);
+   header->minpat    = opts->minpat;
+   header->maxpat    = opts->maxpat;
+   header->npat      = npat;
+   header->nresults  = nresults;
+   header->npatterns = (opts->patset != NULL) ? 
+                       opts->patset->npatterns : 0;
+   header->longsize  = sizeof(long);
+}
+
+/************************************************************************/
+/*>BOOL WritePartialString(FILE *fp, char *string)
+   -----------------------------------------------
+   Input:   FILE   *fp          File to write
+            char   *string      String to write
+   Returns: BOOL                Success?
+
+   Writes a string to a partial result file as its length and the
+   characters
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL WritePartialString(FILE *fp, char *string)
+{
+   uint32_t len = strlen(string);
+   
+   return((fwrite(&len, sizeof(uint32_t), 1, fp) == 1) &&
+          (fwrite(string, 1, len, fp) == len));
+}
+
+/************************************************************************/
+/*>BOOL ReadPartial(FILE *fp, PARTIALHEADER *header, char *pattern,
+                    PATTERNSET **patset, SEARCHRESULT **results)
+   ----------------------------------------------------------------
+   Input:   FILE          *fp        Partial result file
+   Output:  PARTIALHEADER *header    Header from the file
+            char          *pattern   Pattern from -s (MAXPATLEN chars)
+            PATTERNSET    **patset   Patterns from -S (NULL if none)
+            SEARCHRESULT  **results  Results (header->nresults of them,
+                                     NULL on failure)
+   Returns: BOOL                     Success?
+
+   Reads a file written by WritePartial(). Nothing in the file is 
+   trusted: the number of patterns in each result must be the number
+   searched for with the options in the header, every count must fit 
+   in what is left of the file and every sequence index and label 
+   offset must be in range (see CheckPartialResult()).
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Takes an open file so it can follow a checkpoint header
+   17.10.26  Checks the counts, indices and offsets read from the file.
+             The results are freed on failure
+*/
+BOOL ReadPartial(FILE *fp, PARTIALHEADER *header, char *pattern,
+                 PATTERNSET **patset, SEARCHRESULT **results)
+{
+   SEARCHRESULT *r;
+   char         buffer[MAXPATLEN];
+   int          c, i, nresults;
+   int32_t      size[2];
+   int64_t      used, npat;
+   BOOL         ok = TRUE;
+
+   *patset  = NULL;
+   *results = NULL;
+   if((fread(header, sizeof(PARTIALHEADER), 1, fp) != 1) ||
+      strncmp(header->magic, PARTMAGIC, 8) ||
+      (header->longsize != sizeof(long)) || 
+      !ReadPartialString(fp, pattern))
+      return(FALSE);
+
+   /* Each pattern takes at least its length                            */
+   if(!PartialFits(fp, header->npatterns, sizeof(uint32_t)))
+      return(FALSE);
+   if(header->npatterns)
+   {
+      if((*patset = (PATTERNSET *)calloc(1, sizeof(PATTERNSET))) == NULL)
+         ok = FALSE;
+      else if(((*patset)->patterns = (char **)calloc(header->npatterns, 
+                                                     sizeof(char *)))
+              == NULL)
+         ok = FALSE;
+      for(i=0; ok && (i<(int)header->npatterns); i++)
+      {
+         if(!ReadPartialString(fp, buffer) ||
+            (((*patset)->patterns[i] = strdup(buffer)) == NULL))
+            ok = FALSE;
+         else
+            (*patset)->npatterns++;
+      }
+   }
+
+   /* The patterns in each result must be those counted for the options
+      in the header, as given by CountPatterns() for the search
+   */
+   if((header->minpat < 1) || (header->maxpat + 1 < header->minpat) ||
+      (header->maxpat >= INT_MAX / NRESIDUES))
+      return(FALSE);
+   if(header->flags & PARTHISTOGRAM)
+      npat = 1;
+   else if(header->npatterns)
+      npat = header->npatterns;
+   else if(pattern[0])
+      npat = 1;
+   else
+      npat = NRESIDUES * ((int64_t)header->maxpat + 1);
+   if(!ok || (header->npat != npat) || (header->nresults > INT_MAX) ||
+      !PartialFits(fp, header->nresults, 
+                   npat * (sizeof(long) + sizeof(int)) + 
+                   sizeof(int) + 2 * sizeof(int64_t) + 
+                   2 * sizeof(int32_t)))
+      return(FALSE);
+
+   nresults = (int)header->nresults;
+   *results = AllocSearchResults(nresults, header->npat);
+   for(c=0; ok && (c<nresults); c++)
+   {
+      r = &((*results)[c]);
+      for(i=0; ok && (i<(int)header->npat); i++)
+      {
+         ok = ok && (fread(&(r->hits[i].count), sizeof(long), 1, fp) 
+                     == 1);
+         ok = ok && (fread(&(r->hits[i].nseqs), sizeof(int), 1, fp) 
+                     == 1) &&
+                    (r->hits[i].nseqs >= 0) &&
+                    PartialFits(fp, r->hits[i].nseqs, sizeof(int));
+         if(ok && r->hits[i].nseqs)
+         {
+            r->hits[i].maxseqs = r->hits[i].nseqs;
+            if((r->hits[i].seqs = (int *)malloc(r->hits[i].nseqs * 
+                                                sizeof(int))) == NULL)
+               ok = FALSE;
+            ok = ok && (fread(r->hits[i].seqs, sizeof(int), 
+                              r->hits[i].nseqs, fp) == 
+                        (size_t)r->hits[i].nseqs);
+         }
+      }
+
+      ok = ok && (fread(&(r->labels.nstrings), sizeof(int), 1, fp) == 1);
+      ok = ok && (fread(&used, sizeof(int64_t), 1, fp) == 1) &&
+                 (r->labels.nstrings >= 0) && (used >= 0) &&
+                 (used || !r->labels.nstrings) &&
+                 PartialFits(fp, used, 1) &&
+                 PartialFits(fp, r->labels.nstrings, sizeof(long));
+      if(ok && used)
+      {
+         r->labels.used = r->labels.size = used;
+         r->labels.maxstrings = r->labels.nstrings;
+         if(((r->labels.buffer = (char *)malloc(used)) == NULL) ||
+            ((r->labels.offsets = (long *)malloc(r->labels.nstrings * 
+                                                 sizeof(long))) == NULL))
+            ok = FALSE;
+         ok = ok && (fread(r->labels.buffer, 1, used, fp) == 
+                     (size_t)used);
+         ok = ok && (fread(r->labels.offsets, sizeof(long), 
+                           r->labels.nstrings, fp) == 
+                     (size_t)r->labels.nstrings);
+      }
+
+      ok = ok && (fread(size, sizeof(int32_t), 2, fp) == 2) &&
+                 (size[0] >= 0) && (size[1] >= 0) &&
+                 (size[1] < (size[0] ? size[0] : 1)) &&
+                 PartialFits(fp, 2 * (int64_t)NRESIDUES * size[0], 
+                             sizeof(long));
+      if(ok && size[0])
+      {
+         GrowHistogram(&(r->hist), size[0]);
+         ok = (r->hist.size == size[0]);
+         r->hist.maxlen = size[1];
+         ok = ok && (fread(r->hist.runs, sizeof(long), 
+                           NRESIDUES * size[0], fp) == 
+                     (size_t)(NRESIDUES * size[0]));
+         ok = ok && (fread(r->hist.exact, sizeof(long), 
+                           NRESIDUES * size[0], fp) == 
+                     (size_t)(NRESIDUES * size[0]));
+      }
+
+      ok = ok && (fread(&used, sizeof(int64_t), 1, fp) == 1) &&
+                 (used >= 0) && PartialFits(fp, used, 1);
+      if(ok && used)
+      {
+         if((r->maxima.data = (char *)malloc(used)) == NULL)
+            ok = FALSE;
+         r->maxima.used = r->maxima.size = used;
+         ok = ok && (fread(r->maxima.data, 1, used, fp) == 
+                     (size_t)used);
+      }
+
+      ok = ok && CheckPartialResult(r, header);
+   }
+
+   if(!ok)
+   {
+      FreeSearchResults(*results, nresults, header->npat);
+      *results = NULL;
+   }
+   return(ok);
+}
+
+/************************************************************************/
+/*>BOOL PartialFits(FILE *fp, int64_t nitems, size_t itemsize)
+   -----------------------------------------------------------
+   Input:   FILE    *fp         Partial result file
+            int64_t nitems      Number of items to be read
+            size_t  itemsize    Size of each item
+   Returns: BOOL                Is there room for them in the rest of
+                                the file?
+
+   Checks a count read from a partial result file before anything is
+   allocated for it. A file which is not a regular file can't be 
+   checked and always passes.
+
+   17.10.26  Original   By: ACRM
+*/
+BOOL PartialFits(FILE *fp, int64_t nitems, size_t itemsize)
+{
+   struct stat st;
+   off_t       pos;
+
+   if(nitems < 0)
+      return(FALSE);
+   if((fstat(fileno(fp), &st) != 0) || !S_ISREG(st.st_mode) ||
+      ((pos = ftello(fp)) < 0))
+      return(TRUE);
+   if(pos > st.st_size)
+      return(FALSE);
+   return((uint64_t)nitems <= (uint64_t)(st.st_size - pos) / 
+                              (itemsize ? itemsize : 1));
+}
+
+/************************************************************************/
+/*>BOOL CheckPartialResult(SEARCHRESULT *r, PARTIALHEADER *header)
+   ---------------------------------------------------------------
+   Input:   SEARCHRESULT  *r        A result read from a partial file
+            PARTIALHEADER *header   Header of the file
+   Returns: BOOL                    Can the result be reported safely?
+
+   Checks that every matching sequence is a stored label, that every 
+   label starts inside the label pool and is terminated, and that a 
+   verbose histogram has the maxima for every label.
+
+   17.10.26  Original   By: ACRM
+*/
+BOOL CheckPartialResult(SEARCHRESULT *r, PARTIALHEADER *header)
+{
+   int64_t nmaxima = 0;
+   int     i, k;
+
+   for(i=0; i<(int)header->npat; i++)
+   {
+      for(k=0; k<r->hits[i].nseqs; k++)
+      {
+         if((r->hits[i].seqs[k] < 0) || 
+            (r->hits[i].seqs[k] >= r->labels.nstrings))
+            return(FALSE);
+      }
+   }
+
+   if(r->labels.used && (r->labels.buffer[r->labels.used-1] != '\0'))
+      return(FALSE);
+   for(k=0; k<r->labels.nstrings; k++)
+   {
+      if((r->labels.offsets[k] < 0) || 
+         (r->labels.offsets[k] >= r->labels.used))
+         return(FALSE);
+   }
+
+   if((header->flags & PARTHISTOGRAM) && (header->flags & PARTVERBOSE))
+      nmaxima = (int64_t)r->labels.nstrings * NRESIDUES * sizeof(int);
+   return(r->maxima.used == (size_t)nmaxima);
+}
+
+/************************************************************************/
+/*>BOOL ReadPartialString(FILE *fp, char *string)
+   ----------------------------------------------
+   Input:   FILE   *fp          File to read
+   Output:  char   *string      String read (MAXPATLEN chars)
+   Returns: BOOL                Success?
+
+   Reads a string written by WritePartialString()
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL ReadPartialString(FILE *fp, char *string)
+{
+   uint32_t len;
+   
+   if((fread(&len, sizeof(uint32_t), 1, fp) != 1) || (len >= MAXPATLEN) ||
+      (fread(string, 1, len, fp) != len))
+      return(FALSE);
+   string[len] = '\0';
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>BOOL SamePartialSearch(PARTIALHEADER *header1, char *pattern1, 
+                          PATTERNSET *patset1, PARTIALHEADER *header2, 
+                          char *pattern2, PATTERNSET *patset2)
+   ---------------------------------------------------------------------
+   Input:   PARTIALHEADER *header1   Header of the first partial result
+            char          *pattern1  Its -s pattern
+            PATTERNSET    *patset1   Its -S patterns (or NULL)
+            PARTIALHEADER *header2   Header of the second partial result
+            char          *pattern2  Its -s pattern
+            PATTERNSET    *patset2   Its -S patterns (or NULL)
+   Returns: BOOL                     Are the results from the same 
+                                     search?
+
+   Checks that two partial results used the same options and patterns
+   so they may be combined. The shards are not compared.
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL SamePartialSearch(PARTIALHEADER *header1, char *pattern1, 
+                       PATTERNSET *patset1, PARTIALHEADER *header2, 
+                       char *pattern2, PATTERNSET *patset2)
+{
+   int i;
+   
+   if((header1->flags     != header2->flags)  ||
+      (header1->minpat    != header2->minpat) || 
+      (header1->maxpat    != header2->maxpat) ||
+      (header1->npat      != header2->npat)   || 
+      (header1->npatterns != header2->npatterns) ||
+      strcmp(pattern1, pattern2))
+      return(FALSE);
+   
+   for(i=0; i<(int)header1->npatterns; i++)
+   {
+      if(strcmp(patset1->patterns[i], patset2->patterns[i]))
+         return(FALSE);
+   }
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>BOOL MergePartials(OPTIONS *opts)
+   ---------------------------------
+   Input:   OPTIONS *opts       Options from the command line, giving the
+                                partial files
+   Returns: BOOL                Success?
+
+   Reads the partial result files for every shard of a search and 
+   reports the combined results. The results from each shard are put 
+   in shard order, whatever the order of the files, and reported exactly
+   as they would be by a single search of the whole file. The search 
+   options are taken from the partial files, which must all come from
+   the same search.
+
+   16.10.26  Original   By: ACRM
+   17.10.26  The pattern set and results are cleared before reading each
+             file so a file that can't be opened frees nothing
+*/
+BOOL MergePartials(OPTIONS *opts)
+{
+   PARTIALHEADER first, header;
+   PATTERNSET    *patset;
+   SEARCHRESULT  *results, *merged = NULL, **shards = NULL;
+   FILE          *fp;
+   char          pattern[MAXPATLEN];
+   int           i, j, n, nmerged = 0, 
+                 *counts = NULL;
+   BOOL          ok = TRUE, 
+                 read;
+
+   memset(&first, 0, sizeof(PARTIALHEADER));
+   if(!opts->npartfiles)
+   {
+      fprintf(stderr, "No partial files to merge\n");
+      return(FALSE);
+   }
+
+   for(i=0; ok && (i<opts->npartfiles); i++)
+   {
+      read    = FALSE;
+      patset  = NULL;
+      results = NULL;
+      if((fp = fopen(opts->partfiles[i], "rb")) != NULL)
+      {
+         read = ReadPartial(fp, &header, pattern, &patset, &results);
+         fclose(fp);
+      }
+      
+      if(!read)
+      {
+         fprintf(stderr, "Unable to read partial file %s\n", 
+                 opts->partfiles[i]);
+         if(patset != NULL)
+            FreePatternSet(patset);
+         ok = FALSE;
+      }
+      else if(i == 0)
+      {
+         /* Options for the report come from the first file             */
+         first            = header;
+         opts->exact      = (header.flags & PARTEXACT)     ? TRUE : FALSE;
+         opts->verbose    = (header.flags & PARTVERBOSE)   ? TRUE : FALSE;
+         opts->histogram  = (header.flags & PARTHISTOGRAM) ? TRUE : FALSE;
+         opts->minpat     = header.minpat;
+         opts->maxpat     = header.maxpat;
+         opts->patset     = patset;
+         strcpy(opts->pattern, pattern);
+
+         if((header.nshards != (uint32_t)opts->npartfiles) ||
+            ((shards = (SEARCHRESULT **)calloc(header.nshards, 
+                                               sizeof(SEARCHRESULT *)))
+             == NULL) ||
+            ((counts = (int *)calloc(header.nshards, sizeof(int)))
+             == NULL))
+         {
+            fprintf(stderr, "Expected %u partial files\n", 
+                    header.nshards);
+            ok = FALSE;
+         }
+      }
+      else
+      {
+         /* Must be from the same search                                */
+         if((header.nshards != first.nshards) || 
+            !SamePartialSearch(&header, pattern, patset, 
+                               &first, opts->pattern, opts->patset))
+         {
+            fprintf(stderr, "Partial file %s is from a different \
+search\n", opts->partfiles[i]);
+            ok = FALSE;
+         }
+         if(patset != NULL)
+            FreePatternSet(patset);
+      }
+
+      if(ok)
+      {
+         if((header.shard < 1) || (header.shard > first.nshards) ||
+            (shards[header.shard-1] != NULL))
+         {
+            fprintf(stderr, "Partial file %s repeats or has an invalid \
+shard\n", opts->partfiles[i]);
+            ok = FALSE;
+         }
+         else
+         {
+            shards[header.shard-1] = results;
+            counts[header.shard-1] = header.nresults;
+            nmerged += header.nresults;
+            results = NULL;
+         }
+      }
+      if(results != NULL)
+         FreeSearchResults(results, header.nresults, header.npat);
+   }
+
+   if(ok)
+   {
+      /* Put the results from each shard in order                       */
+      if((merged = (SEARCHRESULT *)malloc((nmerged + 1) * 
+                                          sizeof(SEARCHRESULT))) == NULL)
+      {
+         fprintf(stderr, "No memory for results\n");
+         exit(1);
+      }
+      for(i=0, n=0; i<(int)first.nshards; i++)
+      {
+         for(j=0; j<counts[i]; j++)
+            merged[n++] = shards[i][j];
+         free(shards[i]);
+         shards[i] = NULL;
+      }
+      ReportResults(merged, nmerged, opts);
+      FreeSearchResults(merged, nmerged, first.npat);
+   }
+   
+   if(shards != NULL)
+   {
+      for(i=0; i<(int)first.nshards; i++)
+      {
+         if(shards[i] != NULL)
+            FreeSearchResults(shards[i], counts[i], first.npat);
+      }
+      free(shards);
+      free(counts);
+   }
+   if(opts->patset != NULL)
+      FreePatternSet(opts->patset);
+   return(ok);
+}
+
+/************************************************************************/
+/*>int SearchIncremental(FASTAREADER *reader, OPTIONS *opts, int npat, 
+                         SEARCHRESULT **results)
+   --------------------------------------------------------------------
+   Input:   FASTAREADER  *reader   Input FASTA file
+            OPTIONS      *opts     Search options
+            int          npat      Number of patterns in each result
+   Output:  SEARCHRESULT **results Results for the whole file 
+   Returns: int                    Number of results (-1 on error)
+
+   Searches a file with a checkpoint. If the checkpoint file exists, the
+   part of the FASTA file that it covers is checked against the hash
+   in the checkpoint and only the rest of the file is searched. This is
+   used both to search just the sequences appended to a database since
+   the last run and to resume a run that was killed. The file is 
+   searched in pieces of about CKPTSIZE bytes and the checkpoint is 
+   rewritten after each piece.
+
+   16.10.26  Original   By: ACRM
+*/
+int SearchIncremental(FASTAREADER *reader, OPTIONS *opts, int npat, 
+                      SEARCHRESULT **results)
+{
+   SEARCHRESULT *more;
+   CKPTHEADER   ckpt;
+   char         *data = reader->data;
+   size_t       size  = reader->size,
+                end;
+   int          nresults, nmore;
+
+   if((data == NULL) || (reader->corpus != NULL))
+   {
+      fprintf(stderr, "Checkpoints need a FASTA file, not a corpus or \
+a stream\n");
+      return(-1);
+   }
+
+   if((nresults = ReadCheckpoint(opts->ckptfile, opts, npat, &ckpt, 
+                                 results)) < 0)
+      return(-1);
+
+   /* The file must start with the part that has been searched          */
+   if((ckpt.offset > size) ||
+      ((ckpt.offset < size) && (data[ckpt.offset] != '>')) ||
+      (HashBytes(FNVBASIS, data, ckpt.offset) != ckpt.hash))
+   {
+      fprintf(stderr, "The input file does not start with the %llu \
+bytes in checkpoint %s\n", (unsigned long long)ckpt.offset, 
+              opts->ckptfile);
+      FreeSearchResults(*results, nresults, npat);
+      return(-1);
+   }
+
+   while(ckpt.offset < size)
+   {
+      end = (size - ckpt.offset > CKPTSIZE) ? 
+            NextHeader(data, size, ckpt.offset + CKPTSIZE) : size;
+
+      /* Hashed first as records are unpacked in place by the search  */
+      reader->data = data + ckpt.offset;
+      reader->size = end - ckpt.offset;
+      reader->pos  = 0;
+      ckpt.hash    = HashBytes(ckpt.hash, reader->data, reader->size);
+      ckpt.offset  = end;
+
+      nmore    = RunSearch(reader, opts, npat, &more);
+      nresults = AppendResults(results, nresults, more, nmore);
+
+      if(!WriteCheckpoint(opts->ckptfile, opts, &ckpt, *results, 
+                          nresults, npat))
+      {
+         fprintf(stderr, "Unable to write checkpoint %s\n", 
+                 opts->ckptfile);
+         FreeSearchResults(*results, nresults, npat);
+         return(-1);
+      }
+   }
+   
+   reader->data = data;
+   reader->size = size;
+   reader->pos  = size;
+   return(nresults);
+}
+
+/************************************************************************/
+/*>int ReadCheckpoint(char *filename, OPTIONS *opts, int npat, 
+                      CKPTHEADER *ckpt, SEARCHRESULT **results)
+   ---------------------------------------------------------------
+   Input:   char         *filename  Checkpoint file
+            OPTIONS      *opts      Search options
+            int          npat       Number of patterns in each result
+   Output:  CKPTHEADER   *ckpt      Part of the file searched
+            SEARCHRESULT **results  Results so far
+   Returns: int                     Number of results (-1 on error)
+
+   Reads a checkpoint written by WriteCheckpoint(). If the file does 
+   not exist, the search starts from the beginning of the FASTA file
+   with no results. The checkpoint must be for the same search. The 
+   results must match the hash in the header and are checked by 
+   ReadPartial() so a damaged checkpoint is never resumed.
+
+   16.10.26  Original   By: ACRM
+   17.10.26  Checks the hash of the results and that the checkpoint is
+             not for a shard
+*/
+int ReadCheckpoint(char *filename, OPTIONS *opts, int npat, 
+                   CKPTHEADER *ckpt, SEARCHRESULT **results)
+{
+   PARTIALHEADER header, expected;
+   PATTERNSET    *patset = NULL;
+   FILE          *fp;
+   char          pattern[MAXPATLEN];
+   uint64_t      hash;
+   BOOL          ok;
+
+   *results = NULL;
+   if((fp = fopen(filename, "rb")) == NULL)
+   {
+      memcpy(ckpt->magic, CKPTMAGIC, 8);
+      ckpt->offset = 0;
+      ckpt->hash   = FNVBASIS;
+      *results     = AllocSearchResults(0, npat);
+      return(0);
+   }
+
+   hash = FNVBASIS;
+   ok = (fread(ckpt, sizeof(CKPTHEADER), 1, fp) == 1) &&
+        !strncmp(ckpt->magic, CKPTMAGIC, 8) &&
+        HashStream(fp, &hash) && (hash == ckpt->payload) &&
+        !fseek(fp, sizeof(CKPTHEADER), SEEK_SET) &&
+        ReadPartial(fp, &header, pattern, &patset, results) &&
+        !header.shard && !header.nshards;
+   fclose(fp);
+   
+   if(!ok)
+   {
+      fprintf(stderr, "Unable to read checkpoint %s\n", filename);
+   }
+   else
+   {
+      SetPartialHeader(&expected, opts, header.nresults, npat);
+      if(!SamePartialSearch(&header, pattern, patset, 
+                            &expected, opts->pattern, opts->patset))
+      {
+         fprintf(stderr, "Checkpoint %s is from a different search\n",
+                 filename);
+         ok = FALSE;
+      }
+   }
+   
+   if(patset != NULL)
+      FreePatternSet(patset);
+   if(!ok)
+   {
+      if(*results != NULL)
+         FreeSearchResults(*results, header.nresults, header.npat);
+      return(-1);
+   }
+   return(header.nresults);
+}
+
+/************************************************************************/
+/*>BOOL WriteCheckpoint(char *filename, OPTIONS *opts, CKPTHEADER *ckpt,
+                        SEARCHRESULT *results, int nresults, int npat)
+   ---------------------------------------------------------------------
+   Input:   char         *filename  Checkpoint file
+            OPTIONS      *opts      Search options
+            CKPTHEADER   *ckpt      Part of the file searched
+            SEARCHRESULT *results   Results so far
+            int          nresults   Number of results
+            int          npat       Number of patterns in each result
+   Returns: BOOL                    Success?
+
+   Writes a checkpoint: a CKPTHEADER followed by the results in the 
+   same form as a partial result file. The checkpoint is written to a
+   temporary file which then replaces the old one, so a run killed 
+   while writing leaves the previous checkpoint intact. Once the 
+   results are written they are read back to give the hash in the 
+   header.
+
+   16.10.26  Original   By: ACRM
+   17.10.26  Sets ckpt->payload
+*/
+BOOL WriteCheckpoint(char *filename, OPTIONS *opts, CKPTHEADER *ckpt,
+                     SEARCHRESULT *results, int nresults, int npat)
+{
+   FILE *fp;
+   char tmpfile[MAXBUFF+8];
+   BOOL ok;
+   
+   sprintf(tmpfile, "%s.tmp", filename);
+   if((fp = fopen(tmpfile, "w+b")) == NULL)
+      return(FALSE);
+
+   ckpt->payload = FNVBASIS;
+   ok = (fwrite(ckpt, sizeof(CKPTHEADER), 1, fp) == 1) &&
+        WritePartial(fp, opts, results, nresults, npat) &&
+        !fseek(fp, sizeof(CKPTHEADER), SEEK_SET) &&
+        HashStream(fp, &(ckpt->payload)) &&
+        !fseek(fp, 0, SEEK_SET) &&
+        (fwrite(ckpt, sizeof(CKPTHEADER), 1, fp) == 1);
+   if(fclose(fp))
+      ok = FALSE;
+   
+   if(ok && !rename(tmpfile, filename))
+      return(TRUE);
+   
+   unlink(tmpfile);
+   return(FALSE);
+}
+
+/************************************************************************/
+/*>int AppendResults(SEARCHRESULT **results, int nresults, 
+                     SEARCHRESULT *more, int nmore)
+   ------------------------------------------------------
+   I/O:     SEARCHRESULT **results  Array of results
+   Input:   int          nresults   Number of results
+            SEARCHRESULT *more      Results to add to the end (freed)
+            int          nmore      Number of results to add
+   Returns: int                     New number of results
+
+   Adds the results from searching another part of the file. The 
+   results are moved rather than copied.
+
+   16.10.26  Original   By: ACRM
+*/
+int AppendResults(SEARCHRESULT **results, int nresults, 
+                  SEARCHRESULT *more, int nmore)
+{
+   if((*results = (SEARCHRESULT *)realloc(*results, 
+                                          (nresults + nmore + 1) *
+                                          sizeof(SEARCHRESULT))) == NULL)
+   {
+      fprintf(stderr, "No memory for results\n");
+      exit(1);
+   }
+   memcpy(*results + nresults, more, nmore * sizeof(SEARCHRESULT));
+   free(more);
+   return(nresults + nmore);
+}
+
+/************************************************************************/
+/*>uint64_t HashBytes(uint64_t hash, char *data, size_t size)
+   ----------------------------------------------------------
+   Input:   uint64_t hash       Hash so far (FNVBASIS to start)
+            char     *data      Bytes to add
+            size_t   size       Number of bytes
+   Returns: uint64_t            Updated hash
+
+   FNV-1a hash of a block of bytes. Hashing a file in pieces gives the 
+   same result as hashing it in one.
+
+   16.10.26  Original   By: ACRM
+*/
+uint64_t HashBytes(uint64_t hash, char *data, size_t size)
+{
+   size_t i;
+   
+   for(i=0; i<size; i++)
+   {
+      hash ^= (unsigned char)data[i];
+      hash *= FNVPRIME;
+   }
+   return(hash);
+}
+
+/************************************************************************/
+/*>BOOL HashStream(FILE *fp, uint64_t *hash)
+   -----------------------------------------
+   Input:   FILE     *fp        File to read
+   I/O:     uint64_t *hash      Hash so far (FNVBASIS to start)
+   Returns: BOOL                Success?
+
+   Adds the rest of a file from the current position to an FNV-1a 
+   hash, as HashBytes()
+
+   17.10.26  Original   By: ACRM
+*/
+BOOL HashStream(FILE *fp, uint64_t *hash)
+{
+   char   buffer[HASHBUFFSIZE];
+   size_t nread;
+
+   while((nread = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+      *hash = HashBytes(*hash, buffer, nread);
+   return(!ferror(fp));
+}
+
+/************************************************************************/
+/*>int RunSearch(FASTAREADER *reader, OPTIONS *opts, int npat, 
+                 SEARCHRESULT **results)
+   -----------------------------------------------------------
+   Input:   FASTAREADER  *reader  Input FASTA file
+            OPTIONS      *opts    Search options
+            int          npat     Number of patterns being counted
+   Output:  SEARCHRESULT **results Array of results
+   Returns: int                   Number of results
+
+   Runs the search over the whole file. If more than one thread has 
+   been requested and the file is mapped, the file is split into 
+   chunks which start at a record and each chunk is searched into its
+   own result. The chunks are shared between the threads with work
+   stealing. The results are returned in file order so combining them
+   in order gives exactly the output of a single thread.
+
+   16.10.26  Original   By: ACRM
+*/
+int RunSearch(FASTAREADER *reader, OPTIONS *opts, int npat, 
+              SEARCHRESULT **results)
+{
+   SEARCH    search;
+   pthread_t *threads;
+   WORKER    *workers;
+   int       i, j, nthreads, perthread;
+   double    start = GetTime(),
+             wall;
+   uint64_t  bytes = 0;
+
+   /* Bytes to be searched; a stream is counted as it is read           */
+   if(reader->corpus != NULL)
+      bytes = reader->corpus->seqoffsets[reader->size] -
+              reader->corpus->seqoffsets[reader->pos] +
+              reader->corpus->labeloffsets[reader->size] -
+              reader->corpus->labeloffsets[reader->pos];
+   else if(reader->data != NULL)
+      bytes = reader->size;
+
+   search.opts   = opts;
+   search.npat   = npat;
+   search.nseq   = 0;
+   search.residues = 0;
+   search.bounds = NULL;
+   search.queues = NULL;
+   search.data   = NULL;
+   search.corpus = NULL;
+   search.writer = NULL;
+   pthread_mutex_init(&(search.lock), NULL);
+
+   nthreads = opts->nthreads;
+   if((nthreads > 1) && (reader->corpus != NULL))
+   {
+      search.corpus  = reader->corpus;
+      search.nchunks = SplitCorpus(reader->corpus, reader->pos, 
+                                   reader->size, nthreads, 
+                                   &(search.bounds));
+   }
+   else if((nthreads > 1) && (reader->data != NULL))
+   {
+      search.data    = reader->data;
+      search.nchunks = SplitIntoChunks(reader->data, reader->size, 
+                                       nthreads, &(search.bounds));
+   }
+   else
+   {
+      nthreads       = 1;
+      search.nchunks = 1;
+   }
+   if(nthreads > search.nchunks)
+      nthreads = search.nchunks;
+
+   search.results = AllocSearchResults(search.nchunks, npat);
+   if((opts->hitsfp != NULL) &&
+      ((search.writer = StartHitWriter(opts->hitsfp, search.nchunks)) 
+       == NULL))
+   {
+      fprintf(stderr, "Unable to start hit writer\n");
+      exit(1);
+   }
+
+   if(nthreads == 1)
+   {
+      if(search.bounds == NULL)
+      {
+         SearchRecords(reader, &search, &(search.results[0]),
+                       ((opts->metrics != NULL) ? 
+                        opts->metrics->threads : NULL));
+      }
+      else
+      {
+         /* Only one chunk so search it like the worker would           */
+         WORKER worker;
+         worker.search = &search;
+         worker.id     = 0;
+         search.queues = (WORKQUEUE *)malloc(sizeof(WORKQUEUE));
+         if(search.queues == NULL)
+         {
+            fprintf(stderr, "No memory for work queues\n");
+            exit(1);
+         }
+         pthread_mutex_init(&(search.queues[0].lock), NULL);
+         search.queues[0].next = 0;
+         search.queues[0].last = search.nchunks;
+         SearchWorker((void *)&worker);
+      }
+   }
+   else
+   {
+      threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+      workers = (WORKER *)malloc(nthreads * sizeof(WORKER));
+      search.queues = (WORKQUEUE *)malloc(nthreads * sizeof(WORKQUEUE));
+      if((threads == NULL) || (workers == NULL) || 
+         (search.queues == NULL))
+      {
+         fprintf(stderr, "No memory for threads\n");
+         exit(1);
+      }
+
+      /* Give each thread an equal run of consecutive chunks            */
+      perthread = search.nchunks / nthreads;
+      for(i=0; i<nthreads; i++)
+      {
+         pthread_mutex_init(&(search.queues[i].lock), NULL);
+         search.queues[i].next = i * perthread;
+         search.queues[i].last = (i == nthreads-1) ? 
+                                 search.nchunks : (i+1) * perthread;
+      }
+
+      for(i=0; i<nthreads; i++)
+      {
+         workers[i].search = &search;
+         workers[i].id     = i;
+         if(pthread_create(&(threads[i]), NULL, SearchWorker, 
+                           (void *)&(workers[i])))
+         {
+            fprintf(stderr, "Unable to create thread\n");
+            exit(1);
+         }
+      }
+      for(i=0; i<nthreads; i++)
+         pthread_join(threads[i], NULL);
+
+      free(threads);
+      free(workers);
+   }
+
+   if(search.queues != NULL)
+   {
+      for(i=0; i<nthreads; i++)
+         pthread_mutex_destroy(&(search.queues[i].lock));
+      free(search.queues);
+   }
+   if(search.bounds != NULL)
+      free(search.bounds);
+   if(search.writer != NULL)
+   {
+      wall = StopHitWriter(search.writer);
+      if(opts->metrics != NULL)
+         opts->metrics->output += wall;
+   }
+   pthread_mutex_destroy(&(search.lock));
+
+   if(opts->metrics != NULL)
+   {
+      /* Time and bytes searched, and matches found                     */
+      wall = GetTime() - start;
+      opts->metrics->search += wall;
+      for(i=0; i<nthreads; i++)
+         opts->metrics->threads[i].wall += wall;
+
+      if(reader->ring != NULL)
+         bytes = reader->ring->bytes;
+      opts->metrics->bytes += bytes;
+
+      for(i=0; i<search.nchunks; i++)
+      {
+         for(j=0; j<npat; j++)
+            opts->metrics->hits += search.results[i].hits[j].count;
+      }
+   }
+
+   *results = search.results;
+   return(search.nchunks);
+}
+
+/************************************************************************/
+/*>void SearchRecords(FASTAREADER *reader, SEARCH *search, 
+                      SEARCHRESULT *result, THREADSTATS *stats)
+   -------------------------------------------------------------
+   Input:   FASTAREADER  *reader  FASTA reader
+            SEARCH       *search  The search being run
+   I/O:     SEARCHRESULT *result  Result to be updated
+            THREADSTATS  *stats   Time in each phase for this thread
+                                  (NULL if not timed)
+
+   Reads each record from a reader and counts the matches to the -s 
+   pattern or to all the patterns, or finds the distribution of run 
+   lengths. With --hits, the position of each match is formatted into
+   a buffer which is passed to the writer thread when it is full.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Added hit output
+   16.10.26  Added stats
+*/
+void SearchRecords(FASTAREADER *reader, SEARCH *search, 
+                   SEARCHRESULT *result, THREADSTATS *stats)
+{
+   OPTIONS    *opts = search->opts;
+   double     t0 = 0.0,
+              t1 = 0.0,
+              t2;
+   BOOL       matched;
+   FASTAREC   rec;
+   MATCHMASKS masks;
+   HITLIST    hitlist,
+              *hl = NULL;
+   ARENA      text;
+   int        maxima[NRESIDUES],
+              chunk = result - search->results;
+
+   memset(&masks, 0, sizeof(MATCHMASKS));
+   memset(&hitlist, 0, sizeof(HITLIST));
+   memset(&text, 0, sizeof(ARENA));
+   if(search->writer != NULL)
+      hl = &hitlist;
+
+   if(stats != NULL)
+      t0 = GetTime();
+   while(ReadFASTARecord(reader, &rec))
+   {
+      if(stats != NULL)
+      {
+         t1 = GetTime();
+         stats->read += t1 - t0;
+         stats->nseq++;
+         stats->residues += rec.seqlen;
+      }
+      if(!opts->quiet || (opts->metrics != NULL))
+         CountProgress(search, rec.seqlen);
+      hitlist.nhits = 0;
+
+      /* In verbose mode sequences are indexed by the label pool so the
+         index is only advanced when a sequence's label is stored
+      */
+      if(opts->histogram)
+      {
+         ScanSequenceHistogram(rec.sequence, rec.seqlen, opts->exact,
+                               &(result->hist), maxima);
+         if(opts->verbose)
+         {
+            ArenaAppend(&(result->maxima), (char *)maxima, 
+                        NRESIDUES * sizeof(int));
+            matched = TRUE;
+         }
+      }
+      else if(opts->patset != NULL)
+      {
+         ScanSequenceForPatternSet(rec.sequence, rec.seqlen, 
+                                   result->labels.nstrings, 
+                                   opts->patset, opts->exact, 
+                                   result->hits,
+                                   (opts->verbose ? &matched : NULL), 
+                                   &masks, hl);
+      }
+      else if(opts->pattern[0])
+      {
+         ScanSequenceForPattern(rec.sequence, rec.seqlen, 
+                                result->labels.nstrings, opts->pattern,
+                                opts->periodic, opts->exact, 
+                                result->hits,
+                                (opts->verbose ? &matched : NULL), 
+                                &masks, hl);
+      }
+      else
+      {
+         ScanSequenceForRuns(rec.sequence, rec.seqlen, 
+                             result->labels.nstrings, opts->exact, 
+                             opts->minpat, opts->maxpat, result->hits, 
+                             (opts->verbose ? &matched : NULL), hl);
+      }
+      
+      if(opts->verbose && matched)
+      {
+         if(StoreString(&(result->labels), rec.label, rec.labellen) < 0)
+         {
+            fprintf(stderr, "No memory for sequence labels\n");
+            exit(1);
+         }
+      }
+
+      if(stats != NULL)
+      {
+         t2 = GetTime();
+         stats->scan += t2 - t1;
+         t1 = t2;
+      }
+
+      if(hitlist.nhits)
+      {
+         FormatHits(&rec, opts, &hitlist, &text);
+         if(text.used >= HITBUFFSIZE)
+            QueueHits(search->writer, chunk, &text, FALSE);
+      }
+
+      if(stats != NULL)
+      {
+         t0 = GetTime();
+         stats->format += t0 - t1;
+      }
+   }
+   if(stats != NULL)
+      stats->read += GetTime() - t0;
+
+   if(search->writer != NULL)
+      QueueHits(search->writer, chunk, &text, TRUE);
+   if(hitlist.hits != NULL)
+      free(hitlist.hits);
+   rpFreeMatchMasks(&masks);
+}
+
+/************************************************************************/
+/*>void CountProgress(SEARCH *search, int seqlen)
+   -----------------------------------------------
+   I/O:     SEARCH   *search    The search being run
+   Input:   int      seqlen     Length of the sequence
+
+   Counts a sequence and reports progress every 10000 sequences, on
+   stderr unless -q was given and to the metrics file with --metrics
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Added seqlen and progress in the metrics
+*/
+void CountProgress(SEARCH *search, int seqlen)
+{
+   int      nseq;
+   uint64_t residues;
+   
+   pthread_mutex_lock(&(search->lock));
+   nseq     = ++(search->nseq);
+   residues = (search->residues += seqlen);
+   pthread_mutex_unlock(&(search->lock));
+   
+   if(!(nseq % 10000))
+   {
+      if(!search->opts->quiet)
+      {
+         fprintf(stderr, "Processed %d sequences\n", nseq);
+         fflush(stderr);
+      }
+      if(search->opts->metrics != NULL)
+         WriteProgress(search->opts->metrics, nseq, residues);
+   }
+}
+
+/************************************************************************/
+/*>double GetTime(void)
+   --------------------
+   Returns: double              Seconds from an arbitrary start
+
+   Monotonic clock for timing the phases of a run
+
+   16.10.26  Original   By: ACRM
+*/
+double GetTime(void)
+{
+   struct timespec ts;
+   
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return(ts.tv_sec + ts.tv_nsec * 1.0e-9);
+}
+
+/************************************************************************/
+/*>METRICS *StartMetrics(char *filename, int nthreads)
+   ---------------------------------------------------
+   Input:   char    *filename   File for the metrics ("-" for stderr)
+            int     nthreads    Number of threads
+   Returns: METRICS *           The metrics (NULL if the file could not
+                                be opened)
+
+   Opens the metrics file and starts timing the run
+
+   16.10.26  Original   By: ACRM
+*/
+METRICS *StartMetrics(char *filename, int nthreads)
+{
+   METRICS *metrics;
+
+   if((metrics = (METRICS *)calloc(1, sizeof(METRICS))) == NULL)
+      return(NULL);
+   if((metrics->threads = (THREADSTATS *)calloc(nthreads, 
+                                                 sizeof(THREADSTATS)))
+      == NULL)
+   {
+      free(metrics);
+      return(NULL);
+   }
+   
+   if(!strcmp(filename, "-"))
+      metrics->fp = stderr;
+   else if((metrics->fp = fopen(filename, "w")) == NULL)
+   {
+      free(metrics->threads);
+      free(metrics);
+      return(NULL);
+   }
+   metrics->nthreads = nthreads;
+   metrics->start    = GetTime();
+   return(metrics);
+}
+
+/************************************************************************/
+/*>void WriteProgress(METRICS *metrics, int nseq, uint64_t residues)
+   -----------------------------------------------------------------
+   Input:   METRICS  *metrics   The metrics
+            int      nseq       Sequences searched so far
+            uint64_t residues   Residues searched so far
+
+   Writes a JSON line giving the progress of a search. Called from the
+   search threads; each line is written with a single fprintf() so 
+   lines from different threads are not mixed.
+
+   16.10.26  Original   By: ACRM
+*/
+void WriteProgress(METRICS *metrics, int nseq, uint64_t residues)
+{
+   double elapsed = GetTime() - metrics->start;
+
+   fprintf(metrics->fp, "{\"event\":\"progress\",\"elapsed\":%.3f,\
+\"sequences\":%d,\"residues\":%llu,\"residues_per_s\":%.0f}\n",
+           elapsed, nseq, (unsigned long long)residues,
+           (elapsed > 0.0) ? residues / elapsed : 0.0);
+   fflush(metrics->fp);
+}
+
+/************************************************************************/
+/*>BOOL WriteMetrics(METRICS *metrics)
+   -----------------------------------
+   Input:   METRICS *metrics    The metrics (freed)
+   Returns: BOOL                Success?
+
+   Writes a JSON line summarising the run and closes the metrics file.
+   The phase times are summed over the threads: read is reading and
+   parsing records, scan is matching (including the exact match 
+   checks, which are made on whole blocks inside the kernel), format is
+   formatting hit records and output is reporting the results and 
+   writing the hit records. The rates are for the time spent in the 
+   search. Utilisation is the fraction of that time each thread spent
+   working rather than waiting.
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL WriteMetrics(METRICS *metrics)
+{
+   THREADSTATS   total;
+   struct rusage usage;
+   double        search = metrics->search;
+   int           i;
+   BOOL          ok;
+
+   memset(&total, 0, sizeof(THREADSTATS));
+   for(i=0; i<metrics->nthreads; i++)
+   {
+      total.read     += metrics->threads[i].read;
+      total.scan     += metrics->threads[i].scan;
+      total.format   += metrics->threads[i].format;
+      total.nseq     += metrics->threads[i].nseq;
+      total.residues += metrics->threads[i].residues;
+   }
+   if(search <= 0.0)
+      search = 1.0e-9;
+   if(getrusage(RUSAGE_SELF, &usage))
+      usage.ru_maxrss = 0;
+
+   fprintf(metrics->fp, "{\"event\":\"summary\",\"elapsed\":%.3f,\
+\"search\":%.3f,\"sequences\":%llu,\"residues\":%llu,\"bytes\":%llu,\
+\"hits\":%llu,\"phases\":{\"read\":%.3f,\"scan\":%.3f,\"format\":%.3f,\
+\"output\":%.3f},\"residues_per_s\":%.0f,\"mb_per_s\":%.1f,\
+\"hits_per_s\":%.0f,\"peak_rss_kb\":%ld,\"threads\":[",
+           GetTime() - metrics->start, metrics->search,
+           (unsigned long long)total.nseq, 
+           (unsigned long long)total.residues,
+           (unsigned long long)metrics->bytes, 
+           (unsigned long long)metrics->hits,
+           total.read, total.scan, total.format, metrics->output,
+           total.residues / search, metrics->bytes / search / 1.0e6,
+           metrics->hits / search, (long)usage.ru_maxrss);
+   for(i=0; i<metrics->nthreads; i++)
+   {
+      THREADSTATS *t = &(metrics->threads[i]);
+      fprintf(metrics->fp, "%s{\"thread\":%d,\"sequences\":%llu,\
+\"busy\":%.3f,\"utilisation\":%.3f}", (i ? "," : ""), i,
+              (unsigned long long)t->nseq, t->read + t->scan + t->format,
+              (t->wall > 0.0) ? 
+              (t->read + t->scan + t->format) / t->wall : 0.0);
+   }
+   fprintf(metrics->fp, "]}\n");
+
+   ok = !ferror(metrics->fp);
+   if(metrics->fp == stderr)
+      fflush(stderr);
+   else if(fclose(metrics->fp))
+      ok = FALSE;
+   free(metrics->threads);
+   free(metrics);
+   return(ok);
+}
+
+/************************************************************************/
+/*>void AddHit(HITLIST *hitlist, int pattern, int start, int end, 
+               BOOL exact)
+   --------------------------------------------------------------
+   I/O:     HITLIST *hitlist    Matches in a sequence
+   Input:   int     pattern     Index of the pattern in the hits array
+            int     start       First residue of the match
+            int     end         Last residue of the match
+            BOOL    exact       Would the match count as exact?
+
+   Adds the position of a match to the list for a sequence. Exits if 
+   there is no memory.
+
+   16.10.26  Original   By: ACRM
+*/
+void AddHit(HITLIST *hitlist, int pattern, int start, int end, 
+            BOOL exact)
+{
+   HIT *hit;
+   
+   if(hitlist->nhits == hitlist->maxhits)
+   {
+      hitlist->maxhits = (hitlist->maxhits) ? 2 * hitlist->maxhits : 64;
+      if((hitlist->hits = (HIT *)realloc(hitlist->hits, 
+                                         hitlist->maxhits * sizeof(HIT)))
+         == NULL)
+      {
+         fprintf(stderr, "No memory for hit positions\n");
+         exit(1);
+      }
+   }
+
+   hit          = &(hitlist->hits[hitlist->nhits++]);
+   hit->pattern = pattern;
+   hit->start   = start;
+   hit->end     = end;
+   hit->exact   = exact;
+}
+
+/************************************************************************/
+/*>void FormatHits(FASTAREC *rec, OPTIONS *opts, HITLIST *hitlist, 
+                   ARENA *text)
+   ----------------------------------------------------------------
+   Input:   FASTAREC *rec       The sequence
+            OPTIONS  *opts      Search options
+            HITLIST  *hitlist   Matches in the sequence
+   I/O:     ARENA    *text      Formatted records are appended
+
+   Formats a record for each match. The TSV format gives the label (less
+   the '>'), the pattern, the first and last residues numbered from 1 
+   and whether the match is exact or extended (i.e. part of a longer 
+   repeat, so only found with -x). The BED format gives the first word 
+   of the label, the start numbered from 0 and the end, the pattern, a
+   score of 0, no strand and the same flag.
+
+   16.10.26  Original   By: ACRM
+*/
+void FormatHits(FASTAREC *rec, OPTIONS *opts, HITLIST *hitlist, 
+                ARENA *text)
+{
+   HIT  *hit;
+   char buffer[MAXBUFF],
+        *pattern,
+        res;
+   int  i, j, idlen, len;
+
+   /* The label without the '>' and the identifier up to a space        */
+   for(idlen=1; idlen<rec->labellen; idlen++)
+   {
+      if(isspace((unsigned char)rec->label[idlen]))
+         break;
+   }
+
+   for(i=0; i<hitlist->nhits; i++)
+   {
+      hit = &(hitlist->hits[i]);
+      if(opts->bed)
+      {
+         ArenaAppend(text, rec->label + 1, idlen - 1);
+         len = sprintf(buffer, "\t%d\t%d\t", hit->start, hit->end + 1);
+      }
+      else
+      {
+         ArenaAppend(text, rec->label + 1, rec->labellen - 1);
+         len = sprintf(buffer, "\t");
+      }
+      ArenaAppend(text, buffer, len);
+
+      if(opts->patset != NULL)
+      {
+         pattern = opts->patset->patterns[hit->pattern];
+         ArenaAppend(text, pattern, strlen(pattern));
+      }
+      else if(opts->pattern[0])
+      {
+         ArenaAppend(text, opts->pattern, strlen(opts->pattern));
+      }
+      else
+      {
+         /* Rebuild the pattern from its residue and length             */
+         res = RESIDUES[hit->pattern / (opts->maxpat + 1)];
+         for(j=hit->start; j<=hit->end; j++)
+            ArenaAppend(text, ((j - hit->start) % 2) ? "X" : &res, 1);
+      }
+
+      if(opts->bed)
+         len = sprintf(buffer, "\t0\t.\t%s\n", 
+                       hit->exact ? "exact" : "extended");
+      else
+         len = sprintf(buffer, "\t%d\t%d\t%s\n", hit->start + 1, 
+                       hit->end + 1, hit->exact ? "exact" : "extended");
+      ArenaAppend(text, buffer, len);
+   }
+}
+
+/************************************************************************/
+/*>void ScanSequenceForRuns(char *sequence, int seqlen, int seqnum, 
+                            BOOL exact, int minpat, int maxpat, 
+                            PATHITS *hits, BOOL *matched, 
+                            HITLIST *hitlist)
+   ----------------------------------------------------------------------
+   Input:   char    *sequence   The sequence
+            int     seqlen      Length of the sequence
+            int     seqnum      Index for this sequence in the hit lists
+            BOOL    exact       Do exact matching
+            int     minpat      Minimum number of repeated residues
+            int     maxpat      Maximum number of repeated residues
+   I/O:     PATHITS *hits       Counts for each residue/length; indexed
+                                as [residue*(maxpat+1) + length]
+   Output:  BOOL    *matched    Did any pattern match? If this is NULL
+                                the matching sequences are not recorded
+   I/O:     HITLIST *hitlist    Positions of the matches are added (NULL
+                                if they are not needed)
+
+   Finds every maximal alternating run (cXcX...c) for each residue in 
+   the sequence and updates the pattern counts from the runs. A run 
+   containing m occurrences of c contains (m-n+1) non-exact matches to
+   the pattern with n occurrences. Exact matches are only made by the 
+   full run (n==m) and are subject to the same end conditions applied
+   by rpCheckBounds().
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Runs are found by rpNextRun()
+   16.10.26  Added hitlist
+*/
+void ScanSequenceForRuns(char *sequence, int seqlen, int seqnum, 
+                         BOOL exact, int minpat, int maxpat, 
+                         PATHITS *hits, BOOL *matched, 
+                         HITLIST *hitlist)
+{
+   int  npat = maxpat + 1,
+        pos  = 0,
+        m, n, r, k, top, start;
+   BOOL isexact;
+
+   if(matched != NULL)
+      *matched = FALSE;
+
+   while(rpNextRun(gResIndex, sequence, seqlen, &pos, &r, &m, &isexact))
+   {
+      if(exact)
+      {
+         /* Only the whole run can match                                */
+         if(isexact && (m >= minpat) && (m <= maxpat))
+         {
+            hits[r*npat + m].count++;
+            if(hitlist != NULL)
+               AddHit(hitlist, r*npat + m, pos-1, pos + 2*m - 3, TRUE);
+            if(matched != NULL)
+            {
+               if(!AddHitSequence(&(hits[r*npat + m]), seqnum))
+               {
+                  fprintf(stderr, "No memory for matching sequences\n");
+                  exit(1);
+               }
+               *matched = TRUE;
+            }
+         }
+      }
+      else
+      {
+         top = (m < maxpat) ? m : maxpat;
+         for(n=minpat; n<=top; n++)
+         {
+            hits[r*npat + n].count += (m - n + 1);
+            if(hitlist != NULL)
+            {
+               for(k=0, start=pos-1; k<=m-n; k++, start+=2)
+                  AddHit(hitlist, r*npat + n, start, start + 2*n - 2, 
+                         isexact && (n == m));
+            }
+            if(matched != NULL)
+            {
+               if(!AddHitSequence(&(hits[r*npat + n]), seqnum))
+               {
+                  fprintf(stderr, "No memory for matching sequences\n");
+                  exit(1);
+               }
+               *matched = TRUE;
+            }
+         }
+      }
+   }
+}
+
+/************************************************************************/
+/*>void ScanSequenceHistogram(char *sequence, int seqlen, BOOL exact,
+                              HISTOGRAM *hist, int *maxima)
+   ------------------------------------------------------------------
+   Input:   char      *sequence  The sequence
+            int       seqlen     Length of the sequence
+            BOOL      exact      Give maxima for exact matches
+   I/O:     HISTOGRAM *hist      Run length distribution
+   Output:  int       *maxima    Longest match for each residue
+
+   Adds the alternating runs in a sequence to the distribution of run
+   lengths. The histogram grows as needed so there is no upper limit 
+   on the length.
+
+   16.10.26  Original   By: ACRM
+*/
+void ScanSequenceHistogram(char *sequence, int seqlen, BOOL exact,
+                           HISTOGRAM *hist, int *maxima)
+{
+   int  pos = 0,
+        r, m;
+   BOOL isexact;
+
+   for(r=0; r<NRESIDUES; r++)
+      maxima[r] = 0;
+
+   while(rpNextRun(gResIndex, sequence, seqlen, &pos, &r, &m, &isexact))
+   {
+      if(m >= hist->size)
+         GrowHistogram(hist, m+1);
+      if(m > hist->maxlen)
+         hist->maxlen = m;
+
+      hist->runs[r*hist->size + m]++;
+      if(isexact)
+         hist->exact[r*hist->size + m]++;
+
+      if((isexact || !exact) && (m > maxima[r]))
+         maxima[r] = m;
+   }
+}
+
+/************************************************************************/
+/*>void GrowHistogram(HISTOGRAM *hist, int size)
+   ---------------------------------------------
+   I/O:     HISTOGRAM *hist      Run length distribution
+   Input:   int       size       Lengths needed for each residue
+
+   Makes room in a histogram for runs of length up to size-1. The size
+   is at least doubled so that growing is rare.
+
+   16.10.26  Original   By: ACRM
+*/
+void GrowHistogram(HISTOGRAM *hist, int size)
+{
+   long *runs, *exact;
+   int  r, newsize;
+
+   if(size <= hist->size)
+      return;
+   newsize = (2 * hist->size > size) ? 2 * hist->size : size;
+   if(newsize < 64)
+      newsize = 64;
+   
+   if(((runs  = (long *)calloc(NRESIDUES * newsize, sizeof(long))) 
+       == NULL) ||
+      ((exact = (long *)calloc(NRESIDUES * newsize, sizeof(long))) 
+       == NULL))
+   {
+      fprintf(stderr, "No memory for histogram\n");
+      exit(1);
+   }
+
+   if(hist->size)
+   {
+      for(r=0; r<NRESIDUES; r++)
+      {
+         memcpy(runs  + r*newsize, hist->runs  + r*hist->size, 
+                hist->size * sizeof(long));
+         memcpy(exact + r*newsize, hist->exact + r*hist->size, 
+                hist->size * sizeof(long));
+      }
+      free(hist->runs);
+      free(hist->exact);
+   }
+
+   hist->runs  = runs;
+   hist->exact = exact;
+   hist->size  = newsize;
+}
+
+/************************************************************************/
+/*>void AddHistogram(HISTOGRAM *total, HISTOGRAM *hist)
+   ----------------------------------------------------
+   I/O:     HISTOGRAM *total     Histogram to add to
+   Input:   HISTOGRAM *hist      Histogram to be added
+
+   Adds one histogram into another
+
+   16.10.26  Original   By: ACRM
+*/
+void AddHistogram(HISTOGRAM *total, HISTOGRAM *hist)
+{
+   int r, m;
+
+   if(hist->size == 0)
+      return;
+   GrowHistogram(total, hist->maxlen + 1);
+   if(hist->maxlen > total->maxlen)
+      total->maxlen = hist->maxlen;
+
+   for(r=0; r<NRESIDUES; r++)
+   {
+      for(m=1; m<=hist->maxlen; m++)
+      {
+         total->runs[r*total->size + m]  += hist->runs[r*hist->size + m];
+         total->exact[r*total->size + m] += hist->exact[r*hist->size + m];
+      }
+   }
+}
+
+/************************************************************************/
+/*>void FreeHistogram(HISTOGRAM *hist)
+   -----------------------------------
+   I/O:     HISTOGRAM *hist      Histogram
+
+   Frees the memory used by a histogram
+
+   16.10.26  Original   By: ACRM
+*/
+void FreeHistogram(HISTOGRAM *hist)
+{
+   if(hist->size)
+   {
+      free(hist->runs);
+      free(hist->exact);
+   }
+   hist->runs   = hist->exact = NULL;
+   hist->size   = hist->maxlen = 0;
+}
+
+/************************************************************************/
+/*>void GetHistogramCounts(HISTOGRAM *hist, BOOL exact, long *counts)
+   ------------------------------------------------------------------
+   Input:   HISTOGRAM *hist      Run length distribution
+            BOOL      exact      Give exact match counts
+   Output:  long      *counts    Number of matches for each residue and
+                                 length [res*(maxlen+1) + length]
+
+   Converts the distribution of run lengths to the number of matches to
+   each pattern. For exact matching this is just the number of exact
+   runs. For non-exact matching a run of length m gives m-n+1 matches
+   to the pattern of length n so the count is found from sums over the
+   longer runs, working down from the longest.
+
+   16.10.26  Original   By: ACRM
+*/
+void GetHistogramCounts(HISTOGRAM *hist, BOOL exact, long *counts)
+{
+   int  r, m, 
+        maxlen = hist->maxlen;
+   long nruns, nres;
+
+   for(r=0; r<NRESIDUES; r++)
+   {
+      counts[r*(maxlen+1)] = 0;
+      nruns = nres = 0;
+      for(m=maxlen; m>=1; m--)
+      {
+         if(exact)
+         {
+            counts[r*(maxlen+1) + m] = hist->exact[r*hist->size + m];
+         }
+         else
+         {
+            /* nruns = runs of length >= m; nres = residues in them     */
+            nruns += hist->runs[r*hist->size + m];
+            nres  += m * hist->runs[r*hist->size + m];
+            counts[r*(maxlen+1) + m] = nres - (m-1) * nruns;
+         }
+      }
+   }
+}
+
+/************************************************************************/
+/*>BOOL WriteHistogram(char *filename, HISTOGRAM *hist, BOOL exact)
+   ----------------------------------------------------------------
+   Input:   char      *filename  File to write
+            HISTOGRAM *hist      Run length distribution
+            BOOL      exact      Write exact match counts
+   Returns: BOOL                 Success?
+
+   Writes the match counts in binary so they can be loaded without
+   parsing. All values are in the byte order of the machine writing 
+   the file:
+      char     magic[8]        "IRHIST01"
+      uint32_t nresidues       Number of residues (20)
+      uint32_t maxlen          Longest run
+      uint32_t exact           1 for exact match counts, 0 otherwise
+      uint32_t reserved        0
+      char     residues[24]    The residues, padded with nulls
+      uint64_t counts[nresidues][maxlen]
+                               Number of matches for each residue with
+                               1..maxlen repeats
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL WriteHistogram(char *filename, HISTOGRAM *hist, BOOL exact)
+{
+   FILE     *fp;
+   uint32_t header[4];
+   char     residues[24];
+   uint64_t *row;
+   long     *counts;
+   int      r, m;
+   BOOL     ok = TRUE;
+
+   if((fp = fopen(filename, "wb")) == NULL)
+      return(FALSE);
+
+   counts = (long *)malloc(NRESIDUES * (hist->maxlen + 1) * sizeof(long));
+   row    = (uint64_t *)malloc((hist->maxlen + 1) * sizeof(uint64_t));
+   if((counts == NULL) || (row == NULL))
+   {
+      free(counts);
+      free(row);
+      fclose(fp);
+      return(FALSE);
+   }
+   GetHistogramCounts(hist, exact, counts);
+
+   header[0] = NRESIDUES;
+   header[1] = hist->maxlen;
+   header[2] = exact ? 1 : 0;
+   header[3] = 0;
+   memset(residues, 0, sizeof(residues));
+   memcpy(residues, RESIDUES, NRESIDUES);
+
+   if((fwrite(HISTMAGIC, 1, 8, fp) != 8) ||
+      (fwrite(header, sizeof(uint32_t), 4, fp) != 4) ||
+      (fwrite(residues, 1, sizeof(residues), fp) != sizeof(residues)))
+      ok = FALSE;
+
+   for(r=0; ok && (r<NRESIDUES); r++)
+   {
+      for(m=1; m<=hist->maxlen; m++)
+         row[m-1] = (uint64_t)counts[r*(hist->maxlen+1) + m];
+      if(fwrite(row, sizeof(uint64_t), hist->maxlen, fp) != 
+         (size_t)hist->maxlen)
+         ok = FALSE;
+   }
+
+   if(fclose(fp))
+      ok = FALSE;
+   free(counts);
+   free(row);
+   return(ok);
+}
+
+/************************************************************************/
+/*>void ScanSequenceForPattern(char *sequence, int seqlen, int seqnum, 
+                               char *pattern, PERIODIC *periodic, 
+                               BOOL exact, PATHITS *hits, 
+                               BOOL *matched, MATCHMASKS *masks,
+                               HITLIST *hitlist)
+   ----------------------------------------------------------------------
+   Input:   char    *sequence   The sequence
+            int     seqlen      Length of the sequence
+            int     seqnum      Index for this sequence in the hit list
+            char    *pattern    The pattern
+            PERIODIC *periodic  The compiled pattern. If this is not NULL
+                                it is used in place of pattern
+            BOOL    exact       Do exact matching
+   I/O:     PATHITS *hits       Hits for the pattern
+   Output:  BOOL    *matched    Did the pattern match? If this is NULL
+                                the matching sequence is not recorded
+   I/O:     MATCHMASKS *masks   Work space for the bitmask kernel
+            HITLIST *hitlist    Positions of the matches are added with
+                                pattern 0 (NULL if they are not needed)
+
+   Counts the matches to a single pattern in a sequence. All the places
+   where the pattern matches are found in one pass by 
+   rpFindPatternStarts() rather than by calling 
+   SearchSequenceForPattern() again after each hit.
+
+   07.03.13  Original (in SearchFileForPattern())   By: ACRM
+   16.10.26  Moved out of SearchFileForPattern()
+   16.10.26  Uses rpFindPatternStarts() for both exact and non-exact 
+             matching
+   16.10.26  Added periodic
+   16.10.26  Added hitlist
+   16.10.26  Approximate matching for a PERIODIC pattern with mismatches
+   17.10.26  Exits if there is no memory for the masks
+*/
+void ScanSequenceForPattern(char *sequence, int seqlen, int seqnum, 
+                            char *pattern, PERIODIC *periodic, 
+                            BOOL exact, PATHITS *hits, 
+                            BOOL *matched, MATCHMASKS *masks,
+                            HITLIST *hitlist)
+{
+   BOOL print = FALSE;
+   int  w, n, start,
+        nwords, patlen;
+
+   if((periodic != NULL) && periodic->mismatches)
+      nwords = rpFindApproxStarts(sequence, seqlen, periodic, exact, masks);
+   else if(periodic != NULL)
+      nwords = rpFindPeriodicStarts(sequence, seqlen, periodic, exact, 
+                                    masks);
+   else
+      nwords = rpFindPatternStarts(sequence, seqlen, pattern, 
+                                   strlen(pattern), exact, masks);
+   if(nwords < 0)
+   {
+      fprintf(stderr, "No memory for pattern masks\n");
+      exit(1);
+   }
+   for(w=0; w<nwords; w++)
+   {
+      if(masks->starts[w])
+      {
+         n = rpCountBits(masks->starts[w]);
+         hits->count += n;
+         print = TRUE;
+      }
+   }
+
+   if((hitlist != NULL) && print)
+   {
+      patlen = (periodic != NULL) ? periodic->patlen : strlen(pattern);
+      for(start=rpNextStart(masks->starts, nwords, 0);
+          start >= 0;
+          start=rpNextStart(masks->starts, nwords, start+1))
+      {
+         AddHit(hitlist, 0, start, start + patlen - 1, 
+                exact || ((periodic != NULL) ?
+                          rpMatchPeriodicAt(sequence, seqlen, periodic, 
+                                            start, TRUE) :
+                          rpCheckBounds(sequence, seqlen, pattern, patlen,
+                                        start)));
+      }
+   }
+
+   if(matched != NULL)
+   {
+      if(print && !AddHitSequence(hits, seqnum))
+      {
+         fprintf(stderr, "No memory for matching sequences\n");
+         exit(1);
+      }
+      *matched = print;
+   }
+}
+
+/************************************************************************/
+/*>void ScanSequenceForPatternSet(char *sequence, int seqlen, int seqnum, 
+                                  PATTERNSET *patset, BOOL exact, 
+                                  PATHITS *hits, BOOL *matched, 
+                                  MATCHMASKS *masks, HITLIST *hitlist)
+   ----------------------------------------------------------------------
+   Input:   char       *sequence  The sequence
+            int        seqlen     Length of the sequence
+            int        seqnum     Index for this sequence in hit lists
+            PATTERNSET *patset    The patterns
+            BOOL       exact      Do exact matching
+   I/O:     PATHITS    *hits      Hits for each pattern in patset order
+   Output:  BOOL       *matched   Did any pattern match? If this is NULL
+                                  the matching sequences are not 
+                                  recorded
+   I/O:     MATCHMASKS *masks     Work space for the bitmask kernel
+            HITLIST    *hitlist   Positions of the matches are added 
+                                  (NULL if they are not needed)
+
+   Counts the matches to every pattern in a set. A pattern with n 
+   repeated residues starts at each of the first m-n+1 residues of a 
+   run of m, as long as it does not run off the end of the sequence.
+   Only the first of these can be an exact match since the others are
+   preceded by the run. So each run is found once and only the patterns
+   for its residue with n <= m are tested, each in constant time.
+   Patterns for other residues, and PERIODIC patterns, are searched 
+   with the bitmask kernel.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Added hitlist
+*/
+void ScanSequenceForPatternSet(char *sequence, int seqlen, int seqnum, 
+                               PATTERNSET *patset, BOOL exact, 
+                               PATHITS *hits, BOOL *matched, 
+                               MATCHMASKS *masks, HITLIST *hitlist)
+{
+   int  pos = 0,
+        start, r, m, n, i, k, pi, kmax, nhits;
+   long count;
+   BOOL isexact, hit;
+
+   if(matched != NULL)
+      *matched = FALSE;
+
+   while(rpNextRun(gResIndex, sequence, seqlen, &pos, &r, &m, &isexact))
+   {
+      start = pos - 1;
+      for(i=patset->first[r]; i<patset->first[r+1]; i++)
+      {
+         pi = patset->order[i];
+         if((n = patset->nrepeat[pi]) > m)
+            break;
+         
+         /* Last start in this run which fits in the sequence           */
+         if((kmax = seqlen - patset->patlen[pi] - start) < 0)
+            continue;
+         kmax /= 2;
+         if(kmax > m-n)
+            kmax = m-n;
+
+         if(exact)
+            count = rpCheckBounds(sequence, seqlen, patset->patterns[pi],
+                                  patset->patlen[pi], start) ? 1 : 0;
+         else
+            count = kmax + 1;
+
+         if(count)
+         {
+            hits[pi].count += count;
+            for(k=0; (hitlist != NULL) && (k<count); k++)
+            {
+               AddHit(hitlist, pi, start + 2*k, 
+                      start + 2*k + patset->patlen[pi] - 1,
+                      exact || rpCheckBounds(sequence, seqlen, 
+                                             patset->patterns[pi],
+                                             patset->patlen[pi], 
+                                             start + 2*k));
+            }
+            if(matched != NULL)
+            {
+               if(!AddHitSequence(&(hits[pi]), seqnum))
+               {
+                  fprintf(stderr, "No memory for matching sequences\n");
+                  exit(1);
+               }
+               *matched = TRUE;
+            }
+         }
+      }
+   }
+
+   for(i=patset->first[NRESIDUES]; i<patset->npatterns; i++)
+   {
+      pi = patset->order[i];
+      nhits = (hitlist != NULL) ? hitlist->nhits : 0;
+      ScanSequenceForPattern(sequence, seqlen, seqnum, 
+                             patset->patterns[pi], patset->periodic[pi],
+                             exact, &(hits[pi]),
+                             ((matched != NULL) ? &hit : NULL), masks,
+                             hitlist);
+      if((matched != NULL) && hit)
+         *matched = TRUE;
+
+      /* The hits were added as pattern 0                               */
+      for(k=nhits; (hitlist != NULL) && (k<hitlist->nhits); k++)
+         hitlist->hits[k].pattern = pi;
+   }
+}
+
+/************************************************************************/
+/*>BOOL SelfTest(void)
+   -------------------
+   Returns: BOOL                Did all the tests pass?
+
+   Compares the pattern starts and match counts from the bitmask kernel
+   with those from the original SearchSequenceForPattern() and 
+   rpCheckBounds() on random sequences and patterns. The sequences are 
+   drawn from a small alphabet so that long alternating runs are common.
+   PERIODIC patterns, with and without substitutions, are compared with
+   rpMatchPeriodicAt().
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Tests exact starts
+   16.10.26  Tests PERIODIC patterns
+   16.10.26  Tests approximate matches
+*/
+BOOL SelfTest(void)
+{
+   char       *sequence,
+              pattern[MAXPATLEN],
+              *alphabet = "AAAAXYC",
+              *classes[] = {"A", "[AC]", "[CY]"},
+              *p;
+   int        i, j, t, seqlen, patlen, 
+              offset, start, period, nrepeat,
+              nfail = 0;
+   BOOL       exact;
+   PERIODIC   periodic;
+   MATCHMASKS masks;
+   PATHITS    hits;
+   long       count;
+
+   memset(&masks, 0, sizeof(MATCHMASKS));
+   memset(&hits,  0, sizeof(PATHITS));
+   hits.lastseq = (-1);
+   if((sequence = (char *)malloc(1025)) == NULL)
+   {
+      fprintf(stderr, "No memory for self-test\n");
+      return(FALSE);
+   }
+   srand(1);
+
+   for(t=0; t<NSELFTEST; t++)
+   {
+      seqlen = rand() % 1025;
+      for(i=0; i<seqlen; i++)
+         sequence[i] = alphabet[rand() % strlen(alphabet)];
+      patlen = 1 + rand() % ((t % 10) ? 20 : (MAXPATLEN-1));
+      for(i=0; i<patlen; i++)
+         pattern[i] = (i & 1) ? 'X' : 'A';
+      pattern[patlen] = '\0';
+
+      /* Compare the starts                                             */
+      exact = t & 1;
+      if(rpFindPatternStarts(sequence, seqlen, pattern, patlen, exact, 
+                             &masks) < 0)
+      {
+         fprintf(stderr, "No memory for self-test\n");
+         return(FALSE);
+      }
+      offset = start = 0;
+      for(j=0; ; j++)
+      {
+         while(((offset = SearchSequenceForPattern(sequence, seqlen, 
+                                                   pattern, offset))
+                != (-1)) && exact &&
+               !rpCheckBounds(sequence, seqlen, pattern, patlen, offset))
+            offset++;
+         start  = rpNextStart(masks.starts, (seqlen+63)/64, start);
+         if(offset != start)
+         {
+            fprintf(stderr, "Self-test failed: sequence length %d, \
+pattern %s, %s hit %d at %d from scalar and %d from kernel\n",
+                    seqlen, pattern, (exact ? "exact" : "non-exact"), 
+                    j, offset, start);
+            nfail++;
+            break;
+         }
+         if(offset < 0)
+            break;
+         offset++;
+         start++;
+      }
+
+      /* Compare the exact match counts                                 */
+      for(offset=0, count=0; 
+          (offset=SearchSequenceForPattern(sequence, seqlen, pattern, 
+                                           offset)) != (-1); 
+          offset++)
+      {
+         if(rpCheckBounds(sequence, seqlen, pattern, patlen, offset))
+            count++;
+      }
+      hits.count = 0;
+      ScanSequenceForPattern(sequence, seqlen, 0, pattern, NULL, TRUE, 
+                             &hits, NULL, &masks, NULL);
+      if(hits.count != count)
+      {
+         fprintf(stderr, "Self-test failed: sequence length %d, \
+pattern %s, %ld exact matches from scalar and %ld from kernel\n",
+                 seqlen, pattern, count, hits.count);
+         nfail++;
+      }
+
+      /* Compare the starts for a PERIODIC pattern                      */
+      period  = 2 + rand() % 4;
+      nrepeat = 1 + rand() % 8;
+      p       = classes[rand() % 3];
+      for(i=0, pattern[0]='\0'; i<nrepeat; i++)
+      {
+         if(i)
+         {
+            for(j=1; j<period; j++)
+               strcat(pattern, "X");
+         }
+         strcat(pattern, p);
+      }
+      if(rpCompilePattern(pattern, &periodic) >= 0)
+      {
+         /* Simple patterns are only tested with substitutions          */
+         periodic.mismatches = t % 4;
+         if(!periodic.mismatches && (strchr(pattern, '[') == NULL) &&
+            ((period == 2) || (nrepeat == 1)))
+            periodic.mismatches = 1;
+         
+         if((periodic.mismatches ?
+             rpFindApproxStarts(sequence, seqlen, &periodic, exact, 
+                                &masks) :
+             rpFindPeriodicStarts(sequence, seqlen, &periodic, exact, 
+                                  &masks)) < 0)
+         {
+            fprintf(stderr, "No memory for self-test\n");
+            return(FALSE);
+         }
+         for(offset=0; offset<seqlen; offset++)
+         {
+            if(rpMatchPeriodicAt(sequence, seqlen, &periodic, offset, 
+                                 exact) != 
+               ((masks.starts[offset/64] >> (offset%64)) & 1))
+            {
+               fprintf(stderr, "Self-test failed: sequence length %d, \
+pattern %s, %d mismatches, %s match at %d differs from kernel\n",
+                       seqlen, pattern, periodic.mismatches,
+                       (exact ? "exact" : "non-exact"), offset);
+               nfail++;
+               break;
+            }
+         }
+      }
+   }
+
+   free(sequence);
+   rpFreeMatchMasks(&masks);
+
+   if(nfail)
+   {
+      fprintf(stderr, "Self-test: %d of %d tests failed\n", 
+              nfail, NSELFTEST);
+      return(FALSE);
+   }
+   fprintf(stderr, "Self-test: all %d tests passed\n", NSELFTEST);
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>BOOL Benchmark(FASTAREADER *reader, OPTIONS *opts, FILE *out)
+   -------------------------------------------------------------
+   Input:   FASTAREADER *reader Input FASTA file
+            OPTIONS     *opts   Search options (only -n and -m are used)
+            FILE        *out    Output file
+   Returns: BOOL                Did every engine give the same counts?
+
+   Times the engines which count the alternating patterns (cXcX...c) of 
+   every residue with minpat..maxpat occurrences and checks that they 
+   give the same exact and non-exact counts. The engines are the 
+   original SearchSequenceForPattern() and rpCheckBounds(), the bitmask 
+   kernel used by ScanSequenceForPattern() and the run scanner used by
+   ScanSequenceForRuns(). 
+
+   Records are copied into batches of BENCHBATCH residues and each 
+   engine searches the whole batch in turn on a single thread, so 
+   reading the file is not timed and every engine sees the same data.
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL Benchmark(FASTAREADER *reader, OPTIONS *opts, FILE *out)
+{
+   static char *names[NENGINES] = {"legacy", "kernel", "runs"};
+   ARENA      data, bounds;
+   FASTAREC   rec;
+   MATCHMASKS masks;
+   PATHITS    *hits[NENGINES][2];
+   char       *patterns, *pattern;
+   double     times[NENGINES], start;
+   uint64_t   residues = 0;
+   size_t     offset;
+   long       nseq  = 0;
+   int        npat  = NRESIDUES * (opts->maxpat + 1), 
+              nbatch, e, i, r, n, x;
+   BOOL       more  = TRUE,
+              ok    = TRUE;
+
+   if(opts->minpat < 1)
+      opts->minpat = 1;
+   if((opts->maxpat < opts->minpat) || (2*opts->maxpat >= MAXPATLEN))
+   {
+      fprintf(stderr, "Benchmark needs patterns with 1..%d \
+occurrences\n", (MAXPATLEN-1)/2);
+      return(FALSE);
+   }
+
+   /* The alternating pattern for each residue and length              */
+   if((patterns = (char *)calloc(npat, MAXPATLEN)) == NULL)
+   {
+      fprintf(stderr, "No memory for benchmark\n");
+      exit(1);
+   }
+   for(r=0; r<NRESIDUES; r++)
+   {
+      for(n=opts->minpat; n<=opts->maxpat; n++)
+      {
+         pattern = patterns + (r*(opts->maxpat + 1) + n) * MAXPATLEN;
+         for(i=0; i<2*n-1; i++)
+            pattern[i] = (i & 1) ? SPACER : RESIDUES[r];
+      }
+   }
+   
+   for(e=0; e<NENGINES; e++)
+   {
+      times[e] = 0.0;
+      for(x=0; x<2; x++)
+      {
+         if((hits[e][x] = (PATHITS *)calloc(npat, sizeof(PATHITS))) 
+            == NULL)
+         {
+            fprintf(stderr, "No memory for benchmark\n");
+            exit(1);
+         }
+      }
+   }
+   memset(&data,   0, sizeof(ARENA));
+   memset(&bounds, 0, sizeof(ARENA));
+   memset(&masks,  0, sizeof(MATCHMASKS));
+
+   while(more)
+   {
+      /* Copy a batch of records                                        */
+      ArenaReset(&data);
+      ArenaReset(&bounds);
+      for(nbatch=0; 
+          (data.used < BENCHBATCH) && (more = ReadFASTARecord(reader, 
+                                                                &rec));
+          nbatch++)
+      {
+         offset = ArenaAppend(&data, rec.sequence, rec.seqlen);
+         ArenaAppend(&bounds, (char *)&offset, sizeof(size_t));
+         residues += rec.seqlen;
+      }
+      if(!nbatch)
+         break;
+      offset = data.used;
+      ArenaAppend(&bounds, (char *)&offset, sizeof(size_t));
+      nseq += nbatch;
+
+      /* Search it with each engine                                     */
+      for(e=0; e<NENGINES; e++)
+      {
+         start = GetTime();
+         BenchmarkBatch(e, data.data, (size_t *)bounds.data, nbatch, 
+                        patterns, opts, hits[e], &masks);
+         times[e] += GetTime() - start;
+      }
+   }
+
+   fprintf(out, "Benchmark: %ld sequences, %llu residues, patterns \
+with %d..%d occurrences\n", nseq, (unsigned long long)residues,
+           opts->minpat, opts->maxpat);
+   fprintf(out, "%-8s %10s %10s %8s  %s\n", 
+           "Engine", "Seconds", "Mres/s", "Speedup", "Counts");
+   for(e=0; e<NENGINES; e++)
+   {
+      BOOL same = TRUE;
+      
+      for(i=0; i<npat; i++)
+      {
+         for(x=0; x<2; x++)
+         {
+            if(same && 
+               (hits[e][x][i].count != hits[BENCHLEGACY][x][i].count))
+            {
+               fprintf(stderr, "Benchmark: %s %s count for %s is %ld \
+but %ld from %s\n", (x ? "exact" : "non-exact"), names[e], 
+                       patterns + i*MAXPATLEN, hits[e][x][i].count, 
+                       hits[BENCHLEGACY][x][i].count, 
+                       names[BENCHLEGACY]);
+               same = FALSE;
+            }
+         }
+      }
+      fprintf(out, "%-8s %10.3f %10.1f %8.1f  %s\n", names[e], times[e],
+              (times[e] > 0.0) ? residues / times[e] / 1.0e6 : 0.0,
+              (times[e] > 0.0) ? times[BENCHLEGACY] / times[e] : 0.0,
+              ((e == BENCHLEGACY) ? "reference" :
+               (same ? "identical" : "DIFFERENT")));
+      if(!same)
+         ok = FALSE;
+   }
+
+   for(e=0; e<NENGINES; e++)
+   {
+      free(hits[e][0]);
+      free(hits[e][1]);
+   }
+   free(patterns);
+   ArenaFree(&data);
+   ArenaFree(&bounds);
+   rpFreeMatchMasks(&masks);
+   return(ok);
+}
+
+/************************************************************************/
+/*>void BenchmarkBatch(int engine, char *data, size_t *bounds, int nseq,
+                       char *patterns, OPTIONS *opts, PATHITS **hits,
+                       MATCHMASKS *masks)
+   ----------------------------------------------------------------------
+   Input:   int        engine   BENCHLEGACY, BENCHKERNEL or BENCHRUNS
+            char       *data    Sequences of the batch
+            size_t     *bounds  Start of each sequence in data (nseq+1 
+                                entries)
+            int        nseq     Number of sequences
+            char       *patterns The alternating pattern for each 
+                                residue and length, MAXPATLEN apart
+            OPTIONS    *opts    Search options
+   I/O:     PATHITS    **hits   Non-exact [0] and exact [1] counts for
+                                each residue and length
+            MATCHMASKS *masks   Work space for the bitmask kernel
+
+   Searches a batch of sequences with one engine for Benchmark()
+
+   16.10.26  Original   By: ACRM
+*/
+void BenchmarkBatch(int engine, char *data, size_t *bounds, int nseq,
+                    char *patterns, OPTIONS *opts, PATHITS **hits,
+                    MATCHMASKS *masks)
+{
+   char *sequence, *pattern;
+   int  s, r, n, i, seqlen, offset;
+   
+   for(s=0; s<nseq; s++)
+   {
+      sequence = data + bounds[s];
+      seqlen   = (int)(bounds[s+1] - bounds[s]);
+
+      if(engine == BENCHRUNS)
+      {
+         ScanSequenceForRuns(sequence, seqlen, s, FALSE, opts->minpat,
+                             opts->maxpat, hits[0], NULL, NULL);
+         ScanSequenceForRuns(sequence, seqlen, s, TRUE, opts->minpat,
+                             opts->maxpat, hits[1], NULL, NULL);
+         continue;
+      }
+
+      for(r=0; r<NRESIDUES; r++)
+      {
+         for(n=opts->minpat; n<=opts->maxpat; n++)
+         {
+            i       = r*(opts->maxpat + 1) + n;
+            pattern = patterns + i*MAXPATLEN;
+            
+            if(engine == BENCHKERNEL)
+            {
+               ScanSequenceForPattern(sequence, seqlen, s, pattern, 
+                                      NULL, FALSE, &(hits[0][i]), NULL,
+                                      masks, NULL);
+               ScanSequenceForPattern(sequence, seqlen, s, pattern, 
+                                      NULL, TRUE, &(hits[1][i]), NULL,
+                                      masks, NULL);
+            }
+            else
+            {
+               for(offset=0; 
+                   (offset=SearchSequenceForPattern(sequence, seqlen, 
+                                                    pattern, offset)) 
+                   != (-1); 
+                   offset++)
+               {
+                  hits[0][i].count++;
+                  if(rpCheckBounds(sequence, seqlen, pattern, 2*n-1, 
+                                   offset))
+                     hits[1][i].count++;
+               }
+            }
+         }
+      }
+   }
+}
+
+/************************************************************************/
+/*>BOOL AddHitSequence(PATHITS *hits, int seqnum)
+   ----------------------------------------------
+   Input:   int     seqnum      Sequence index
+   I/O:     PATHITS *hits       Hits for a pattern
+   Returns: BOOL                Success (FALSE if out of memory)
+
+   Records that a sequence matched a pattern. Repeated calls for the
+   same sequence only record it once.
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL AddHitSequence(PATHITS *hits, int seqnum)
+{
+   if(hits->lastseq == seqnum)
+      return(TRUE);
+   
+   if(hits->nseqs >= hits->maxseqs)
+   {
+      int maxseqs = (hits->maxseqs) ? 2 * hits->maxseqs : 16,
+          *seqs;
+
+      if((seqs = (int *)realloc(hits->seqs, maxseqs * sizeof(int)))
+         == NULL)
+         return(FALSE);
+      hits->seqs    = seqs;
+      hits->maxseqs = maxseqs;
+   }
+   hits->seqs[hits->nseqs++] = seqnum;
+   hits->lastseq = seqnum;
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>SEARCHRESULT *AllocSearchResults(int nresults, int npat)
+   --------------------------------------------------------
+   Input:   int     nresults    Number of results
+            int     npat        Number of patterns in each result
+   Returns: SEARCHRESULT *      Array of empty results
+
+   Allocates an array of empty search results. Exits if there is no
+   memory.
+
+   16.10.26  Original   By: ACRM
+*/
+SEARCHRESULT *AllocSearchResults(int nresults, int npat)
+{
+   SEARCHRESULT *results;
+   int          i, j;
+
+   if((results = (SEARCHRESULT *)calloc(nresults, sizeof(SEARCHRESULT)))
+      == NULL)
+   {
+      fprintf(stderr, "No memory for results\n");
+      exit(1);
+   }
+   for(i=0; i<nresults; i++)
+   {
+      if((results[i].hits = (PATHITS *)calloc(npat, sizeof(PATHITS)))
+         == NULL)
+      {
+         fprintf(stderr, "No memory for pattern counts\n");
+         exit(1);
+      }
+      for(j=0; j<npat; j++)
+         results[i].hits[j].lastseq = (-1);
+   }
+   return(results);
+}
+
+/************************************************************************/
+/*>void FreeSearchResults(SEARCHRESULT *results, int nresults, int npat)
+   ---------------------------------------------------------------------
+   I/O:     SEARCHRESULT *results  Array of results
+   Input:   int          nresults  Number of results
+            int          npat      Number of patterns in each result
+
+   Frees an array of search results
+
+   16.10.26  Original   By: ACRM
+*/
+void FreeSearchResults(SEARCHRESULT *results, int nresults, int npat)
+{
+   int i, j;
+   
+   for(i=0; i<nresults; i++)
+   {
+      for(j=0; j<npat; j++)
+      {
+         if(results[i].hits[j].seqs != NULL)
+            free(results[i].hits[j].seqs);
+      }
+      free(results[i].hits);
+      FreeStringPool(&(results[i].labels));
+      FreeHistogram(&(results[i].hist));
+      ArenaFree(&(results[i].maxima));
+   }
+   free(results);
+}
+
+/************************************************************************/
+/*>void InitResidueIndex(void)
+   ---------------------------
+   Sets up gResIndex[] to give the index of each residue in RESIDUES
+   and gBaseIndex[] to give the index of each nucleotide (in either 
+   case) in BASES. Must be called before any threads are started.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Uses rpBuildResidueIndex()
+   16.10.26  Sets up gBaseIndex[]
+*/
+void InitResidueIndex(void)
+{
+   int i;
+   
+   rpBuildResidueIndex(gResIndex);
+
+   for(i=0; i<256; i++)
+      gBaseIndex[i] = (-1);
+   for(i=0; i<NBASES; i++)
+   {
+      gBaseIndex[(unsigned char)BASES[i]]          = i;
+      gBaseIndex[(unsigned char)tolower(BASES[i])] = i;
+   }
+}
+
+/************************************************************************/
+/*>int SplitIntoChunks(char *data, size_t size, int nthreads, 
+                       size_t **bounds)
+   -----------------------------------------------------------
+   Input:   char    *data       Mapped file
+            size_t  size        Size of the file
+            int     nthreads    Number of threads
+   Output:  size_t  **bounds    Start offset of each chunk followed by 
+                                the size of the file
+   Returns: int                 Number of chunks
+
+   Splits a mapped file into chunks for the threads. There are several
+   chunks per thread so that work can be stolen by threads which finish
+   early. Each chunk boundary is moved forward to the start of a header
+   line so that no record is split.
+
+   16.10.26  Original   By: ACRM
+*/
+int SplitIntoChunks(char *data, size_t size, int nthreads, 
+                    size_t **bounds)
+{
+   size_t chunksize, pos;
+   char   *p, *end = data + size;
+   int    nchunks, maxchunks;
+
+   maxchunks = nthreads * THREADCHUNKS;
+   chunksize = size / maxchunks;
+   if(chunksize < MINCHUNK)
+   {
+      chunksize = MINCHUNK;
+      maxchunks = (int)(size / chunksize) + 1;
+   }
+
+   if((*bounds = (size_t *)malloc((maxchunks + 1) * sizeof(size_t)))
+      == NULL)
+   {
+      fprintf(stderr, "No memory for file chunks\n");
+      exit(1);
+   }
+
+   (*bounds)[0] = 0;
+   nchunks      = 1;
+   for(pos=chunksize; (pos < size) && (nchunks < maxchunks); 
+       pos+=chunksize)
+   {
+      /* Find the next header line                                      */
+      if(pos <= (*bounds)[nchunks-1])
+         continue;
+      for(p=data+pos-1; p<end; p++)
+      {
+         if((p = (char *)memchr(p, '\n', end-p)) == NULL)
+            break;
+         if((p+1 < end) && (p[1] == '>'))
+            break;
+      }
+      if((p == NULL) || (p >= end) || (p+1 >= end))
+         break;
+      (*bounds)[nchunks++] = (p + 1) - data;
+   }
+   (*bounds)[nchunks] = size;
+
+   return(nchunks);
+}
+
+/************************************************************************/
+/*>int SplitCorpus(CORPUS *corpus, size_t first, size_t last, 
+                    int nthreads, size_t **bounds)
+   -------------------------------------------------------------
+   Input:   CORPUS *corpus      Binary corpus
+            size_t first        First record to search
+            size_t last         One past the last record to search
+            int    nthreads     Number of threads
+   Output:  size_t **bounds     First record of each chunk with an extra
+                                entry for the end (malloc'd)
+   Returns: int                 Number of chunks
+
+   The equivalent of SplitIntoChunks() for a corpus. The records are 
+   split into runs with about the same number of residues.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Added first and last
+*/
+int SplitCorpus(CORPUS *corpus, size_t first, size_t last, 
+                int nthreads, size_t **bounds)
+{
+   uint64_t chunksize, target,
+            total = corpus->seqoffsets[last] - corpus->seqoffsets[first];
+   size_t   i;
+   int      nchunks, maxchunks;
+
+   maxchunks = nthreads * THREADCHUNKS;
+   chunksize = total / maxchunks;
+   if(chunksize < MINCHUNK)
+   {
+      chunksize = MINCHUNK;
+      maxchunks = (int)(total / chunksize) + 1;
+   }
+
+   if((*bounds = (size_t *)malloc((maxchunks + 1) * sizeof(size_t)))
+      == NULL)
+   {
+      fprintf(stderr, "No memory for file chunks\n");
+      exit(1);
+   }
+
+   (*bounds)[0] = first;
+   nchunks      = 1;
+   target       = corpus->seqoffsets[first] + chunksize;
+   for(i=first+1; (i<last) && (nchunks < maxchunks); i++)
+   {
+      if(corpus->seqoffsets[i] >= target)
+      {
+         (*bounds)[nchunks++] = i;
+         target = corpus->seqoffsets[i] + chunksize;
+      }
+   }
+   (*bounds)[nchunks] = last;
+
+   return(nchunks);
+}
+
+/************************************************************************/
+/*>BOOL SelectShard(FASTAREADER *reader, int shard, int nshards)
+   -------------------------------------------------------------
+   I/O:     FASTAREADER *reader   FASTA reader
+   Input:   int         shard     Shard to search (1..nshards)
+            int         nshards   Number of shards
+   Returns: BOOL                  Success? (FALSE for a stream)
+
+   Restricts the reader to one of nshards pieces of the file, each with
+   about the same number of bytes (or residues for a corpus). Pieces 
+   start at a header line, so every sequence is in exactly one shard.
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL SelectShard(FASTAREADER *reader, int shard, int nshards)
+{
+   uint64_t total;
+   size_t   start, end;
+   
+   if(reader->corpus != NULL)
+   {
+      total        = reader->corpus->seqoffsets[reader->corpus->nseq];
+      reader->pos  = FirstCorpusRecord(reader->corpus, 
+                                       total * (shard - 1) / nshards);
+      reader->size = (shard == nshards) ? reader->corpus->nseq :
+                     FirstCorpusRecord(reader->corpus, 
+                                       total * shard / nshards);
+      return(TRUE);
+   }
+   else if(reader->data != NULL)
+   {
+      start = NextHeader(reader->data, reader->size, 
+                         (size_t)((uint64_t)reader->size * (shard - 1) / 
+                                  nshards));
+      end   = (shard == nshards) ? reader->size :
+              NextHeader(reader->data, reader->size, 
+                         (size_t)((uint64_t)reader->size * shard / 
+                                  nshards));
+      reader->data += start;
+      reader->size  = end - start;
+      return(TRUE);
+   }
+   return(FALSE);
+}
+
+/************************************************************************/
+/*>size_t NextHeader(char *data, size_t size, size_t pos)
+   ------------------------------------------------------
+   Input:   char   *data        Mapped FASTA file
+            size_t size         Size of the file
+            size_t pos          Offset to start looking
+   Returns: size_t              Offset of the first header line at or
+                                after pos (size if there is none)
+
+   16.10.26  Original   By: ACRM
+*/
+size_t NextHeader(char *data, size_t size, size_t pos)
+{
+   char *p;
+   
+   if(pos == 0)
+   {
+      if(size && (data[0] == '>'))
+         return(0);
+      pos = 1;
+   }
+   for(pos--; pos < size; pos = p - data + 1)
+   {
+      if((p = memchr(data + pos, '\n', size - pos)) == NULL)
+         break;
+      if((p + 1 < data + size) && (p[1] == '>'))
+         return(p - data + 1);
+   }
+   return(size);
+}
+
+/************************************************************************/
+/*>size_t FirstCorpusRecord(CORPUS *corpus, uint64_t offset)
+   ---------------------------------------------------------
+   Input:   CORPUS   *corpus    Binary corpus
+            uint64_t offset     Residue offset
+   Returns: size_t              First record starting at or after 
+                                offset (nseq if there is none)
+
+   16.10.26  Original   By: ACRM
+*/
+size_t FirstCorpusRecord(CORPUS *corpus, uint64_t offset)
+{
+   size_t lo = 0,
+          hi = corpus->nseq,
+          mid;
+
+   while(lo < hi)
+   {
+      mid = (lo + hi) / 2;
+      if(corpus->seqoffsets[mid] < offset)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return(lo);
+}
+
+/************************************************************************/
+/*>void *SearchWorker(void *arg)
+   -----------------------------
+   Input:   void   *arg         The WORKER for this thread
+
+   Thread function which takes chunks of the file from its queue (or 
+   steals them from other threads) and searches each chunk into the
+   result for that chunk.
+
+   16.10.26  Original   By: ACRM
+*/
+void *SearchWorker(void *arg)
+{
+   WORKER      *worker = (WORKER *)arg;
+   SEARCH      *search = worker->search;
+   FASTAREADER reader;
+   int         chunk,
+               nthreads = search->opts->nthreads;
+
+   if(nthreads > search->nchunks)
+      nthreads = search->nchunks;
+   
+   /* Each thread has its own reader onto the shared mapping so that the
+      arenas are reused for all the chunks it searches
+   */
+   memset(&reader, 0, sizeof(FASTAREADER));
+   while((chunk = GetChunk(search, worker->id, nthreads)) >= 0)
+   {
+      if(search->corpus != NULL)
+      {
+         reader.corpus = search->corpus;
+         reader.pos    = search->bounds[chunk];
+         reader.size   = search->bounds[chunk+1];
+      }
+      else
+      {
+         reader.data = search->data + search->bounds[chunk];
+         reader.size = search->bounds[chunk+1] - search->bounds[chunk];
+         reader.pos  = 0;
+      }
+      SearchRecords(&reader, search, &(search->results[chunk]),
+                    ((search->opts->metrics != NULL) ? 
+                     &(search->opts->metrics->threads[worker->id]) : 
+                     NULL));
+   }
+   ArenaFree(&(reader.record));
+   ArenaFree(&(reader.header));
+
+   return(NULL);
+}
+
+/************************************************************************/
+/*>int GetChunk(SEARCH *search, int id, int nthreads)
+   --------------------------------------------------
+   Input:   SEARCH  *search     The search being run
+            int     id          Thread number
+            int     nthreads    Number of threads
+   Returns: int                 Chunk number (-1 if none left)
+
+   Gets the next chunk for a thread from the front of its own queue. If
+   the queue is empty, half of the chunks remaining at the back of 
+   another thread's queue are stolen.
+
+   16.10.26  Original   By: ACRM
+*/
+int GetChunk(SEARCH *search, int id, int nthreads)
+{
+   WORKQUEUE *own = &(search->queues[id]),
+             *victim;
+   int       chunk = (-1),
+             i, n, first, last;
+
+   pthread_mutex_lock(&(own->lock));
+   if(own->next < own->last)
+      chunk = own->next++;
+   pthread_mutex_unlock(&(own->lock));
+   if(chunk >= 0)
+      return(chunk);
+
+   for(i=1; i<nthreads; i++)
+   {
+      victim = &(search->queues[(id+i) % nthreads]);
+      
+      pthread_mutex_lock(&(victim->lock));
+      n = victim->last - victim->next;
+      if(n > 0)
+      {
+         last          = victim->last;
+         first         = last - (n+1)/2;
+         victim->last  = first;
+      }
+      pthread_mutex_unlock(&(victim->lock));
+
+      if(n > 0)
+      {
+         /* Keep the first stolen chunk and queue the rest              */
+         pthread_mutex_lock(&(own->lock));
+         own->next = first + 1;
+         own->last = last;
+         pthread_mutex_unlock(&(own->lock));
+         return(first);
+      }
+   }
+   
+   return(-1);
+}
+
+/************************************************************************/
+/*>int StoreString(STRPOOL *pool, char *string, int len)
+   -----------------------------------------------------
+   Input:   char    *string     String to store
+            int     len         Length of the string
+   I/O:     STRPOOL *pool       String pool
+   Returns: int                 Index of the string in the pool (-1 if
+                                out of memory)
+
+   Appends a copy of a string to a string pool. The string need not be
+   terminated; the copy in the pool is.
+
+   16.10.26  Original   By: ACRM
+*/
+int StoreString(STRPOOL *pool, char *string, int len)
+{
+   if(pool->used + len + 1 > pool->size)
+   {
+      long size = (pool->size) ? 2 * pool->size : 65536;
+      char *buffer;
+
+      while(size < pool->used + len + 1)
+         size *= 2;
+      if((buffer = (char *)realloc(pool->buffer, size)) == NULL)
+         return(-1);
+      pool->buffer = buffer;
+      pool->size   = size;
+   }
+   if(pool->nstrings >= pool->maxstrings)
+   {
+      int  maxstrings = (pool->maxstrings) ? 2 * pool->maxstrings : 1024;
+      long *offsets;
+
+      if((offsets = (long *)realloc(pool->offsets, 
+                                    maxstrings * sizeof(long))) == NULL)
+         return(-1);
+      pool->offsets    = offsets;
+      pool->maxstrings = maxstrings;
+   }
+
+   memcpy(pool->buffer + pool->used, string, len);
+   pool->buffer[pool->used + len] = '\0';
+   pool->offsets[pool->nstrings] = pool->used;
+   pool->used += len + 1;
+   return(pool->nstrings++);
+}
+
+/************************************************************************/
+/*>void FreeStringPool(STRPOOL *pool)
+   ----------------------------------
+   I/O:     STRPOOL *pool       String pool
+
+   Frees the memory used by a string pool
+
+   16.10.26  Original   By: ACRM
+*/
+void FreeStringPool(STRPOOL *pool)
+{
+   if(pool->buffer != NULL)
+      free(pool->buffer);
+   if(pool->offsets != NULL)
+      free(pool->offsets);
+   pool->buffer   = NULL;
+   pool->offsets  = NULL;
+   pool->used     = pool->size       = 0;
+   pool->nstrings = pool->maxstrings = 0;
+}
+
+/************************************************************************/
+/* Takes a sequence and pattern of the form AXAXAXA together with an
+   offset into the sequence. It then searches for the pattern starting
+   from the specified offset.
+   If the pattern is found then it returns the new offset where the
+   pattern was found.
+   Returns (-1) when pattern not found
+*/
+int SearchSequenceForPattern(char *sequence, int seqlen, char *pattern, 
+                             int offset)
+{
+   char *subseq, ch;
+   int  patlen, nrepeat, i, j;
+   BOOL match;
+   
+   subseq = sequence+offset;
+   seqlen -= offset;
+
+   patlen = strlen(pattern);
+   nrepeat = (patlen-1)/2;
+   ch      = pattern[0];
+   
+   for(i=0; i<(1+seqlen-patlen); i++)
+   {
+      match = TRUE;
+      for(j=0; j<patlen; j+=2)
+      {
+         if(subseq[i+j] != ch)
+         {
+            match = FALSE;
+            break;
+         }
+      }
+      if(match)
+      {
+         for(j=1; j<patlen-1; j+=2)
+         {
+            if(subseq[i+j] == ch)
+            {
+               match = FALSE;
+               break;
+            }
+         }
+      }
+      
+      if(match)
+      {
+         return(offset+i);
+      }
+   }
+
+   return(-1);
+}
+
+/************************************************************************/
+/*>FASTAREADER *OpenFASTAReader(FILE *in)
+   --------------------------------------
+   Input:   FILE        *in     Input file
+   Returns: FASTAREADER *       Reader (NULL if out of memory)
+
+   Creates a reader for a FASTA file. Regular files are memory mapped so
+   that records can be handed out as views into the file. The mapping is
+   private and writable so that lower case sequences can be folded in
+   place; only pages that actually contain lower case are copied. If the
+   file cannot be mapped, it is read with ReadFASTAStream() instead.
+
+   If the file is a binary corpus written by BuildCorpus(), records are
+   read from that instead.
+
+   Other input, such as stdin or a pipe from a decompressor, is read 
+   into a ring of buffers by a separate thread so that reading overlaps
+   with searching.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Reads corpus files
+   16.10.26  Starts a RING for input which is not mapped
+*/
+FASTAREADER *OpenFASTAReader(FILE *in)
+{
+   FASTAREADER *reader;
+   struct stat st;
+   void        *data;
+
+   if((reader = (FASTAREADER *)calloc(1, sizeof(FASTAREADER))) == NULL)
+      return(NULL);
+   reader->fp = in;
+
+   /* An empty file cannot be mapped so is read through the ring       */
+   if(!fstat(fileno(in), &st) && S_ISREG(st.st_mode) && st.st_size)
+   {
+      data = mmap(NULL, (size_t)st.st_size, PROT_READ|PROT_WRITE, 
+                  MAP_PRIVATE, fileno(in), 0);
+      if(data != MAP_FAILED)
+      {
+         posix_madvise(data, (size_t)st.st_size, 
+                       POSIX_MADV_SEQUENTIAL);
+
+         if((((size_t)st.st_size >= sizeof(CORPUSHEADER)) &&
+             !strncmp((char *)data, CORPUSMAGIC, 8)) ||
+            (((size_t)st.st_size >= offsetof(CORPUSHEADER, runs)) &&
+             !strncmp((char *)data, CORPUSMAGIC1, 8)))
+         {
+            if((reader->corpus = OpenCorpus((char *)data, 
+                                            (size_t)st.st_size)) == NULL)
+            {
+               fprintf(stderr, "Corpus file is corrupt\n");
+               munmap(data, (size_t)st.st_size);
+               free(reader);
+               return(NULL);
+            }
+            reader->pos  = 0;
+            reader->size = reader->corpus->nseq;
+            return(reader);
+         }
+         
+         reader->map     = reader->data = (char *)data;
+         reader->mapsize = reader->size = (size_t)st.st_size;
+         return(reader);
+      }
+   }
+
+   if((reader->ring = StartRing(in)) == NULL)
+   {
+      free(reader);
+      return(NULL);
+   }
+   return(reader);
+}
+
+/************************************************************************/
+/*>BOOL ReadFASTARecord(FASTAREADER *reader, FASTAREC *rec)
+   --------------------------------------------------------
+   I/O:     FASTAREADER *reader FASTA reader
+   Output:  FASTAREC    *rec    The record
+   Returns: BOOL                Was a record read?
+
+   Reads the next record. The label and sequence are only valid until
+   the next call. Where a sequence is on a single line, it is returned
+   directly from the mapped file; otherwise the lines are copied into
+   the record arena which is reset, but not freed, for every record. 
+   Any text before the first header is ignored.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Reads from a corpus
+*/
+BOOL ReadFASTARecord(FASTAREADER *reader, FASTAREC *rec)
+{
+   char   *end, *p, *eol, *next;
+
+   if(reader->corpus != NULL)
+      return(ReadCorpusRecord(reader, rec));
+
+   /* File could not be mapped so fall back to reading it               */
+   if(reader->data == NULL)
+      return(ReadFASTAStream(reader, rec));
+
+   end = reader->data + reader->size;
+   p   = reader->data + reader->pos;
+
+   /* Find the next header line                                         */
+   while((p < end) && (*p != '>'))
+   {
+      if((eol = (char *)memchr(p, '\n', end-p)) == NULL)
+         p = end;
+      else
+         p = eol+1;
+   }
+   if(p >= end)
+   {
+      reader->pos = reader->size;
+      return(FALSE);
+   }
+
+   if((eol = (char *)memchr(p, '\n', end-p)) == NULL)
+      eol = end;
+   rec->label    = p;
+   rec->labellen = (int)(eol - p);
+   p = (eol < end) ? eol+1 : end;
+
+   /* Find the end of the first sequence line                           */
+   if((p >= end) || (*p == '>'))
+   {
+      rec->sequence = p;
+      rec->seqlen   = 0;
+   }
+   else
+   {
+      if((eol = (char *)memchr(p, '\n', end-p)) == NULL)
+         eol = end;
+      next = (eol < end) ? eol+1 : end;
+      
+      if((next >= end) || (*next == '>'))
+      {
+         /* Single line sequence - use it directly                      */
+         rec->sequence = p;
+         rec->seqlen   = (int)(eol - p);
+         p = next;
+      }
+      else
+      {
+         /* Multi-line sequence - copy the lines into the arena         */
+         ArenaReset(&(reader->record));
+         while((p < end) && (*p != '>'))
+         {
+            if((eol = (char *)memchr(p, '\n', end-p)) == NULL)
+               eol = end;
+            ArenaAppend(&(reader->record), p, eol-p);
+            p = (eol < end) ? eol+1 : end;
+         }
+         rec->sequence = reader->record.data;
+         rec->seqlen   = (int)reader->record.used;
+      }
+   }
+
+   reader->pos = p - reader->data;
+   FoldToUpper(rec->sequence, rec->seqlen);
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>ssize_t ReadLine(FASTAREADER *reader)
+   -------------------------------------
+   I/O:     FASTAREADER *reader FASTA reader with a RING
+   Returns: ssize_t             Length of the line including any '\n'
+                                (-1 at the end of the file)
+
+   Reads a line of any length from the ring into reader->line, in the
+   same way as getline()
+
+   16.10.26  Original   By: ACRM
+*/
+ssize_t ReadLine(FASTAREADER *reader)
+{
+   size_t len = 0, 
+          n, size;
+   char   *eol, *start;
+
+   for(;;)
+   {
+      if(reader->bufpos >= reader->buflen)
+      {
+         if((reader->buflen = RingNext(reader->ring, &(reader->buffer)))
+            == 0)
+            break;
+         reader->bufpos = 0;
+      }
+
+      start = reader->buffer + reader->bufpos;
+      eol   = (char *)memchr(start, '\n', reader->buflen - reader->bufpos);
+      n     = (eol != NULL) ? (size_t)(eol - start) + 1 : 
+                              reader->buflen - reader->bufpos;
+
+      if(len + n + 1 > reader->linesize)
+      {
+         size = reader->linesize ? 2 * reader->linesize : MAXBUFF;
+         while(size < len + n + 1)
+            size *= 2;
+         if((reader->line = (char *)realloc(reader->line, size)) == NULL)
+         {
+            fprintf(stderr, "No memory for line of length %lu\n",
+                    (unsigned long)(len + n));
+            exit(1);
+         }
+         reader->linesize = size;
+      }
+      memcpy(reader->line + len, start, n);
+      len            += n;
+      reader->bufpos += n;
+      if(eol != NULL)
+         break;
+   }
+
+   if(!len)
+      return(-1);
+   reader->line[len] = '\0';
+   return((ssize_t)len);
+}
+
+/************************************************************************/
+/*>RING *StartRing(FILE *fp)
+   -------------------------
+   Input:   FILE   *fp          Input stream
+   Returns: RING   *            The ring (NULL if out of memory or the
+                                thread could not be started)
+
+   Allocates a ring of input buffers and starts a thread to fill them
+   from the stream. The thread blocks when all the buffers are full so
+   reading, or decompression upstream of a pipe, runs ahead of the 
+   search by at most RINGBUFFERS buffers.
+
+   16.10.26  Original   By: ACRM
+*/
+RING *StartRing(FILE *fp)
+{
+   RING *ring;
+   int  i;
+
+   if((ring = (RING *)calloc(1, sizeof(RING))) == NULL)
+      return(NULL);
+   for(i=0; i<RINGBUFFERS; i++)
+   {
+      if((ring->buffers[i] = (char *)malloc(RINGBUFFSIZE)) == NULL)
+      {
+         while(i--)
+            free(ring->buffers[i]);
+         free(ring);
+         return(NULL);
+      }
+   }
+   ring->fp = fp;
+   pthread_mutex_init(&(ring->lock), NULL);
+   pthread_cond_init(&(ring->filled), NULL);
+   pthread_cond_init(&(ring->emptied), NULL);
+
+   if(pthread_create(&(ring->thread), NULL, RingReader, (void *)ring))
+   {
+      ring->stop = TRUE;
+      ring->eof  = TRUE;
+      StopRing(ring);
+      return(NULL);
+   }
+   return(ring);
+}
+
+/************************************************************************/
+/*>void *RingReader(void *arg)
+   ---------------------------
+   Input:   void   *arg         The RING
+   Returns: void   *            NULL
+
+   Thread which fills the ring buffers from the input stream until the
+   end of the stream or until it is told to stop
+
+   16.10.26  Original   By: ACRM
+   17.10.26  Sets ring->error if the stream could not be read
+*/
+void *RingReader(void *arg)
+{
+   RING   *ring = (RING *)arg;
+   size_t n;
+
+   for(;;)
+   {
+      pthread_mutex_lock(&(ring->lock));
+      while((ring->count == RINGBUFFERS) && !ring->stop)
+         pthread_cond_wait(&(ring->emptied), &(ring->lock));
+      if(ring->stop)
+      {
+         pthread_mutex_unlock(&(ring->lock));
+         break;
+      }
+      pthread_mutex_unlock(&(ring->lock));
+
+      /* Only this thread touches the buffer at head while it is empty  */
+      n = fread(ring->buffers[ring->head], 1, RINGBUFFSIZE, ring->fp);
+
+      pthread_mutex_lock(&(ring->lock));
+      if(n)
+      {
+         ring->bytes += n;
+         ring->lengths[ring->head] = n;
+         ring->head = (ring->head + 1) % RINGBUFFERS;
+         ring->count++;
+      }
+      else
+      {
+         ring->eof   = TRUE;
+         ring->error = ferror(ring->fp) ? TRUE : FALSE;
+      }
+      pthread_cond_signal(&(ring->filled));
+      pthread_mutex_unlock(&(ring->lock));
+      
+      if(!n)
+         break;
+   }
+   
+   return(NULL);
+}
+
+/************************************************************************/
+/*>size_t RingNext(RING *ring, char **data)
+   ----------------------------------------
+   I/O:     RING   *ring        The ring
+   Output:  char   **data       Next buffer of input
+   Returns: size_t              Bytes in the buffer (0 at the end of the
+                                input)
+
+   Releases the buffer returned by the previous call and waits for the
+   next one to be filled
+
+   16.10.26  Original   By: ACRM
+*/
+size_t RingNext(RING *ring, char **data)
+{
+   size_t len = 0;
+   
+   pthread_mutex_lock(&(ring->lock));
+   if(ring->inuse)
+   {
+      ring->tail  = (ring->tail + 1) % RINGBUFFERS;
+      ring->count--;
+      ring->inuse = FALSE;
+      pthread_cond_signal(&(ring->emptied));
+   }
+
+   while(!ring->count && !ring->eof)
+      pthread_cond_wait(&(ring->filled), &(ring->lock));
+   if(ring->count)
+   {
+      *data       = ring->buffers[ring->tail];
+      len         = ring->lengths[ring->tail];
+      ring->inuse = TRUE;
+   }
+   pthread_mutex_unlock(&(ring->lock));
+
+   return(len);
+}
+
+/************************************************************************/
+/*>BOOL ReaderError(FASTAREADER *reader)
+   -------------------------------------
+   Input:   FASTAREADER *reader FASTA reader
+   Returns: BOOL                Did reading stop on a read error rather 
+                                than the end of the file?
+
+   Only a stream read through the ring can fail part way; a mapped file
+   or corpus is read from memory.
+
+   17.10.26  Original   By: ACRM
+*/
+BOOL ReaderError(FASTAREADER *reader)
+{
+   BOOL error = FALSE;
+
+   if(reader->ring != NULL)
+   {
+      pthread_mutex_lock(&(reader->ring->lock));
+      error = reader->ring->error;
+      pthread_mutex_unlock(&(reader->ring->lock));
+   }
+   return(error);
+}
+
+/************************************************************************/
+/*>void StopRing(RING *ring)
+   -------------------------
+   I/O:     RING   *ring        The ring
+
+   Stops the input thread and frees the ring. The stream is not closed.
+
+   16.10.26  Original   By: ACRM
+*/
+void StopRing(RING *ring)
+{
+   int i;
+   
+   pthread_mutex_lock(&(ring->lock));
+   if(!ring->stop)
+   {
+      ring->stop = TRUE;
+      pthread_cond_signal(&(ring->emptied));
+      pthread_mutex_unlock(&(ring->lock));
+      pthread_join(ring->thread, NULL);
+   }
+   else
+   {
+      pthread_mutex_unlock(&(ring->lock));
+   }
+
+   pthread_mutex_destroy(&(ring->lock));
+   pthread_cond_destroy(&(ring->filled));
+   pthread_cond_destroy(&(ring->emptied));
+   for(i=0; i<RINGBUFFERS; i++)
+      free(ring->buffers[i]);
+   free(ring);
+}
+
+/************************************************************************/
+/*>HITWRITER *StartHitWriter(FILE *fp, int nchunks)
+   ------------------------------------------------
+   Input:   FILE      *fp       Hit output file
+            int       nchunks   Number of chunks being searched
+   Returns: HITWRITER *         The writer (NULL if out of memory or the
+                                thread could not be started)
+
+   Starts a thread to write the hit records for a search. Each chunk's
+   records are queued in blocks by QueueHits() and the thread writes 
+   them in chunk order, so the output is the same for any number of 
+   threads while the searching threads never wait for the output.
+
+   16.10.26  Original   By: ACRM
+*/
+HITWRITER *StartHitWriter(FILE *fp, int nchunks)
+{
+   HITWRITER *writer;
+
+   if((writer = (HITWRITER *)calloc(1, sizeof(HITWRITER))) == NULL)
+      return(NULL);
+   writer->fp      = fp;
+   writer->nchunks = nchunks;
+   writer->first   = (HITBLOCK **)calloc(nchunks, sizeof(HITBLOCK *));
+   writer->last    = (HITBLOCK **)calloc(nchunks, sizeof(HITBLOCK *));
+   writer->done    = (BOOL *)calloc(nchunks, sizeof(BOOL));
+   if((writer->first == NULL) || (writer->last == NULL) || 
+      (writer->done == NULL))
+   {
+      free(writer->first);
+      free(writer->last);
+      free(writer->done);
+      free(writer);
+      return(NULL);
+   }
+   pthread_mutex_init(&(writer->lock), NULL);
+   pthread_cond_init(&(writer->ready), NULL);
+
+   if(pthread_create(&(writer->thread), NULL, HitWriterThread, 
+                     (void *)writer))
+   {
+      pthread_mutex_destroy(&(writer->lock));
+      pthread_cond_destroy(&(writer->ready));
+      free(writer->first);
+      free(writer->last);
+      free(writer->done);
+      free(writer);
+      return(NULL);
+   }
+   return(writer);
+}
+
+/************************************************************************/
+/*>void *HitWriterThread(void *arg)
+   --------------------------------
+   Input:   void   *arg         The HITWRITER
+   Returns: void   *            NULL
+
+   Thread which writes the queued blocks for each chunk in turn until
+   every chunk has been searched and written. Write errors are left for
+   the caller to find with ferror().
+
+   16.10.26  Original   By: ACRM
+*/
+void *HitWriterThread(void *arg)
+{
+   HITWRITER *writer = (HITWRITER *)arg;
+   HITBLOCK  *block;
+   double    start;
+
+   pthread_mutex_lock(&(writer->lock));
+   while(writer->next < writer->nchunks)
+   {
+      if((block = writer->first[writer->next]) != NULL)
+      {
+         if((writer->first[writer->next] = block->next) == NULL)
+            writer->last[writer->next] = NULL;
+         pthread_mutex_unlock(&(writer->lock));
+
+         start = GetTime();
+         fwrite(block->data, 1, block->used, writer->fp);
+         writer->writetime += GetTime() - start;
+         free(block->data);
+         free(block);
+
+         pthread_mutex_lock(&(writer->lock));
+      }
+      else if(writer->done[writer->next])
+      {
+         writer->next++;
+      }
+      else
+      {
+         pthread_cond_wait(&(writer->ready), &(writer->lock));
+      }
+   }
+   pthread_mutex_unlock(&(writer->lock));
+   
+   return(NULL);
+}
+
+/************************************************************************/
+/*>void QueueHits(HITWRITER *writer, int chunk, ARENA *text, BOOL done)
+   --------------------------------------------------------------------
+   Input:   HITWRITER *writer   The writer
+            int       chunk     Chunk the records are from
+   I/O:     ARENA     *text     Formatted records. The memory is handed
+                                to the writer and the arena emptied.
+   Input:   BOOL      done      Has the chunk been searched?
+
+   Queues a block of hit records to be written
+
+   16.10.26  Original   By: ACRM
+*/
+void QueueHits(HITWRITER *writer, int chunk, ARENA *text, BOOL done)
+{
+   HITBLOCK *block = NULL;
+
+   if(text->used)
+   {
+      if((block = (HITBLOCK *)malloc(sizeof(HITBLOCK))) == NULL)
+      {
+         fprintf(stderr, "No memory for hit output\n");
+         exit(1);
+      }
+      block->next = NULL;
+      block->data = text->data;
+      block->used = text->used;
+   }
+   else
+   {
+      ArenaFree(text);
+   }
+   text->data = NULL;
+   text->used = text->size = 0;
+
+   pthread_mutex_lock(&(writer->lock));
+   if(block != NULL)
+   {
+      if(writer->last[chunk] != NULL)
+         writer->last[chunk]->next = block;
+      else
+         writer->first[chunk] = block;
+      writer->last[chunk] = block;
+   }
+   if(done)
+      writer->done[chunk] = TRUE;
+   pthread_cond_signal(&(writer->ready));
+   pthread_mutex_unlock(&(writer->lock));
+}
+
+/************************************************************************/
+/*>double StopHitWriter(HITWRITER *writer)
+   ---------------------------------------
+   I/O:     HITWRITER *writer   The writer
+   Returns: double              Seconds spent writing
+
+   Waits for the writer thread to write every chunk and frees the 
+   writer. The file is not closed.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Returns the time spent writing
+*/
+double StopHitWriter(HITWRITER *writer)
+{
+   double writetime;
+   
+   pthread_join(writer->thread, NULL);
+   writetime = writer->writetime;
+   pthread_mutex_destroy(&(writer->lock));
+   pthread_cond_destroy(&(writer->ready));
+   free(writer->first);
+   free(writer->last);
+   free(writer->done);
+   free(writer);
+   return(writetime);
+}
+
+/************************************************************************/
+/*>BOOL SearchDNA(FASTAREADER *reader, OPTIONS *opts)
+   --------------------------------------------------
+   Input:   FASTAREADER *reader Input FASTA or corpus file
+            OPTIONS     *opts   Search options
+   Returns: BOOL                Success?
+
+   Counts every pattern of the form cXcX...c for each nucleotide c, as
+   the default search does for amino acids. The input is read in 
+   pieces and each sequence is passed through a window of DNAWINDOW 
+   bases so that a whole chromosome never needs to be held in memory.
+   Pages of a mapped file are released once they have been read.
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL SearchDNA(FASTAREADER *reader, OPTIONS *opts)
+{
+   DNASCAN  scan;
+   FASTAREC rec;
+   char     *data;
+   size_t   len, nwords,
+            page = (size_t)sysconf(_SC_PAGESIZE);
+   uintptr_t from, to;
+
+   if(opts->minpat < 1)
+      opts->minpat = 1;
+   if(opts->maxpat < opts->minpat)
+      opts->maxpat = opts->minpat - 1;
+
+   memset(&scan, 0, sizeof(DNASCAN));
+   scan.opts      = opts;
+   scan.result    = AllocSearchResults(1, CountPatterns(opts));
+   scan.linestart = TRUE;
+
+   /* The window has room for two blocks of padding after the bases     */
+   nwords = DNAWINDOW / 64 + 2;
+   if(((scan.lo    = (uint64_t *)malloc(nwords * sizeof(uint64_t))) 
+       == NULL) ||
+      ((scan.hi    = (uint64_t *)malloc(nwords * sizeof(uint64_t))) 
+       == NULL) ||
+      ((scan.other = (uint64_t *)malloc(nwords * sizeof(uint64_t))) 
+       == NULL))
+   {
+      fprintf(stderr, "No memory for sequence window\n");
+      exit(1);
+   }
+
+   if(reader->corpus != NULL)
+   {
+      while(ReadCorpusRecord(reader, &rec))
+      {
+         StartDNASequence(&scan, rec.label, rec.labellen);
+         AddDNABases(&scan, rec.sequence, rec.seqlen);
+         EndDNASequence(&scan);
+      }
+   }
+   else if(reader->data != NULL)
+   {
+      while(reader->pos < reader->size)
+      {
+         len = reader->size - reader->pos;
+         if(len > DNACHUNK)
+            len = DNACHUNK;
+         ScanDNAText(&scan, reader->data + reader->pos, len);
+
+         /* Release the whole pages which have now been read            */
+         from = ((uintptr_t)(reader->data + reader->pos) / page) * page;
+         reader->pos += len;
+         to   = ((uintptr_t)(reader->data + reader->pos) / page) * page;
+         if(to > from)
+            madvise((void *)from, to - from, MADV_DONTNEED);
+      }
+   }
+   else
+   {
+      while((len = RingNext(reader->ring, &data)) != 0)
+         ScanDNAText(&scan, data, len);
+   }
+   if(scan.insequence)
+      EndDNASequence(&scan);
+
+   ReportAllPatterns(scan.result, 1, opts);
+
+   FreeSearchResults(scan.result, 1, CountPatterns(opts));
+   ArenaFree(&(scan.label));
+   ArenaFree(&(scan.header));
+   free(scan.lo);
+   free(scan.hi);
+   free(scan.other);
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>void ScanDNAText(DNASCAN *scan, char *text, size_t len)
+   -------------------------------------------------------
+   I/O:     DNASCAN *scan       Scan state
+   Input:   char    *text       Next piece of a FASTA file
+            size_t  len         Length of text
+
+   Splits FASTA text into headers and sequence lines, which may be cut
+   anywhere between pieces. As in ReadFASTARecord(), anything before 
+   the first header is skipped and a header is a line starting with >.
+
+   16.10.26  Original   By: ACRM
+*/
+void ScanDNAText(DNASCAN *scan, char *text, size_t len)
+{
+   char *p   = text,
+        *end = text + len,
+        *eol;
+
+   while(p < end)
+   {
+      if(!scan->inheader && scan->linestart && (*p == '>'))
+      {
+         if(scan->insequence)
+            EndDNASequence(scan);
+         ArenaReset(&(scan->header));
+         scan->inheader = TRUE;
+      }
+
+      if((eol = (char *)memchr(p, '\n', end-p)) == NULL)
+         eol = end;
+      if(scan->inheader)
+         ArenaAppend(&(scan->header), p, eol-p);
+      else if(scan->insequence)
+         AddDNABases(scan, p, eol-p);
+
+      scan->linestart = (eol < end);
+      if(scan->linestart && scan->inheader)
+      {
+         StartDNASequence(scan, scan->header.data, scan->header.used);
+         scan->inheader = FALSE;
+      }
+      p = (eol < end) ? eol+1 : end;
+   }
+}
+
+/************************************************************************/
+/*>void StartDNASequence(DNASCAN *scan, char *label, size_t len)
+   -------------------------------------------------------------
+   I/O:     DNASCAN *scan       Scan state
+   Input:   char    *label      Label of the new sequence
+            size_t  len         Length of the label
+
+   16.10.26  Original   By: ACRM
+*/
+void StartDNASequence(DNASCAN *scan, char *label, size_t len)
+{
+   int c;
+
+   ArenaReset(&(scan->label));
+   ArenaAppend(&(scan->label), label, len);
+   scan->seqnum     = scan->result->labels.nstrings;
+   scan->insequence = TRUE;
+   scan->matched    = FALSE;
+   scan->start      = 0;
+   scan->seqlen     = 0;
+   scan->nbases     = 0;
+   scan->first      = (-1);
+   scan->last       = (-1);
+   for(c=0; c<NBASES; c++)
+      scan->cont[c] = 0;
+}
+
+/************************************************************************/
+/*>void AddDNABases(DNASCAN *scan, char *bases, size_t len)
+   --------------------------------------------------------
+   I/O:     DNASCAN *scan       Scan state
+   Input:   char    *bases      Bases to add to the current sequence
+            size_t  len         Number of bases
+
+   Packs bases into the window, scanning it whenever it is full. Each 
+   base takes one bit in lo and one in hi (its index in BASES). 
+   Anything other than ACGT (such as N) sets a bit in other so that it
+   matches no base but still acts as a spacer, as for a non-residue in
+   a protein.
+
+   16.10.26  Original   By: ACRM
+*/
+void AddDNABases(DNASCAN *scan, char *bases, size_t len)
+{
+   size_t   i, n, w;
+   uint64_t lo, hi, other;
+   int      b, bit;
+
+   if(len && !scan->start && !scan->nbases)
+      scan->first = gBaseIndex[(unsigned char)bases[0]];
+
+   while(len)
+   {
+      if(scan->nbases == DNAWINDOW)
+         ScanDNABlocks(scan, FALSE);
+
+      /* Fill the rest of the current word                              */
+      w   = scan->nbases / 64;
+      bit = (int)(scan->nbases % 64);
+      n   = 64 - bit;
+      if(n > len)
+         n = len;
+      if(bit)
+      {
+         lo    = scan->lo[w];
+         hi    = scan->hi[w];
+         other = scan->other[w];
+      }
+      else
+      {
+         lo = hi = other = 0;
+      }
+
+      for(i=0; i<n; i++, bit++)
+      {
+         b      = gBaseIndex[(unsigned char)bases[i]];
+         lo    |= (uint64_t)(b & 1)        << bit;
+         hi    |= (uint64_t)((b >> 1) & 1) << bit;
+         other |= (uint64_t)(b < 0)        << bit;
+      }
+
+      scan->lo[w]    = lo & ~other;
+      scan->hi[w]    = hi & ~other;
+      scan->other[w] = other;
+      scan->nbases  += n;
+      bases         += n;
+      len           -= n;
+   }
+}
+
+/************************************************************************/
+/*>void EndDNASequence(DNASCAN *scan)
+   ----------------------------------
+   I/O:     DNASCAN *scan       Scan state
+
+   Scans the rest of the window and records the label if anything 
+   matched
+
+   16.10.26  Original   By: ACRM
+*/
+void EndDNASequence(DNASCAN *scan)
+{
+   OPTIONS *opts = scan->opts;
+   int     nseq;
+   
+   ScanDNABlocks(scan, TRUE);
+   scan->insequence = FALSE;
+
+   if(opts->verbose && scan->matched &&
+      (StoreString(&(scan->result->labels), scan->label.data, 
+                   (int)scan->label.used) < 0))
+   {
+      fprintf(stderr, "No memory for sequence labels\n");
+      exit(1);
+   }
+
+   nseq = ++(scan->nseq);
+   if(!opts->quiet && !(nseq % 10000))
+   {
+      fprintf(stderr, "Processed %d sequences\n", nseq);
+      fflush(stderr);
+   }
+}
+
+/************************************************************************/
+/*>void ScanDNABlocks(DNASCAN *scan, BOOL final)
+   ---------------------------------------------
+   I/O:     DNASCAN *scan       Scan state
+   Input:   BOOL    final       The sequence has ended
+
+   Finds the alternating runs in each block of 64 bases in the window. 
+   For a base c, E has a bit set where the sequence is c. A run 
+   continues from i to i+2 where E[i] & ~E[i+1] & E[i+2]; it starts 
+   where E is set but does not continue from i-2, and ends where E is
+   set but does not continue to i+2. So a block needs the next block 
+   but only the continuation bits of the previous one. Runs of one 
+   base start and end at the same bit and are counted with a popcount;
+   other runs are passed to CountDNARun(). The runs found are exactly
+   those found by rpNextRun().
+
+   Unless the sequence has ended, the last block (for which the next 
+   block is not yet known) is moved to the start of the window. At the
+   end, the window is padded with bases which match nothing. 
+   CountDNARun() needs to know the end of the sequence, and whether the
+   run starts at position 1, so those blocks have no shortcut for runs
+   of one.
+
+   16.10.26  Original   By: ACRM
+*/
+void ScanDNABlocks(DNASCAN *scan, BOOL final)
+{
+   OPTIONS  *opts = scan->opts;
+   PATHITS  *hits = scan->result->hits;
+   uint64_t e, enext, cont, starts, ends, singles, events, pos,
+            lo, hi, other, lonext, hinext, othernext;
+   size_t   nblocks, k, w;
+   int      c, i, n,
+            npat  = opts->maxpat + 1;
+   BOOL     fast;
+
+   if(final)
+   {
+      w = scan->nbases / 64;
+      if(scan->nbases)
+      {
+         i = (int)((scan->nbases - 1) % 64);
+         k = (scan->nbases - 1) / 64;
+         scan->last = ((scan->other[k] >> i) & 1) ? (-1) :
+                      (int)(((scan->lo[k] >> i) & 1) | 
+                            (((scan->hi[k] >> i) & 1) << 1));
+      }
+      if(scan->nbases % 64)
+         scan->other[w] |= ~(uint64_t)0 << (scan->nbases % 64);
+      else
+         scan->lo[w] = scan->hi[w] = 0, scan->other[w] = ~(uint64_t)0;
+      scan->lo[w+1]    = scan->hi[w+1] = 0;
+      scan->other[w+1] = ~(uint64_t)0;
+      scan->seqlen     = scan->start + scan->nbases;
+      nblocks = (scan->nbases + 63) / 64;
+   }
+   else
+   {
+      nblocks = scan->nbases / 64 - 1;
+   }
+
+   for(k=0; k<nblocks; k++)
+   {
+      lo        = scan->lo[k];
+      hi        = scan->hi[k];
+      other     = scan->other[k];
+      lonext    = scan->lo[k+1];
+      hinext    = scan->hi[k+1];
+      othernext = scan->other[k+1];
+      pos       = scan->start + 64*k;
+      fast      = !final && pos;
+      
+      for(c=0; c<NBASES; c++)
+      {
+         e      = ((c & 1) ? lo : ~lo) & ((c & 2) ? hi : ~hi) & ~other;
+         enext  = ((c & 1) ? lonext : ~lonext) & 
+                  ((c & 2) ? hinext : ~hinext) & ~othernext;
+         cont   = e & ~((e >> 1) | (enext << 63)) & 
+                  ((e >> 2) | (enext << 62));
+         starts = e & ~((cont << 2) | (scan->cont[c] >> 62));
+         ends   = e & ~cont;
+         scan->cont[c] = cont;
+         events = starts | ends;
+
+         if(fast)
+         {
+            singles = starts & ends;
+            if(singles && (opts->minpat == 1) && (opts->maxpat >= 1))
+            {
+               hits[c*npat + 1].count += rpCountBits(singles);
+               if(opts->verbose)
+               {
+                  if(!AddHitSequence(&(hits[c*npat + 1]), scan->seqnum))
+                  {
+                     fprintf(stderr, 
+                             "No memory for matching sequences\n");
+                     exit(1);
+                  }
+                  scan->matched = TRUE;
+               }
+            }
+            events &= ~singles;
+         }
+
+         while(events)
+         {
+#ifdef __GNUC__
+            i = __builtin_ctzll(events);
+#else
+            for(i=0; !(events & ((uint64_t)1 << i)); i++);
+#endif
+            events &= events - 1;
+            if((starts >> i) & 1)
+               scan->runstart[c] = pos + i;
+            if((ends >> i) & 1)
+               CountDNARun(scan, c, scan->runstart[c], pos + i);
+         }
+      }
+   }
+
+   /* Keep the bases which have not been scanned                        */
+   if(!final)
+   {
+      n = (int)((scan->nbases - 64*nblocks + 63) / 64);
+      memmove(scan->lo,    scan->lo    + nblocks, n * sizeof(uint64_t));
+      memmove(scan->hi,    scan->hi    + nblocks, n * sizeof(uint64_t));
+      memmove(scan->other, scan->other + nblocks, n * sizeof(uint64_t));
+      scan->start  += 64*nblocks;
+      scan->nbases -= 64*nblocks;
+   }
+}
+
+/************************************************************************/
+/*>void CountDNARun(DNASCAN *scan, int base, uint64_t p, uint64_t q)
+   -----------------------------------------------------------------
+   I/O:     DNASCAN  *scan      Scan state
+   Input:   int      base       Index of the base in BASES
+            uint64_t p          Position of the first base of the run
+            uint64_t q          Position of the last base of the run
+
+   Counts the matches in a run as ScanSequenceForRuns() does. The run 
+   is not an exact match if it starts at position 1 and follows the
+   same base, or ends 2 from the end and is followed by the same base.
+
+   16.10.26  Original   By: ACRM
+*/
+void CountDNARun(DNASCAN *scan, int base, uint64_t p, uint64_t q)
+{
+   OPTIONS *opts = scan->opts;
+   PATHITS *hits = scan->result->hits;
+   int     npat  = opts->maxpat + 1,
+           m     = (int)((q - p) / 2 + 1),
+           n, top;
+   BOOL    isexact, 
+           hit   = FALSE;
+
+   isexact = !((p == 1) && (scan->first == base)) &&
+             !((q + 2 == scan->seqlen) && (scan->last == base));
+
+   if(opts->exact)
+   {
+      /* Only the whole run can match                                   */
+      if(isexact && (m >= opts->minpat) && (m <= opts->maxpat))
+      {
+         hits[base*npat + m].count++;
+         hit = TRUE;
+         n   = m;
+      }
+   }
+   else
+   {
+      top = (m < opts->maxpat) ? m : opts->maxpat;
+      for(n=opts->minpat; n<=top; n++)
+         hits[base*npat + n].count += (m - n + 1);
+      hit = (opts->minpat <= top);
+      n   = opts->minpat;
+   }
+
+   if(hit && opts->verbose)
+   {
+      for(top=(opts->exact ? m : top); n<=top; n++)
+      {
+         if(!AddHitSequence(&(hits[base*npat + n]), scan->seqnum))
+         {
+            fprintf(stderr, "No memory for matching sequences\n");
+            exit(1);
+         }
+      }
+      scan->matched = TRUE;
+   }
+}
+
+/************************************************************************/
+/*>BOOL NullModel(FASTAREADER *reader, OPTIONS *opts)
+   --------------------------------------------------
+   Input:   FASTAREADER *reader Input FASTA or corpus file
+            OPTIONS     *opts   Search options
+   Returns: BOOL                FALSE if the sequences could not be read
+
+   Compares the number of matches to each pattern with the number found
+   in opts->nnull shuffles of the sequences. Each shuffle keeps the 
+   composition of each sequence (or, with opts->nullcorpus, of the 
+   whole corpus with the lengths of the sequences unchanged) and is 
+   counted with the same kernel as the search. The shuffles are shared
+   among opts->nthreads threads. Each shuffle has its own random number
+   stream so the results do not depend on the number of threads.
+
+   16.10.26  Original   By: ACRM
+   17.10.26  Returns FALSE if LoadCorpus() fails
+*/
+BOOL NullModel(FASTAREADER *reader, OPTIONS *opts)
+{
+   NULLMODEL  model;
+   MATCHMASKS masks;
+   PATHITS    *hits;
+   pthread_t  *threads;
+   long       *observed;
+   int        nthreads, i;
+   BOOL       loaded;
+
+   if(opts->minpat < 1)
+      opts->minpat = 1;
+   if(opts->maxpat < opts->minpat)
+      opts->maxpat = opts->minpat - 1;
+
+   model.opts   = opts;
+   model.npat   = CountPatterns(opts);
+   model.next   = 0;
+   loaded       = (reader->corpus == NULL);
+   if((model.corpus = loaded ? LoadCorpus(reader) : reader->corpus) 
+      == NULL)
+   {
+      fprintf(stderr, "Unable to read sequences\n");
+      return(FALSE);
+   }
+   pthread_mutex_init(&(model.lock), NULL);
+
+   if(((model.counts = (long *)calloc((size_t)opts->nnull * model.npat,
+                                      sizeof(long))) == NULL) ||
+      ((observed = (long *)malloc(model.npat * sizeof(long))) == NULL) ||
+      ((hits = (PATHITS *)calloc(model.npat, sizeof(PATHITS))) == NULL))
+   {
+      fprintf(stderr, "No memory for null model\n");
+      exit(1);
+   }
+
+   /* The real sequences                                                */
+   memset(&masks, 0, sizeof(MATCHMASKS));
+   CountCorpus(model.corpus, model.corpus->residues, opts, hits, 
+               model.npat, &masks);
+   for(i=0; i<model.npat; i++)
+      observed[i] = hits[i].count;
+   rpFreeMatchMasks(&masks);
+   free(hits);
+
+   /* The shuffles                                                      */
+   nthreads = (opts->nthreads < opts->nnull) ? 
+              opts->nthreads : opts->nnull;
+   if((threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t)))
+      == NULL)
+   {
+      fprintf(stderr, "No memory for threads\n");
+      exit(1);
+   }
+   for(i=0; i<nthreads; i++)
+   {
+      if(pthread_create(&(threads[i]), NULL, NullWorker, &model))
+      {
+         fprintf(stderr, "Unable to create thread\n");
+         exit(1);
+      }
+   }
+   for(i=0; i<nthreads; i++)
+      pthread_join(threads[i], NULL);
+
+   ReportNullModel(&model, observed);
+
+   if(loaded)
+      FreeLoadedCorpus(model.corpus);
+   pthread_mutex_destroy(&(model.lock));
+   free(model.counts);
+   free(observed);
+   free(threads);
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>void *NullWorker(void *arg)
+   ---------------------------
+   Input:   void   *arg         The NULLMODEL
+   Returns: void   *            NULL
+
+   Thread which takes shuffles in turn. The residues are copied to a 
+   buffer for the thread, shuffled and counted. The random number 
+   stream for each shuffle is seeded from its number.
+
+   16.10.26  Original   By: ACRM
+*/
+void *NullWorker(void *arg)
+{
+   NULLMODEL  *model  = (NULLMODEL *)arg;
+   CORPUS     *corpus = model->corpus;
+   MATCHMASKS masks;
+   PATHITS    *hits;
+   char       *residues;
+   uint64_t   nresidues = corpus->seqoffsets[corpus->nseq],
+              state;
+   size_t     i;
+   int        shuffle, j;
+
+   if(((residues = (char *)malloc(nresidues ? nresidues : 1)) == NULL) ||
+      ((hits = (PATHITS *)calloc(model->npat, sizeof(PATHITS))) == NULL))
+   {
+      fprintf(stderr, "No memory for shuffled sequences\n");
+      exit(1);
+   }
+   memset(&masks, 0, sizeof(MATCHMASKS));
+
+   for(;;)
+   {
+      pthread_mutex_lock(&(model->lock));
+      shuffle = model->next++;
+      pthread_mutex_unlock(&(model->lock));
+      if(shuffle >= model->opts->nnull)
+         break;
+
+      /* SplitMix64 of the shuffle number gives a well mixed seed       */
+      state = NULLSEED + (uint64_t)(shuffle + 1) * 0x9e3779b97f4a7c15ULL;
+      state = (state ^ (state >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      state = (state ^ (state >> 27)) * 0x94d049bb133111ebULL;
+      state = (state ^ (state >> 31)) | 1;
+
+      if(nresidues)
+         memcpy(residues, corpus->residues, nresidues);
+      if(model->opts->nullcorpus)
+      {
+         ShuffleResidues(residues, nresidues, &state);
+      }
+      else
+      {
+         for(i=0; i<corpus->nseq; i++)
+            ShuffleResidues(residues + corpus->seqoffsets[i],
+                            corpus->seqoffsets[i+1] - 
+                            corpus->seqoffsets[i], &state);
+      }
+
+      CountCorpus(corpus, residues, model->opts, hits, model->npat, 
+                  &masks);
+      for(j=0; j<model->npat; j++)
+         model->counts[(size_t)shuffle * model->npat + j] = hits[j].count;
+   }
+
+   rpFreeMatchMasks(&masks);
+   free(residues);
+   free(hits);
+   return(NULL);
+}
+
+/************************************************************************/
+/*>void CountCorpus(CORPUS *corpus, char *residues, OPTIONS *opts, 
+                    PATHITS *hits, int npat, MATCHMASKS *masks)
+   ----------------------------------------------------------------
+   Input:   CORPUS     *corpus   Sequence offsets
+            char       *residues Residues to search (laid out as in
+                                 corpus->residues)
+            OPTIONS    *opts     Search options
+   Output:  PATHITS    *hits     Count for each pattern
+   Input:   int        npat      Number of patterns
+   I/O:     MATCHMASKS *masks    Work space for the bitmask kernel
+
+   Counts the matches to the patterns in every sequence with the same
+   kernels as SearchRecords()
+
+   16.10.26  Original   By: ACRM
+*/
+void CountCorpus(CORPUS *corpus, char *residues, OPTIONS *opts, 
+                 PATHITS *hits, int npat, MATCHMASKS *masks)
+{
+   char   *sequence;
+   size_t i;
+   int    seqlen, j;
+
+   for(j=0; j<npat; j++)
+      hits[j].count = 0;
+   
+   for(i=0; i<corpus->nseq; i++)
+   {
+      sequence = residues + corpus->seqoffsets[i];
+      seqlen   = (int)(corpus->seqoffsets[i+1] - corpus->seqoffsets[i]);
+
+      if(opts->patset != NULL)
+      {
+         ScanSequenceForPatternSet(sequence, seqlen, (int)i, 
+                                   opts->patset, opts->exact, hits, 
+                                   NULL, masks, NULL);
+      }
+      else if(opts->pattern[0])
+      {
+         ScanSequenceForPattern(sequence, seqlen, (int)i, opts->pattern,
+                                opts->periodic, opts->exact, hits, NULL,
+                                masks, NULL);
+      }
+      else
+      {
+         ScanSequenceForRuns(sequence, seqlen, (int)i, opts->exact, 
+                             opts->minpat, opts->maxpat, hits, NULL, 
+                             NULL);
+      }
+   }
+}
+
+/************************************************************************/
+/*>void ShuffleResidues(char *residues, size_t len, uint64_t *state)
+   -----------------------------------------------------------------
+   I/O:     char     *residues  Residues to shuffle in place
+   Input:   size_t   len        Number of residues
+   I/O:     uint64_t *state     Random number state
+
+   Fisher-Yates shuffle. A random number below i+1 is taken from the 
+   top 32 bits by a multiply rather than a division when it fits.
+
+   16.10.26  Original   By: ACRM
+*/
+void ShuffleResidues(char *residues, size_t len, uint64_t *state)
+{
+   size_t i, j;
+   char   tmp;
+
+   for(i=len; i>1; i--)
+   {
+      if(i <= UINT32_MAX)
+         j = (size_t)(((NextRandom(state) >> 32) * (uint64_t)i) >> 32);
+      else
+         j = (size_t)(NextRandom(state) % i);
+      tmp           = residues[i-1];
+      residues[i-1] = residues[j];
+      residues[j]   = tmp;
+   }
+}
+
+/************************************************************************/
+/*>uint64_t NextRandom(uint64_t *state)
+   ------------------------------------
+   I/O:     uint64_t *state     Random number state (not zero)
+   Returns: uint64_t            Next random number
+
+   xorshift64* generator as in genproteome
+
+   16.10.26  Original   By: ACRM
+*/
+uint64_t NextRandom(uint64_t *state)
+{
+   *state ^= *state >> 12;
+   *state ^= *state << 25;
+   *state ^= *state >> 27;
+   return(*state * 0x2545F4914F6CDD1DULL);
+}
+
+/************************************************************************/
+/*>void ReportNullModel(NULLMODEL *model, long *observed)
+   ------------------------------------------------------
+   Input:   NULLMODEL *model    Counts from each shuffle
+            long      *observed Counts in the real sequences
+
+   Writes a line for each pattern with the observed count, the mean and
+   standard deviation of the count in the shuffles, the z-score and
+   the empirical p-value for a count at least as high as that observed,
+   (1 + shuffles with at least as many) / (1 + shuffles). The z-score 
+   is given as - if every shuffle gave the same count.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Patterns named by PatternName()
+*/
+void ReportNullModel(NULLMODEL *model, long *observed)
+{
+   OPTIONS *opts   = model->opts;
+   char    pat[MAXPATLEN];
+   double  sum, sumsq, mean, sd;
+   long    count;
+   int     nnull = opts->nnull,
+           p, i, ge;
+
+   fprintf(stdout, "Pattern\tObserved\tExpected\tSD\tZ\tP\n");
+   for(p=0; p<model->npat; p++)
+   {
+      if(!PatternName(opts, p, pat))
+         continue;
+
+      sum = sumsq = 0.0;
+      for(i=0, ge=0; i<nnull; i++)
+      {
+         count  = model->counts[(size_t)i * model->npat + p];
+         sum   += (double)count;
+         sumsq += (double)count * (double)count;
+         if(count >= observed[p])
+            ge++;
+      }
+      mean = sum / nnull;
+      sd   = (nnull > 1) ? (sumsq - sum * mean) / (nnull - 1) : 0.0;
+      sd   = (sd > 0.0) ? sqrt(sd) : 0.0;
+
+      fprintf(stdout, "%s\t%ld\t%.3f\t%.3f\t", pat, observed[p], mean, 
+              sd);
+      if(sd > 0.0)
+         fprintf(stdout, "%.3f", ((double)observed[p] - mean) / sd);
+      else
+         fprintf(stdout, "-");
+      fprintf(stdout, "\t%.4g\n", (double)(1 + ge) / (double)(1 + nnull));
+   }
+   fflush(stdout);
+}
+
+/************************************************************************/
+/*>BOOL PatternName(OPTIONS *opts, int p, char *pat)
+   -------------------------------------------------
+   Input:   OPTIONS *opts       Search options
+            int     p           Index of a pattern in the PATHITS 
+   Output:  char    *pat        The pattern (MAXPATLEN characters)
+   Returns: BOOL                FALSE if the pattern is not reported
+                                (fewer than minpat residues)
+
+   Gives the name of a pattern counted by CountCorpus() or 
+   CountOrganism()
+
+   16.10.26  Original (from ReportNullModel())   By: ACRM
+*/
+BOOL PatternName(OPTIONS *opts, int p, char *pat)
+{
+   int j, k, n;
+   
+   if(opts->patset != NULL)
+   {
+      strcpy(pat, opts->patset->patterns[p]);
+   }
+   else if(opts->pattern[0])
+   {
+      strcpy(pat, opts->pattern);
+   }
+   else
+   {
+      /* Pattern p is cXcX...c with n occurrences of residue j          */
+      j = p / (opts->maxpat + 1);
+      n = p % (opts->maxpat + 1);
+      if((n < opts->minpat) || (2*n >= MAXPATLEN))
+         return(FALSE);
+      for(k=0; k<n; k++)
+      {
+         pat[k*2]   = RESIDUES[j];
+         pat[k*2+1] = 'X';
+      }
+      pat[n*2-1] = '\0';
+   }
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>BOOL CompareOrganisms(OPTIONS *opts)
+   ------------------------------------
+   Input:   OPTIONS *opts       Search options and the files from 
+                                --organisms
+   Returns: BOOL                Were all the files read?
+
+   Counts the patterns in many files, typically one proteome per file, 
+   in a single process and writes one matrix with a row for each file.
+   A directory stands for every file in it. 
+
+   The files are shared out as jobs from one queue among a pool of 
+   opts->nthreads threads, so no more than that many files are open 
+   and being read at once. The largest files are taken first so that 
+   the threads finish together, and files smaller than ORGBATCH are 
+   grouped into jobs of about ORGBATCH bytes so that the queue is not 
+   visited for every small file.
+
+   16.10.26  Original   By: ACRM
+   17.10.26  Files which would have the same organism name are named by
+             their paths
+*/
+BOOL CompareOrganisms(OPTIONS *opts)
+{
+   ORGSEARCH search;
+   PERIODIC  periodic;
+   pthread_t *threads;
+   struct stat st;
+   off_t     bytes;
+   int       nthreads, i;
+   BOOL      ok = TRUE;
+
+   InitResidueIndex();
+   if(!PreparePatterns(opts, &periodic))
+      return(FALSE);
+   if(opts->minpat < 1)
+      opts->minpat = 1;
+   if(opts->maxpat < opts->minpat)
+      opts->maxpat = opts->minpat - 1;
+
+   memset(&search, 0, sizeof(ORGSEARCH));
+   search.opts = opts;
+   search.npat = CountPatterns(opts);
+   pthread_mutex_init(&(search.lock), NULL);
+
+   for(i=0; i<opts->norgfiles; i++)
+   {
+      if(stat(opts->orgfiles[i], &st))
+      {
+         fprintf(stderr, "Unable to open input file: %s\n", 
+                 opts->orgfiles[i]);
+         return(FALSE);
+      }
+      if(S_ISDIR(st.st_mode) ? !AddOrganismDir(&search, opts->orgfiles[i])
+                             : !AddOrganism(&search, opts->orgfiles[i]))
+      {
+         fprintf(stderr, "Unable to read directory: %s\n", 
+                 opts->orgfiles[i]);
+         return(FALSE);
+      }
+   }
+   if(!search.norganisms)
+   {
+      fprintf(stderr, "No input files\n");
+      return(FALSE);
+   }
+   if(!NameOrganisms(&search))
+      return(FALSE);
+
+   if(((search.bysize = (ORGANISM **)malloc(search.norganisms * 
+                                            sizeof(ORGANISM *))) 
+       == NULL) ||
+      ((search.jobs = (int *)malloc((search.norganisms + 1) * 
+                                    sizeof(int))) == NULL))
+   {
+      fprintf(stderr, "No memory for input files\n");
+      exit(1);
+   }
+   for(i=0; i<search.norganisms; i++)
+   {
+      if((search.organisms[i].counts = (long *)calloc(search.npat, 
+                                                      sizeof(long))) 
+         == NULL)
+      {
+         fprintf(stderr, "No memory for counts\n");
+         exit(1);
+      }
+      search.bysize[i] = &(search.organisms[i]);
+   }
+   qsort(search.bysize, search.norganisms, sizeof(ORGANISM *), 
+         CompareOrganismSizes);
+
+   /* Each job ends once it has ORGBATCH bytes, so large files have a
+      job to themselves
+   */
+   search.jobs[0] = 0;
+   for(i=0, bytes=0; i<search.norganisms; i++)
+   {
+      bytes += search.bysize[i]->size;
+      if((bytes >= ORGBATCH) || (i == search.norganisms-1))
+      {
+         search.jobs[++search.njobs] = i+1;
+         bytes = 0;
+      }
+   }
+
+   nthreads = (opts->nthreads < search.njobs) ? 
+              opts->nthreads : search.njobs;
+   if((threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t)))
+      == NULL)
+   {
+      fprintf(stderr, "No memory for threads\n");
+      exit(1);
+   }
+   for(i=0; i<nthreads; i++)
+   {
+      if(pthread_create(&(threads[i]), NULL, OrganismWorker, &search))
+      {
+         fprintf(stderr, "Unable to create thread\n");
+         exit(1);
+      }
+   }
+   for(i=0; i<nthreads; i++)
+      pthread_join(threads[i], NULL);
+
+   for(i=0; i<search.norganisms; i++)
+   {
+      if(!search.organisms[i].ok)
+      {
+         fprintf(stderr, "Unable to read input file: %s\n",
+                 search.organisms[i].filename);
+         ok = FALSE;
+      }
+   }
+   if(ok)
+      ReportOrganisms(&search);
+
+   for(i=0; i<search.norganisms; i++)
+   {
+      free(search.organisms[i].filename);
+      free(search.organisms[i].counts);
+   }
+   if(opts->patset != NULL)
+      FreePatternSet(opts->patset);
+   pthread_mutex_destroy(&(search.lock));
+   free(search.organisms);
+   free(search.bysize);
+   free(search.jobs);
+   free(threads);
+   return(ok);
+}
+
+/************************************************************************/
+/*>BOOL AddOrganism(ORGSEARCH *search, char *filename)
+   ---------------------------------------------------
+   I/O:     ORGSEARCH *search   The search
+   Input:   char      *filename Input file
+   Returns: BOOL                FALSE if the file could not be found
+
+   Adds a file to the search. The organism is named from the file name
+   without the directory, any .gz or .zst and the extension. See 
+   NameOrganisms() for names which are not unique.
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL AddOrganism(ORGSEARCH *search, char *filename)
+{
+   ORGANISM    *org;
+   struct stat st;
+   char        *name, *ext;
+   int         len;
+
+   if(stat(filename, &st))
+      return(FALSE);
+   
+   if(search->norganisms >= search->maxorganisms)
+   {
+      search->maxorganisms = search->maxorganisms ? 
+                             2 * search->maxorganisms : 64;
+      if((search->organisms = 
+          (ORGANISM *)realloc(search->organisms, search->maxorganisms * 
+                              sizeof(ORGANISM))) == NULL)
+      {
+         fprintf(stderr, "No memory for input files\n");
+         exit(1);
+      }
+   }
+   org = &(search->organisms[search->norganisms++]);
+   memset(org, 0, sizeof(ORGANISM));
+   org->size = st.st_size;
+   if((org->filename = strdup(filename)) == NULL)
+   {
+      fprintf(stderr, "No memory for input files\n");
+      exit(1);
+   }
+
+   name = ((name = strrchr(filename, '/')) != NULL) ? name+1 : filename;
+   strncpy(org->name, name, MAXBUFF);
+   org->name[MAXBUFF-1] = '\0';
+   len = strlen(org->name);
+   if((len > 3) && !strcmp(org->name+len-3, ".gz"))
+      org->name[len-3] = '\0';
+   else if((len > 4) && !strcmp(org->name+len-4, ".zst"))
+      org->name[len-4] = '\0';
+   if(((ext = strrchr(org->name, '.')) != NULL) && (ext != org->name))
+      *ext = '\0';
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>BOOL AddOrganismDir(ORGSEARCH *search, char *dirname)
+   -----------------------------------------------------
+   I/O:     ORGSEARCH *search   The search
+   Input:   char      *dirname  Directory of input files
+   Returns: BOOL                FALSE if the directory could not be read
+
+   Adds every regular file in a directory, in order of name. Hidden 
+   files and subdirectories are skipped.
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL AddOrganismDir(ORGSEARCH *search, char *dirname)
+{
+   DIR           *dir;
+   struct dirent *ent;
+   struct stat   st;
+   char          **names = NULL,
+                 path[MAXBUFF];
+   int           nnames  = 0,
+                 maxnames = 0,
+                 i;
+   BOOL          ok = TRUE;
+
+   if((dir = opendir(dirname)) == NULL)
+      return(FALSE);
+
+   while((ent = readdir(dir)) != NULL)
+   {
+      if(ent->d_name[0] == '.')
+         continue;
+      if(nnames >= maxnames)
+      {
+         maxnames = maxnames ? 2*maxnames : 64;
+         if((names = (char **)realloc(names, maxnames * sizeof(char *)))
+            == NULL)
+         {
+            fprintf(stderr, "No memory for input files\n");
+            exit(1);
+         }
+      }
+      if((names[nnames++] = strdup(ent->d_name)) == NULL)
+      {
+         fprintf(stderr, "No memory for input files\n");
+         exit(1);
+      }
+   }
+   closedir(dir);
+
+   if(nnames)
+      qsort(names, nnames, sizeof(char *), CompareNames);
+   for(i=0; i<nnames; i++)
+   {
+      if(snprintf(path, MAXBUFF, "%s/%s", dirname, names[i]) >= MAXBUFF)
+         ok = FALSE;
+      else if(!stat(path, &st) && S_ISREG(st.st_mode))
+         ok = ok && AddOrganism(search, path);
+      free(names[i]);
+   }
+   free(names);
+   return(ok);
+}
+
+/************************************************************************/
+/*>int CompareNames(const void *a, const void *b)
+   ----------------------------------------------
+   Input:   void   *a           Pointer to a string
+            void   *b           Pointer to a string
+   Returns: int                 Comparison of the strings for qsort()
+
+   16.10.26  Original   By: ACRM
+*/
+int CompareNames(const void *a, const void *b)
+{
+   return(strcmp(*(char * const *)a, *(char * const *)b));
+}
+
+/************************************************************************/
+/*>int CompareOrganismSizes(const void *a, const void *b)
+   ------------------------------------------------------
+   Input:   void   *a           Pointer to an ORGANISM pointer
+            void   *b           Pointer to an ORGANISM pointer
+   Returns: int                 Order for qsort()
+
+   Orders files from the largest to the smallest, and otherwise in the 
+   order given
+
+   16.10.26  Original   By: ACRM
+*/
+int CompareOrganismSizes(const void *a, const void *b)
+{
+   ORGANISM *orga = *(ORGANISM * const *)a,
+            *orgb = *(ORGANISM * const *)b;
+
+   if(orga->size != orgb->size)
+      return((orga->size > orgb->size) ? (-1) : 1);
+   return((orga < orgb) ? (-1) : (orga > orgb));
+}
+
+/************************************************************************/
+/*>BOOL NameOrganisms(ORGSEARCH *search)
+   -------------------------------------
+   I/O:     ORGSEARCH *search   The search
+   Returns: BOOL                FALSE if the names are still not 
+                                unique (e.g. a file is given twice)
+
+   Organisms which have the same name from AddOrganism(), such as
+   a/x.faa and b/x.faa or x.faa and x.faa.gz, are named by the path 
+   given instead so that each row of the matrix can be told apart.
+
+   17.10.26  Original   By: ACRM
+*/
+BOOL NameOrganisms(ORGSEARCH *search)
+{
+   ORGANISM **byname;
+   int      i, j, pass;
+   BOOL     renamed = FALSE;
+
+   if((byname = (ORGANISM **)malloc(search->norganisms * 
+                                    sizeof(ORGANISM *))) == NULL)
+   {
+      fprintf(stderr, "No memory for input files\n");
+      exit(1);
+   }
+   for(i=0; i<search->norganisms; i++)
+      byname[i] = &(search->organisms[i]);
+
+   /* After the first pass, a duplicate is normally the same path given
+      twice
+   */
+   for(pass=0; pass<2; pass++)
+   {
+      qsort(byname, search->norganisms, sizeof(ORGANISM *), 
+            CompareOrganismNames);
+      for(i=0; i<search->norganisms; i=j)
+      {
+         for(j=i+1; (j<search->norganisms) && 
+                    !strcmp(byname[i]->name, byname[j]->name); j++);
+         if(j == i+1)
+            continue;
+
+         if(pass)
+         {
+            fprintf(stderr, "Input files have the same name: %s\n",
+                    byname[i]->name);
+            free(byname);
+            return(FALSE);
+         }
+         for(; i<j; i++)
+         {
+            strncpy(byname[i]->name, byname[i]->filename, MAXBUFF-1);
+            byname[i]->name[MAXBUFF-1] = '\0';
+         }
+         renamed = TRUE;
+      }
+      if(!renamed)
+         break;
+   }
+
+   free(byname);
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>int CompareOrganismNames(const void *a, const void *b)
+   ------------------------------------------------------
+   Input:   void   *a           Pointer to an ORGANISM pointer
+            void   *b           Pointer to an ORGANISM pointer
+   Returns: int                 Comparison of the names for qsort()
+
+   17.10.26  Original   By: ACRM
+*/
+int CompareOrganismNames(const void *a, const void *b)
+{
+   return(strcmp((*(ORGANISM * const *)a)->name, 
+                 (*(ORGANISM * const *)b)->name));
+}
+
+/************************************************************************/
+/*>void *OrganismWorker(void *arg)
+   -------------------------------
+   Input:   void   *arg         The ORGSEARCH
+   Returns: void   *            NULL
+
+   Thread which takes jobs in turn from the queue and counts the 
+   patterns in each file of the job
+
+   16.10.26  Original   By: ACRM
+*/
+void *OrganismWorker(void *arg)
+{
+   ORGSEARCH  *search = (ORGSEARCH *)arg;
+   OPTIONS    *opts   = search->opts;
+   MATCHMASKS masks;
+   PATHITS    *hits;
+   int        job, i, ndone;
+
+   memset(&masks, 0, sizeof(MATCHMASKS));
+   if((hits = (PATHITS *)calloc(search->npat, sizeof(PATHITS))) == NULL)
+   {
+      fprintf(stderr, "No memory for counts\n");
+      exit(1);
+   }
+
+   for(;;)
+   {
+      pthread_mutex_lock(&(search->lock));
+      job = search->next++;
+      pthread_mutex_unlock(&(search->lock));
+      if(job >= search->njobs)
+         break;
+
+      for(i=search->jobs[job]; i<search->jobs[job+1]; i++)
+      {
+         search->bysize[i]->ok = CountOrganism(search->bysize[i], opts,
+                                               hits, &masks);
+
+         pthread_mutex_lock(&(search->lock));
+         ndone = ++(search->ndone);
+         pthread_mutex_unlock(&(search->lock));
+         if(!opts->quiet && (!(ndone % 100) || 
+                             (ndone == search->norganisms)))
+         {
+            fprintf(stderr, "Processed %d of %d files\n", ndone, 
+                    search->norganisms);
+            fflush(stderr);
+         }
+      }
+   }
+
+   rpFreeMatchMasks(&masks);
+   free(hits);
+   return(NULL);
+}
+
+/************************************************************************/
+/*>BOOL CountOrganism(ORGANISM *org, OPTIONS *opts, PATHITS *hits, 
+                      MATCHMASKS *masks)
+   ----------------------------------------------------------------
+   I/O:     ORGANISM   *org     The file. The counts, sequences and 
+                                residues are filled in
+   Input:   OPTIONS    *opts    Search options
+   I/O:     PATHITS    *hits    Work space for the counts
+            MATCHMASKS *masks   Work space for the bitmask kernel
+   Returns: BOOL                Was the file read?
+
+   Counts the patterns in one file with the same kernels as 
+   SearchRecords()
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL CountOrganism(ORGANISM *org, OPTIONS *opts, PATHITS *hits, 
+                   MATCHMASKS *masks)
+{
+   FASTAREADER *reader;
+   FASTAREC    rec;
+   FILE        *in;
+   BOOL        piped, 
+               ok = TRUE;
+   int         j,
+               npat = CountPatterns(opts);
+
+   if((in = OpenInputFile(org->filename, &piped)) == NULL)
+      return(FALSE);
+   if((reader = OpenFASTAReader(in)) == NULL)
+   {
+      if(piped)
+         pclose(in);
+      else
+         fclose(in);
+      return(FALSE);
+   }
+   
+   for(j=0; j<npat; j++)
+      hits[j].count = 0;
+
+   while(ReadFASTARecord(reader, &rec))
+   {
+      org->nseq++;
+      org->residues += rec.seqlen;
+
+      if(opts->patset != NULL)
+      {
+         ScanSequenceForPatternSet(rec.sequence, rec.seqlen, 0, 
+                                   opts->patset, opts->exact, hits, 
+                                   NULL, masks, NULL);
+      }
+      else if(opts->pattern[0])
+      {
+         ScanSequenceForPattern(rec.sequence, rec.seqlen, 0, 
+                                opts->pattern, opts->periodic, 
+                                opts->exact, hits, NULL, masks, NULL);
+      }
+      else
+      {
+         ScanSequenceForRuns(rec.sequence, rec.seqlen, 0, opts->exact, 
+                             opts->minpat, opts->maxpat, hits, NULL, 
+                             NULL);
+      }
+   }
+
+   for(j=0; j<npat; j++)
+      org->counts[j] = hits[j].count;
+
+   CloseFASTAReader(reader);
+   if(piped)
+      ok = !pclose(in);
+   else
+      fclose(in);
+   return(ok);
+}
+
+/************************************************************************/
+/*>void ReportOrganisms(ORGSEARCH *search)
+   ---------------------------------------
+   Input:   ORGSEARCH *search   The completed search
+
+   Writes a tab separated matrix with a row for each file, in the order
+   given, and a column for each pattern. Each file has its number of 
+   sequences and residues followed by the number of matches to each 
+   pattern per million residues, so that proteomes of different sizes 
+   may be compared.
+
+   16.10.26  Original   By: ACRM
+*/
+void ReportOrganisms(ORGSEARCH *search)
+{
+   ORGANISM *org;
+   char     pat[MAXPATLEN];
+   int      i, p;
+
+   fprintf(stdout, "Organism\tSequences\tResidues");
+   for(p=0; p<search->npat; p++)
+   {
+      if(PatternName(search->opts, p, pat))
+         fprintf(stdout, "\t%s", pat);
+   }
+   fprintf(stdout, "\n");
+
+   for(i=0; i<search->norganisms; i++)
+   {
+      org = &(search->organisms[i]);
+      fprintf(stdout, "%s\t%ld\t%llu", org->name, org->nseq, 
+              (unsigned long long)org->residues);
+      for(p=0; p<search->npat; p++)
+      {
+         if(PatternName(search->opts, p, pat))
+         {
+            fprintf(stdout, "\t%.3f", 
+                    org->residues ? 
+                    1.0e6 * org->counts[p] / (double)org->residues : 0.0);
+         }
+      }
+      fprintf(stdout, "\n");
+   }
+   fflush(stdout);
+}
+
+/************************************************************************/
+/*>BOOL RunServer(FASTAREADER *reader, OPTIONS *opts)
+   --------------------------------------------------
+   Input:   FASTAREADER *reader Input FASTA or corpus file
+            OPTIONS     *opts   Options (socket file, threads, quiet)
+   Returns: BOOL                FALSE if the server could not be started
+
+   Loads the sequences once and answers queries on a Unix socket until
+   the program is stopped with SIGINT or SIGTERM. A binary corpus is 
+   used directly from the mapped file; a FASTA file is loaded into a 
+   corpus in memory. The run length distribution is found while loading
+   so that histogram queries need no search. Each connection is served
+   by one of a pool of opts->nthreads threads. See ServeConnection() 
+   for the protocol.
+   Anything other than a socket already at the socket path is left 
+   alone and the server is not started.
+
+   16.10.26  Original   By: ACRM
+   17.10.26  Only removes an existing socket, not any other file
+   17.10.26  Stops on SIGINT or SIGTERM, closing the connections and 
+             removing the socket. Waits rather than spinning if 
+             connections can't be accepted
+   17.10.26  Returns FALSE if LoadCorpus() fails
+*/
+BOOL RunServer(FASTAREADER *reader, OPTIONS *opts)
+{
+   SERVER             server;
+   struct sockaddr_un addr;
+   pthread_t          *threads;
+   struct stat        st;
+   struct pollfd      pfd;
+   double             start = GetTime();
+   int                listenfd, fd, i, maxima[NRESIDUES];
+   BOOL               loaded;
+
+   if(strlen(opts->socketfile) >= sizeof(addr.sun_path))
+   {
+      fprintf(stderr, "Socket name is too long: %s\n", opts->socketfile);
+      return(FALSE);
+   }
+   if(!lstat(opts->socketfile, &st) && !S_ISSOCK(st.st_mode))
+   {
+      fprintf(stderr, "%s exists and is not a socket\n", 
+              opts->socketfile);
+      return(FALSE);
+   }
+
+   memset(&server, 0, sizeof(SERVER));
+   server.quiet = opts->quiet;
+   loaded       = (reader->corpus == NULL);
+   if((server.corpus = loaded ? LoadCorpus(reader) : reader->corpus) 
+      == NULL)
+   {
+      fprintf(stderr, "Unable to read sequences\n");
+      return(FALSE);
+   }
+   for(i=0; i<(int)server.corpus->nseq; i++)
+   {
+      ScanSequenceHistogram(server.corpus->residues + 
+                            server.corpus->seqoffsets[i],
+                            (int)(server.corpus->seqoffsets[i+1] - 
+                                  server.corpus->seqoffsets[i]),
+                            TRUE, &(server.hist), maxima);
+   }
+
+   /* A client closing its connection must not kill the server          */
+   signal(SIGPIPE, SIG_IGN);
+   signal(SIGINT,  StopServer);
+   signal(SIGTERM, StopServer);
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, opts->socketfile);
+
+   /* A socket left by a server that was killed                         */
+   if(!lstat(opts->socketfile, &st) && S_ISSOCK(st.st_mode))
+      unlink(opts->socketfile);
+   if(((listenfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) ||
+      bind(listenfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(listenfd, SOMAXCONN))
+   {
+      fprintf(stderr, "Unable to listen on socket %s\n", 
+              opts->socketfile);
+      if(loaded)
+         FreeLoadedCorpus(server.corpus);
+      FreeHistogram(&(server.hist));
+      return(FALSE);
+   }
+
+   pthread_mutex_init(&(server.lock), NULL);
+   pthread_cond_init(&(server.ready), NULL);
+   pthread_cond_init(&(server.space), NULL);
+   server.nthreads = opts->nthreads;
+   if(((threads = (pthread_t *)malloc(opts->nthreads * sizeof(pthread_t)))
+       == NULL) ||
+      ((server.active = (int *)malloc(opts->nthreads * sizeof(int))) 
+       == NULL))
+   {
+      fprintf(stderr, "No memory for threads\n");
+      exit(1);
+   }
+   for(i=0; i<opts->nthreads; i++)
+      server.active[i] = (-1);
+   for(i=0; i<opts->nthreads; i++)
+   {
+      if(pthread_create(&(threads[i]), NULL, ServerThread, &server))
+      {
+         fprintf(stderr, "Unable to create thread\n");
+         exit(1);
+      }
+   }
+
+   if(!opts->quiet)
+   {
+      fprintf(stderr, "Serving %lu sequences on %s (loaded in %.2fs)\n",
+              (unsigned long)server.corpus->nseq, opts->socketfile, 
+              GetTime() - start);
+      fflush(stderr);
+   }
+
+   /* Hand each connection to the pool. The socket is polled with a 
+      timeout so that a stop signal is seen even with no connections
+   */
+   pfd.fd     = listenfd;
+   pfd.events = POLLIN;
+   while(!gStopServer)
+   {
+      if(poll(&pfd, 1, STOPCHECK) <= 0)
+         continue;
+      if((fd = accept(listenfd, NULL, NULL)) < 0)
+      {
+         if((errno == EMFILE) || (errno == ENFILE) || 
+            (errno == ENOBUFS) || (errno == ENOMEM))
+         {
+            /* Wait for connections to close                            */
+            fprintf(stderr, "Unable to accept connection: %s\n",
+                    strerror(errno));
+            sleep(1);
+         }
+         continue;
+      }
+      
+      pthread_mutex_lock(&(server.lock));
+      while(server.count == MAXQUEUE)
+         pthread_cond_wait(&(server.space), &(server.lock));
+      server.queue[(server.head + server.count) % MAXQUEUE] = fd;
+      server.count++;
+      pthread_cond_signal(&(server.ready));
+      pthread_mutex_unlock(&(server.lock));
+   }
+
+   /* Close the connections waiting and being served so every thread 
+      finishes
+   */
+   close(listenfd);
+   pthread_mutex_lock(&(server.lock));
+   server.stop = TRUE;
+   for(; server.count; server.count--)
+   {
+      close(server.queue[server.head]);
+      server.head = (server.head + 1) % MAXQUEUE;
+   }
+   for(i=0; i<opts->nthreads; i++)
+   {
+      if(server.active[i] >= 0)
+         shutdown(server.active[i], SHUT_RDWR);
+   }
+   pthread_cond_broadcast(&(server.ready));
+   pthread_mutex_unlock(&(server.lock));
+
+   for(i=0; i<opts->nthreads; i++)
+      pthread_join(threads[i], NULL);
+   unlink(opts->socketfile);
+   if(!opts->quiet)
+   {
+      fprintf(stderr, "Stopped serving on %s\n", opts->socketfile);
+      fflush(stderr);
+   }
+
+   pthread_mutex_destroy(&(server.lock));
+   pthread_cond_destroy(&(server.ready));
+   pthread_cond_destroy(&(server.space));
+   if(loaded)
+      FreeLoadedCorpus(server.corpus);
+   FreeHistogram(&(server.hist));
+   free(server.active);
+   free(threads);
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>void StopServer(int sig)
+   ------------------------
+   Input:   int    sig          Signal number
+
+   Signal handler which tells RunServer() to stop
+
+   17.10.26  Original   By: ACRM
+*/
+void StopServer(int sig)
+{
+   gStopServer = 1;
+}
+
+/************************************************************************/
+/*>CORPUS *LoadCorpus(FASTAREADER *reader)
+   ---------------------------------------
+   Input:   FASTAREADER *reader FASTA reader
+   Returns: CORPUS *            The sequences and labels in memory 
+                                (NULL if the file could not be read)
+
+   Reads a FASTA file into a corpus in memory laid out as in a corpus
+   file written by BuildCorpus(). Exits if out of memory.
+
+   16.10.26  Original   By: ACRM
+   17.10.26  Returns NULL on a read error
+*/
+CORPUS *LoadCorpus(FASTAREADER *reader)
+{
+   CORPUS   *corpus;
+   FASTAREC rec;
+   ARENA    residues, labels, seqoffsets, labeloffsets;
+   uint64_t offset;
+
+   if((corpus = (CORPUS *)calloc(1, sizeof(CORPUS))) == NULL)
+   {
+      fprintf(stderr, "No memory for sequences\n");
+      exit(1);
+   }
+   memset(&residues,     0, sizeof(ARENA));
+   memset(&labels,       0, sizeof(ARENA));
+   memset(&seqoffsets,   0, sizeof(ARENA));
+   memset(&labeloffsets, 0, sizeof(ARENA));
+
+   while(ReadFASTARecord(reader, &rec))
+   {
+      offset = residues.used;
+      ArenaAppend(&seqoffsets, (char *)&offset, sizeof(uint64_t));
+      offset = labels.used;
+      ArenaAppend(&labeloffsets, (char *)&offset, sizeof(uint64_t));
+      ArenaAppend(&residues, rec.sequence, rec.seqlen);
+      ArenaAppend(&labels, rec.label, rec.labellen);
+      ArenaAppend(&labels, "", 1);
+      corpus->nseq++;
+   }
+   if(ReaderError(reader))
+   {
+      ArenaFree(&residues);
+      ArenaFree(&labels);
+      ArenaFree(&seqoffsets);
+      ArenaFree(&labeloffsets);
+      free(corpus);
+      return(NULL);
+   }
+   offset = residues.used;
+   ArenaAppend(&seqoffsets, (char *)&offset, sizeof(uint64_t));
+   offset = labels.used;
+   ArenaAppend(&labeloffsets, (char *)&offset, sizeof(uint64_t));
+
+   corpus->residues     = residues.data;
+   corpus->labels       = labels.data;
+   corpus->seqoffsets   = (uint64_t *)seqoffsets.data;
+   corpus->labeloffsets = (uint64_t *)labeloffsets.data;
+   return(corpus);
+}
+
+/************************************************************************/
+/*>void FreeLoadedCorpus(CORPUS *corpus)
+   -------------------------------------
+   I/O:     CORPUS *corpus      Corpus from LoadCorpus()
+
+   16.10.26  Original   By: ACRM
+*/
+void FreeLoadedCorpus(CORPUS *corpus)
+{
+   free(corpus->residues);
+   free(corpus->labels);
+   free(corpus->seqoffsets);
+   free(corpus->labeloffsets);
+   free(corpus);
+}
+
+/************************************************************************/
+/*>void *ServerThread(void *arg)
+   -----------------------------
+   Input:   void   *arg         The SERVER
+   Returns: void   *            NULL once the server is stopping
+
+   Pool thread which serves connections from the queue. The connection
+   being served is recorded in server->active so that RunServer() can 
+   close it when stopping.
+
+   16.10.26  Original   By: ACRM
+   17.10.26  Returns when server->stop is set
+*/
+void *ServerThread(void *arg)
+{
+   SERVER *server = (SERVER *)arg;
+   int    fd, slot;
+
+   for(;;)
+   {
+      pthread_mutex_lock(&(server->lock));
+      while((server->count == 0) && !server->stop)
+         pthread_cond_wait(&(server->ready), &(server->lock));
+      if(server->stop)
+      {
+         pthread_mutex_unlock(&(server->lock));
+         return(NULL);
+      }
+      fd = server->queue[server->head];
+      server->head = (server->head + 1) % MAXQUEUE;
+      server->count--;
+      for(slot=0; server->active[slot] >= 0; slot++);
+      server->active[slot] = fd;
+      pthread_cond_signal(&(server->space));
+      pthread_mutex_unlock(&(server->lock));
+
+      ServeConnection(server, fd);
+
+      pthread_mutex_lock(&(server->lock));
+      server->active[slot] = (-1);
+      pthread_mutex_unlock(&(server->lock));
+   }
+   return(NULL);
+}
+
+/************************************************************************/
+/*>void ServeConnection(SERVER *server, int fd)
+   --------------------------------------------
+   Input:   SERVER *server      The server
+            int    fd           Connected socket (closed on return)
+
+   Answers queries from one client, one per line:
+
+      PATTERN [-x] [-v] pattern   Matches to a pattern as with -s
+      HISTOGRAM [-x]              Table of run lengths as with -H
+      STATS                       Number of sequences and residues
+      QUIT                        Close the connection
+
+   The reply is the output the command line program would give, or a
+   line starting ERROR, followed by a line containing only a full stop.
+   A request longer than MAXBUFF-1 characters is discarded with a single
+   ERROR reply.
+
+   16.10.26  Original   By: ACRM
+   17.10.26  Rejects over-long requests rather than running the rest of
+             the line as another command
+*/
+void ServeConnection(SERVER *server, int fd)
+{
+   FILE       *in, *out;
+   char       line[MAXBUFF], 
+              *args;
+   MATCHMASKS masks;
+   double     start;
+   int        dupfd, 
+              c;
+
+   if((dupfd = dup(fd)) < 0)
+   {
+      close(fd);
+      return;
+   }
+   if(((in  = fdopen(fd, "r"))    == NULL) ||
+      ((out = fdopen(dupfd, "w")) == NULL))
+   {
+      if(in != NULL)
+         fclose(in);
+      else
+         close(fd);
+      close(dupfd);
+      return;
+   }
+   memset(&masks, 0, sizeof(MATCHMASKS));
+
+   while(fgets(line, MAXBUFF, in))
+   {
+      /* No newline means the request filled the buffer. Unless it ended
+         exactly there, skip the rest of it
+      */
+      if((strchr(line, '\n') == NULL) && 
+         ((c = getc(in)) != EOF) && (c != '\n'))
+      {
+         while(((c = getc(in)) != EOF) && (c != '\n'));
+         fprintf(out, "ERROR Request longer than %d characters\n",
+                 MAXBUFF-1);
+         fputs(ENDREPLY, out);
+         if(fflush(out))
+            break;
+         continue;
+      }
+      TERMINATE(line);
+      start = GetTime();
+      for(args=line; *args && !isspace((unsigned char)*args); args++);
+      if(*args)
+         *(args++) = '\0';
+
+      if(!strcmp(line, "QUIT"))
+      {
+         break;
+      }
+      else if(!strcmp(line, "PATTERN"))
+      {
+         ServePattern(server, args, out, &masks);
+      }
+      else if(!strcmp(line, "HISTOGRAM"))
+      {
+         WriteHistogramTable(out, &(server->hist), 
+                             strncmp(args, "-x", 2) != 0);
+      }
+      else if(!strcmp(line, "STATS"))
+      {
+         fprintf(out, "Sequences: %lu\nResidues: %llu\n", 
+                 (unsigned long)server->corpus->nseq,
+                 (unsigned long long)
+                 server->corpus->seqoffsets[server->corpus->nseq]);
+      }
+      else if(line[0])
+      {
+         fprintf(out, "ERROR Unknown command %s\n", line);
+      }
+      fputs(ENDREPLY, out);
+      if(fflush(out))
+         break;
+
+      if(!server->quiet && line[0])
+      {
+         fprintf(stderr, "%s %s: %.2f ms\n", line, args, 
+                 1000.0 * (GetTime() - start));
+         fflush(stderr);
+      }
+   }
+
+   rpFreeMatchMasks(&masks);
+   fclose(in);
+   fclose(out);
+}
+
+/************************************************************************/
+/*>void ServePattern(SERVER *server, char *args, FILE *out, 
+                     MATCHMASKS *masks)
+   --------------------------------------------------------
+   Input:   SERVER     *server  The server
+            char       *args    Arguments to PATTERN ([-x] [-v] pattern)
+            FILE       *out     Connection to the client
+   I/O:     MATCHMASKS *masks   Work space for the bitmask kernel
+
+   Searches every sequence for a pattern and writes the same output as
+   -s. The run index is used if the corpus has one.
+
+   16.10.26  Original   By: ACRM
+   17.10.26  Uses strtok_r() as this is called from the server threads
+*/
+void ServePattern(SERVER *server, char *args, FILE *out, 
+                  MATCHMASKS *masks)
+{
+   CORPUS   *corpus = server->corpus;
+   PERIODIC periodic, 
+            *pperiodic = NULL;
+   PATHITS  hits;
+   char     pattern[MAXPATLEN],
+            *save;
+   BOOL     exact   = TRUE,
+            verbose = FALSE,
+            matched;
+   size_t   i;
+   int      k;
+
+   pattern[0] = '\0';
+   for(args=strtok_r(args, " \t", &save); 
+       args!=NULL; 
+       args=strtok_r(NULL, " \t", &save))
+   {
+      if(!strcmp(args, "-x"))
+         exact = FALSE;
+      else if(!strcmp(args, "-v"))
+         verbose = TRUE;
+      else if(strlen(args) < MAXPATLEN)
+         strcpy(pattern, args);
+      else
+         pattern[0] = '\0';
+   }
+   UPPER(pattern);
+
+   switch(pattern[0] ? rpCompilePattern(pattern, &periodic) : (-1))
+   {
+   case 1:
+      pperiodic = &periodic;
+      break;
+   case (-1):
+      fprintf(out, "ERROR Invalid pattern\n");
+      return;
+   }
+
+   memset(&hits, 0, sizeof(PATHITS));
+   hits.lastseq = (-1);
+   if(!SearchRunIndex(corpus, pattern, exact, verbose, &hits))
+   {
+      for(i=0; i<corpus->nseq; i++)
+      {
+         ScanSequenceForPattern(corpus->residues + corpus->seqoffsets[i],
+                                (int)(corpus->seqoffsets[i+1] - 
+                                      corpus->seqoffsets[i]),
+                                (int)i, pattern, pperiodic, exact, &hits,
+                                (verbose ? &matched : NULL), masks, 
+                                NULL);
+      }
+   }
+
+   for(k=0; k<hits.nseqs; k++)
+   {
+      fprintf(out, "%s matches\n", 
+              corpus->labels + corpus->labeloffsets[hits.seqs[k]]);
+   }
+   fprintf(out, "Total matches: %ld\n", hits.count);
+   free(hits.seqs);
+}
+
+/************************************************************************/
+/*>FILE *OpenInputFile(char *filename, BOOL *piped)
+   ------------------------------------------------
+   Input:   char   *filename    Input file (blank for stdin)
+   Output:  BOOL   *piped       Was the file opened with popen()?
+   Returns: FILE   *            The open file (NULL on error)
+
+   Opens the input file. Files ending .gz or .zst are decompressed with
+   gzip or zstd through a pipe, as bioplib does with GUNZIP_SUPPORT.
+
+   16.10.26  Original   By: ACRM
+*/
+FILE *OpenInputFile(char *filename, BOOL *piped)
+{
+   char cmd[MAXBUFF+32],
+        *decompress = NULL;
+   int  len = strlen(filename);
+
+   *piped = FALSE;
+   if(!len)
+      return(stdin);
+   
+   if((len > 3) && !strcmp(filename+len-3, ".gz"))
+      decompress = "gzip -dc";
+   else if((len > 4) && !strcmp(filename+len-4, ".zst"))
+      decompress = "zstd -dcq";
+
+   if(decompress == NULL)
+      return(fopen(filename, "r"));
+
+   /* Check the file can be read so the error is reported here rather 
+      than by the decompressor, and that it is safe to quote
+   */
+   if(access(filename, R_OK) || (strchr(filename, '\'') != NULL))
+      return(NULL);
+
+   sprintf(cmd, "%s '%s'", decompress, filename);
+   *piped = TRUE;
+   return(popen(cmd, "r"));
+}
+
+/************************************************************************/
+/*>BOOL ReadCorpusRecord(FASTAREADER *reader, FASTAREC *rec)
+   ---------------------------------------------------------
+   I/O:     FASTAREADER *reader Reader for a corpus
+   Output:  FASTAREC    *rec    The record
+   Returns: BOOL                Was a record read?
+
+   Reads the next record from a binary corpus. The label and sequence 
+   point straight into the mapped corpus and are already upper case.
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL ReadCorpusRecord(FASTAREADER *reader, FASTAREC *rec)
+{
+   CORPUS *corpus = reader->corpus;
+   size_t i       = reader->pos;
+
+   if(i >= reader->size)
+      return(FALSE);
+
+   rec->label    = corpus->labels + corpus->labeloffsets[i];
+   rec->labellen = (int)(corpus->labeloffsets[i+1] - 
+                         corpus->labeloffsets[i] - 1);
+   rec->sequence = corpus->residues + corpus->seqoffsets[i];
+   rec->seqlen   = (int)(corpus->seqoffsets[i+1] - 
+                         corpus->seqoffsets[i]);
+   reader->pos++;
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>CORPUS *OpenCorpus(char *data, size_t size)
+   -------------------------------------------
+   Input:   char   *data        Mapped corpus file
+            size_t size         Size of the file
+   Returns: CORPUS *            The corpus (NULL if the file is corrupt
+                                or out of memory)
+
+   Sets up a corpus from a mapped file, checking that all the offsets
+   lie in the file. A corpus written before the run index was added is
+   opened with no index.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Opens the run index
+*/
+CORPUS *OpenCorpus(char *data, size_t size)
+{
+   CORPUSHEADER *header = (CORPUSHEADER *)data;
+   CORPUS       *corpus;
+   uint64_t     tablesize;
+   size_t       i;
+   BOOL         hasindex = !strncmp(data, CORPUSMAGIC, 8);
+
+   tablesize = (header->nseq + 1) * sizeof(uint64_t);
+   if((header->nseq >= (uint64_t)size) ||
+      (header->residues  > size) || 
+      (header->nresidues > size - header->residues) ||
+      (header->labels    > size) || 
+      (header->nlabels   > size - header->labels) ||
+      (header->seqoffsets   % sizeof(uint64_t)) ||
+      (header->labeloffsets % sizeof(uint64_t)) ||
+      (header->seqoffsets   > size) || 
+      (tablesize > size - header->seqoffsets) ||
+      (header->labeloffsets > size) || 
+      (tablesize > size - header->labeloffsets))
+      return(NULL);
+   
+   if((corpus = (CORPUS *)malloc(sizeof(CORPUS))) == NULL)
+      return(NULL);
+   corpus->map          = data;
+   corpus->mapsize      = size;
+   corpus->nseq         = (size_t)header->nseq;
+   corpus->residues     = data + header->residues;
+   corpus->labels       = data + header->labels;
+   corpus->seqoffsets   = (uint64_t *)(data + header->seqoffsets);
+   corpus->labeloffsets = (uint64_t *)(data + header->labeloffsets);
+   corpus->runs         = NULL;
+   corpus->runfirst     = NULL;
+   corpus->nruns        = 0;
+
+   /* The entries are checked as they are used by SearchRunIndex()      */
+   tablesize = (NRESIDUES * RUNBUCKETS + 1) * sizeof(uint64_t);
+   if(hasindex && header->runs)
+   {
+      if((header->runs     % sizeof(uint64_t)) ||
+         (header->runfirst % sizeof(uint64_t)) ||
+         (header->runs     > size) ||
+         (header->nruns    > (size - header->runs) / sizeof(RUNENTRY)) ||
+         (header->runfirst > size) ||
+         (tablesize        > size - header->runfirst))
+      {
+         free(corpus);
+         return(NULL);
+      }
+      corpus->runs     = (RUNENTRY *)(data + header->runs);
+      corpus->runfirst = (uint64_t *)(data + header->runfirst);
+      corpus->nruns    = (size_t)header->nruns;
+      for(i=0; i<NRESIDUES * RUNBUCKETS; i++)
+      {
+         if(corpus->runfirst[i+1] < corpus->runfirst[i])
+            break;
+      }
+      if((corpus->runfirst[0] != 0) || (i < NRESIDUES * RUNBUCKETS) ||
+         (corpus->runfirst[NRESIDUES * RUNBUCKETS] != corpus->nruns))
+      {
+         free(corpus);
+         return(NULL);
+      }
+   }
+
+   /* Offsets must run in order through the residues and labels         */
+   if((corpus->seqoffsets[0] != 0) || (corpus->labeloffsets[0] != 0) ||
+      (corpus->seqoffsets[corpus->nseq]   != header->nresidues) ||
+      (corpus->labeloffsets[corpus->nseq] != header->nlabels))
+   {
+      free(corpus);
+      return(NULL);
+   }
+   for(i=0; i<corpus->nseq; i++)
+   {
+      if((corpus->seqoffsets[i+1] < corpus->seqoffsets[i]) ||
+         (corpus->seqoffsets[i+1] - corpus->seqoffsets[i] > INT_MAX) ||
+         (corpus->labeloffsets[i+1] <= corpus->labeloffsets[i]) ||
+         (corpus->labels[corpus->labeloffsets[i+1] - 1] != '\0'))
+      {
+         free(corpus);
+         return(NULL);
+      }
+   }
+
+   return(corpus);
+}
+
+/************************************************************************/
+/*>BOOL BuildCorpus(FASTAREADER *reader, char *filename)
+   -----------------------------------------------------
+   Input:   FASTAREADER *reader   FASTA reader
+            char        *filename Corpus file to write
+   Returns: BOOL                  Success?
+
+   Writes a binary corpus file for repeated searches of the same FASTA
+   file. The file has a CORPUSHEADER followed by the upper case 
+   sequences end to end with no newlines, a pool of NUL-terminated 
+   labels, tables giving the start of each sequence and label and the
+   run index written by WriteRunIndex(). The sequences are written as 
+   they are read; everything else is kept in memory and written at the
+   end, followed by the header.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Writes the run index
+*/
+BOOL BuildCorpus(FASTAREADER *reader, char *filename)
+{
+   FILE         *fp;
+   FASTAREC     rec;
+   CORPUSHEADER header;
+   RUNENTRY     run;
+   ARENA        labels, 
+                seqoffsets, 
+                labeloffsets,
+                runs,
+                runres;
+   uint64_t     offset, 
+                nresidues = 0;
+   int          pos, res, len;
+   char         ch;
+   BOOL         ok = TRUE,
+                isexact;
+
+   if((fp = fopen(filename, "wb")) == NULL)
+      return(FALSE);
+
+   memset(&header,       0, sizeof(CORPUSHEADER));
+   memset(&labels,       0, sizeof(ARENA));
+   memset(&seqoffsets,   0, sizeof(ARENA));
+   memset(&labeloffsets, 0, sizeof(ARENA));
+   memset(&runs,         0, sizeof(ARENA));
+   memset(&runres,       0, sizeof(ARENA));
+
+   /* Header is filled in at the end                                    */
+   if(fwrite(&header, sizeof(CORPUSHEADER), 1, fp) != 1)
+      ok = FALSE;
+   header.residues = sizeof(CORPUSHEADER);
+
+   while(ok && ReadFASTARecord(reader, &rec))
+   {
+      ArenaAppend(&seqoffsets, (char *)&nresidues, sizeof(uint64_t));
+      offset = labels.used;
+      ArenaAppend(&labeloffsets, (char *)&offset, sizeof(uint64_t));
+      ArenaAppend(&labels, rec.label, rec.labellen);
+      ArenaAppend(&labels, "", 1);
+
+      if(fwrite(rec.sequence, 1, rec.seqlen, fp) != (size_t)rec.seqlen)
+         ok = FALSE;
+
+      /* Runs of a single residue are not indexed                       */
+      run.seq = (uint32_t)header.nseq;
+      for(pos=0; rpNextRun(gResIndex, rec.sequence, rec.seqlen, &pos, 
+                           &res, &len, &isexact); )
+      {
+         if(len > 1)
+         {
+            run.start = (uint32_t)(pos - 1);
+            run.len   = (uint32_t)len;
+            ch        = (char)res;
+            ArenaAppend(&runs, (char *)&run, sizeof(RUNENTRY));
+            ArenaAppend(&runres, &ch, 1);
+         }
+      }
+
+      nresidues += rec.seqlen;
+      header.nseq++;
+   }
+   ArenaAppend(&seqoffsets, (char *)&nresidues, sizeof(uint64_t));
+   offset = labels.used;
+   ArenaAppend(&labeloffsets, (char *)&offset, sizeof(uint64_t));
+
+   header.nresidues    = nresidues;
+   offset              = header.residues + nresidues;
+   ok = ok && WritePadding(fp, &offset);
+   header.labels       = offset;
+   header.nlabels      = labels.used;
+   ok = ok && (fwrite(labels.data, 1, labels.used, fp) == labels.used);
+   offset             += labels.used;
+   ok = ok && WritePadding(fp, &offset);
+   header.seqoffsets   = offset;
+   ok = ok && (fwrite(seqoffsets.data, 1, seqoffsets.used, fp) == 
+               seqoffsets.used);
+   offset             += seqoffsets.used;
+   header.labeloffsets = offset;
+   ok = ok && (fwrite(labeloffsets.data, 1, labeloffsets.used, fp) == 
+               labeloffsets.used);
+   offset             += labeloffsets.used;
+
+   /* Sequence numbers in the index are 32-bit                          */
+   if(header.nseq <= UINT32_MAX)
+      ok = ok && WriteRunIndex(fp, &runs, &runres, &header, &offset);
+
+   memcpy(header.magic, CORPUSMAGIC, 8);
+   ok = ok && !fseek(fp, 0L, SEEK_SET);
+   ok = ok && (fwrite(&header, sizeof(CORPUSHEADER), 1, fp) == 1);
+   if(fclose(fp))
+      ok = FALSE;
+
+   ArenaFree(&labels);
+   ArenaFree(&seqoffsets);
+   ArenaFree(&labeloffsets);
+   ArenaFree(&runs);
+   ArenaFree(&runres);
+   return(ok);
+}
+
+/************************************************************************/
+/*>BOOL WriteRunIndex(FILE *fp, ARENA *runs, ARENA *runres, 
+                      CORPUSHEADER *header, uint64_t *offset)
+   ----------------------------------------------------------------
+   Input:   FILE         *fp     Corpus file being written
+            ARENA        *runs   RUNENTRYs in file order
+            ARENA        *runres Residue index of each run (one byte 
+                                 each)
+   Output:  CORPUSHEADER *header runs, nruns and runfirst are set
+   I/O:     uint64_t     *offset Current offset in the file; updated
+   Returns: BOOL                 Success?
+
+   Writes the run index: every maximal alternating run of two or more
+   occurrences of a residue, as found by rpNextRun(), sorted into a bucket
+   for each residue and length (see RunBucket()). Within a bucket the 
+   runs are in file order. A table giving the start of each bucket 
+   follows. Exits if out of memory.
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL WriteRunIndex(FILE *fp, ARENA *runs, ARENA *runres, 
+                   CORPUSHEADER *header, uint64_t *offset)
+{
+   RUNENTRY *in     = (RUNENTRY *)runs->data,
+            *sorted;
+   uint64_t first[NRESIDUES * RUNBUCKETS + 1],
+            next[NRESIDUES * RUNBUCKETS];
+   size_t   nruns   = runs->used / sizeof(RUNENTRY),
+            i;
+   int      b;
+   BOOL     ok;
+
+   if((sorted = (RUNENTRY *)malloc((nruns ? nruns : 1) * 
+                                   sizeof(RUNENTRY))) == NULL)
+   {
+      fprintf(stderr, "No memory for run index\n");
+      exit(1);
+   }
+
+   /* Counting sort into the buckets                                    */
+   memset(first, 0, sizeof(first));
+   for(i=0; i<nruns; i++)
+      first[RunBucket(runres->data[i], (int)in[i].len) + 1]++;
+   for(b=0; b<NRESIDUES * RUNBUCKETS; b++)
+   {
+      first[b+1] += first[b];
+      next[b]     = first[b];
+   }
+   for(i=0; i<nruns; i++)
+   {
+      b = RunBucket(runres->data[i], (int)in[i].len);
+      sorted[next[b]++] = in[i];
+   }
+
+   ok = WritePadding(fp, offset);
+   header->runs  = *offset;
+   header->nruns = nruns;
+   ok = ok && (fwrite(sorted, sizeof(RUNENTRY), nruns, fp) == nruns);
+   *offset += nruns * sizeof(RUNENTRY);
+   ok = ok && WritePadding(fp, offset);
+   header->runfirst = *offset;
+   ok = ok && (fwrite(first, sizeof(first), 1, fp) == 1);
+   *offset += sizeof(first);
+
+   free(sorted);
+   return(ok);
 }
 
 /************************************************************************/
-void SearchAllPatterns(FILE *in, BOOL exact, int minpat, int maxpat, 
-                       BOOL verbose, BOOL quiet)
-{
-   char aa;
-   int  i, j, k;
-   char *letters = "ACDEFGHIKLMNPQRSTVWY",
-      pat[MAXPATLEN];
+/*>int RunBucket(int res, int len)
+   -------------------------------
+   Input:   int    res          Residue index in RESIDUES
+            int    len          Occurrences of the residue in the run
+   Returns: int                 Bucket in the run index
 
-   for(j=0; j<strlen(letters); j++)
-   {
-      aa = letters[j];
-      for(i=minpat; i<=maxpat; i++)
-      {
-         for(k=0; k<i; k++)
-         {
-            pat[k*2] = aa;
-            pat[k*2+1] = 'X';
-         }
-         pat[i*2-1] = '\0';
+   Runs of each length below RUNBUCKETS have their own bucket; longer
+   runs share the last one.
 
-         fprintf(stdout, "Testing pattern '%s':\n", pat);
-         fflush(stdout);
-         
-         SearchFileForPattern(pat, in, exact, verbose, quiet);
-        }
-    }
+   16.10.26  Original   By: ACRM
+*/
+int RunBucket(int res, int len)
+{
+   return(res * RUNBUCKETS + ((len < RUNBUCKETS) ? len : RUNBUCKETS-1));
 }
 
 /************************************************************************/
-void SearchFileForPattern(char *pattern, FILE *in, BOOL exact, 
-                          BOOL verbose, BOOL quiet)
+/*>BOOL WritePadding(FILE *fp, uint64_t *offset)
+   ---------------------------------------------
+   Input:   FILE     *fp        File being written
+   I/O:     uint64_t *offset    Current offset in the file; updated
+
+   Returns: BOOL                Success?
+
+   Writes zeros to bring the file to a multiple of 8 bytes so that the
+   following table can be used directly from the mapped file.
+
+   16.10.26  Original   By: ACRM
+*/
+BOOL WritePadding(FILE *fp, uint64_t *offset)
 {
-   char label[MAXBUFF];
-   char sequence[MAXSEQ];
-   BOOL ok, print;
-   int count, offset, nseq=0;
-   
+   static char zeros[sizeof(uint64_t)];
+   size_t      npad;
 
-   rewind(in);
+   npad = (sizeof(uint64_t) - (*offset % sizeof(uint64_t))) % 
+          sizeof(uint64_t);
+   if(fwrite(zeros, 1, npad, fp) != npad)
+      return(FALSE);
+   *offset += npad;
+   return(TRUE);
+}
 
-   count = 0;
-   while(1)
-   {
-      GetFASTASequence(in, label, sequence);
-      if (label[0] == '\0') break;
-      if(!quiet)
-      {
-         if(!(++nseq % 10000))
-         {
-            fprintf(stderr, "Processed %d sequences\n", nseq);
-            fflush(stderr);
-         }
-      }
-      
-      ok     = FALSE;
-      offset = 0;
-      print  = FALSE;
+/************************************************************************/
+/*>void CloseFASTAReader(FASTAREADER *reader)
+   ------------------------------------------
+   I/O:     FASTAREADER *reader FASTA reader
 
-      while((offset=SearchSequenceForPattern(sequence, pattern, offset))
-            !=(-1))
-      {
-         ok = TRUE;
-         if(exact)
-         {
-            ok = CheckBounds(sequence, pattern, offset);
-         }
-         if(ok)
-         {
-            count++;
-            print = TRUE;
-         }
-         offset++;
-      }
-      if(verbose && print)
-      {
-         fprintf(stdout, "%s matches\n", label);
-      }
+   Unmaps the file and frees the reader. Does not close the file.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Frees a corpus
+   16.10.26  Stops the RING
+*/
+void CloseFASTAReader(FASTAREADER *reader)
+{
+   if(reader->ring != NULL)
+      StopRing(reader->ring);
+   if(reader->map != NULL)
+      munmap(reader->map, reader->mapsize);
+   if(reader->corpus != NULL)
+   {
+      munmap(reader->corpus->map, reader->corpus->mapsize);
+      free(reader->corpus);
    }
-   fprintf(stdout, "Total matches: %d\n", count);
+   if(reader->line != NULL)
+      free(reader->line);
+   ArenaFree(&(reader->record));
+   ArenaFree(&(reader->header));
+   free(reader);
 }
 
 /************************************************************************/
-/* takes a sequence, a pattern and the offset into the sequence
-   where the pattern was found. Checks if this is a sub pattern
-   i.e. the pattern continues before or after the identified 
-   place
+/*>void FoldToUpper(char *string, int len)
+   ---------------------------------------
+   I/O:     char   *string      String to convert
+   Input:   int    len          Length of the string
+
+   Converts a string to upper case in place, working on 8 bytes at a
+   time. A word is only written back if it contained a lower case 
+   letter so that mapped pages without lower case are not copied.
+
+   16.10.26  Original   By: ACRM
 */
-BOOL CheckBounds(char *sequence, char *pattern, int offset)
+void FoldToUpper(char *string, int len)
 {
-   char ch;
-   int  patlen, seqlen;
-
-   ch     = pattern[0];
-   patlen = strlen(pattern);
-   seqlen = strlen(sequence);
+   const uint64_t ones = 0x0101010101010101ULL,
+                  high = 0x8080808080808080ULL;
+   uint64_t       word, low7, mask;
+   int            i;
 
-   /* Check the N terminus                                              */
-   if(offset >= 2)
+   for(i=0; i+8<=len; i+=8)
    {
-      if((sequence[offset-1] != ch) &&
-         (sequence[offset-2] == ch))
+      memcpy(&word, string+i, 8);
+      /* Bytes >= 'a' and bytes > 'z' get their top bit set by the 
+         additions; bytes with the top bit already set are excluded
+      */
+      low7 = word & ~high;
+      mask = ((low7 + ones*(0x80-'a')) & ~(low7 + ones*(0x80-'z'-1)) &
+              ~word & high);
+      if(mask)
       {
-         return(FALSE);
+         word ^= (mask >> 2);
+         memcpy(string+i, &word, 8);
       }
    }
-   else if(offset == 1)
+   for(; i<len; i++)
    {
-      if(sequence[offset-1] == ch)
-      {
-         return(FALSE);
-      }
+      if((string[i] >= 'a') && (string[i] <= 'z'))
+         string[i] -= ('a' - 'A');
    }
-   
-   /* Check the C terminus                                              */
-   if((seqlen - (offset+patlen)) >= 2)
+}
+
+/************************************************************************/
+/*>BOOL ReadFASTAStream(FASTAREADER *reader, FASTAREC *rec)
+   --------------------------------------------------------
+   I/O:     FASTAREADER *reader FASTA reader
+   Output:  FASTAREC    *rec    The record
+   Returns: BOOL                Was a record read?
+
+   Reads the next record from a file that could not be mapped. Lines may
+   be of any length. The label and sequence are built in the record 
+   arena so there is no limit on the sequence length. The header of the
+   following record is kept in a separate arena since the record arena 
+   is reset on the next call.
+
+   07.03.13  Original as GetFASTASequence()   By: ACRM
+   16.10.26  Rewritten to use arenas rather than fixed size buffers
+   16.10.26  Lines are read from the RING by ReadLine()
+*/
+BOOL ReadFASTAStream(FASTAREADER *reader, FASTAREC *rec)
+{
+   ssize_t len;
+   size_t  seqstart;
+
+   /* Skip to the first header                                          */
+   while(!reader->haveheader)
    {
-      if((sequence[offset+patlen]   != ch) &&
-         (sequence[offset+patlen+1] == ch))
-      {
+      if((len = ReadLine(reader)) < 0)
          return(FALSE);
+      if(reader->line[0] == '>')
+      {
+         if(reader->line[len-1] == '\n')
+            len--;
+         ArenaReset(&(reader->header));
+         ArenaAppend(&(reader->header), reader->line, len);
+         reader->haveheader = TRUE;
       }
    }
-   else if ((seqlen - (offset+patlen)) == 1)
+
+   ArenaReset(&(reader->record));
+   ArenaAppend(&(reader->record), reader->header.data, 
+               reader->header.used);
+   seqstart = reader->record.used;
+   reader->haveheader = FALSE;
+   
+   while((len = ReadLine(reader)) >= 0)
    {
-      if(sequence[offset+patlen] == ch)
+      if(len && (reader->line[len-1] == '\n'))
+         len--;
+      if(reader->line[0] == '>')
       {
-         return(FALSE);
+         ArenaReset(&(reader->header));
+         ArenaAppend(&(reader->header), reader->line, len);
+         reader->haveheader = TRUE;
+         break;
       }
+      ArenaAppend(&(reader->record), reader->line, len);
    }
-   
 
+   rec->label    = reader->record.data;
+   rec->labellen = (int)seqstart;
+   rec->sequence = reader->record.data + seqstart;
+   rec->seqlen   = (int)(reader->record.used - seqstart);
+   FoldToUpper(rec->sequence, rec->seqlen);
    return(TRUE);
 }
 
 /************************************************************************/
-/* Takes a sequence and pattern of the form AXAXAXA together with an
-   offset into the sequence. It then searches for the pattern starting
-   from the specified offset.
-   If the pattern is found then it returns the new offset where the
-   pattern was found.
-   Returns (-1) when pattern not found
+/*>size_t ArenaAppend(ARENA *arena, char *data, size_t len)
+   --------------------------------------------------------
+   I/O:     ARENA  *arena       The arena
+   Input:   char   *data        Data to append
+            size_t len          Length of data
+   Returns: size_t              Offset of the data in the arena
+
+   Appends data to an arena, growing it geometrically if needed. Since
+   the arena may move when it grows, callers should keep offsets rather
+   than pointers until they have finished appending. Exits if there is
+   no memory.
+
+   16.10.26  Original   By: ACRM
 */
-int SearchSequenceForPattern(char *sequence, char *pattern, int offset)
+size_t ArenaAppend(ARENA *arena, char *data, size_t len)
 {
-   char *subseq, ch;
-   int  patlen, nrepeat, seqlen, i, j;
-   BOOL match;
-   
-   subseq = sequence+offset;
-   seqlen  = strlen(subseq);
-
-   patlen = strlen(pattern);
-   nrepeat = (patlen-1)/2;
-   ch      = pattern[0];
+   size_t offset = arena->used;
    
-   for(i=0; i<(1+seqlen-patlen); i++)
+   if(arena->used + len > arena->size)
    {
-      match = TRUE;
-      for(j=0; j<patlen; j+=2)
-      {
-         if(subseq[i+j] != ch)
-         {
-            match = FALSE;
-            break;
-         }
-      }
-      if(match)
-      {
-         for(j=1; j<patlen-1; j+=2)
-         {
-            if(subseq[i+j] == ch)
-            {
-               match = FALSE;
-               break;
-            }
-         }
-      }
+      size_t size = (arena->size) ? 2 * arena->size : ARENASIZE;
+      char   *newdata;
       
-      if(match)
+      while(size < arena->used + len)
+         size *= 2;
+      if((newdata = (char *)realloc(arena->data, size)) == NULL)
       {
-         return(offset+i);
+         fprintf(stderr, "No memory for sequence of length %lu\n",
+                 (unsigned long)(arena->used + len));
+         exit(1);
       }
+      arena->data = newdata;
+      arena->size = size;
    }
 
-   return(-1);
+   if(len)
+      memcpy(arena->data + arena->used, data, len);
+   arena->used += len;
+   return(offset);
 }
 
 /************************************************************************/
-BOOL GetFASTASequence(FILE *in, char *label, char *sequence)
+/*>void ArenaReset(ARENA *arena)
+   -----------------------------
+   I/O:     ARENA  *arena       The arena
+
+   Empties an arena keeping its memory for reuse
+
+   16.10.26  Original   By: ACRM
+*/
+void ArenaReset(ARENA *arena)
 {
-   static char labelline[MAXBUFF] = "";
-   char buffer[MAXBUFF];
+   arena->used = 0;
+}
 
-   label[0] = '\0';
-   sequence[0] = '\0';
-   
-   if(feof(in))
-   {
-      labelline[0] = '\0';
-      return(FALSE);
-   }
-   
-   while(fgets(buffer, MAXBUFF, in))
-   {
-      TERMINATE(buffer);
-      if(buffer[0] == '>')
-      {
-         if(strlen(labelline))
-         {
-            strncpy(label, labelline, MAXBUFF);
-            strncpy(labelline, buffer, MAXBUFF);
-            UPPER(sequence);
-            return(TRUE);
-         }
-         else
-         {
-            strncpy(labelline, buffer, MAXBUFF);
-         }
-      }
-      else
-      {
-         strncat(sequence, buffer, MAXSEQ-strlen(sequence));
-      }
-   }
-   strncpy(label, labelline, MAXBUFF);
-   labelline[0] = '\0';
-   return(TRUE);
+/************************************************************************/
+/*>void ArenaFree(ARENA *arena)
+   ----------------------------
+   I/O:     ARENA  *arena       The arena
+
+   Frees the memory used by an arena
+
+   16.10.26  Original   By: ACRM
+*/
+void ArenaFree(ARENA *arena)
+{
+   if(arena->data != NULL)
+      free(arena->data);
+   arena->data = NULL;
+   arena->used = arena->size = 0;
 }
 
 /************************************************************************/
 void Usage(void)
 {
-   fprintf(stderr,"indirectrepeats V2.0, (c) 2004-2013, \
+   fprintf(stderr,"indirectrepeats V2.23, (c) 2004-2026, \
 Dr. Andrew C.R. Martin, UCL\n");
    fprintf(stderr,"\n");
    fprintf(stderr,"Usage: indirectrepeats [-x][-v][-q][-n minpat]\
-[-m maxpat][-s pattern] file.faa [output]\n");
+[-m maxpat][-s pattern]\n");
+   fprintf(stderr,"                       [-S patterns.txt]\
+[-k mismatches][-t threads]\n");
+   fprintf(stderr,"                       [--incremental checkpoint] \
+[--hits hits.tsv [--bed]]\n");
+   fprintf(stderr,"                       [--metrics metrics.json]\n");
+   fprintf(stderr,"                       [--null N [--null-corpus]]\n");
+   fprintf(stderr,"                       file.faa [output]\n");
+   fprintf(stderr,"       indirectrepeats -H [-b histogram.bin][-x][-v]\
+[-q][-t threads]\n");
+   fprintf(stderr,"                       file.faa [output]\n");
+   fprintf(stderr,"       indirectrepeats --build-index corpus.irc \
+file.faa\n");
+   fprintf(stderr,"       indirectrepeats --shard i/N [options] file.faa \
+[partial]\n");
+   fprintf(stderr,"       indirectrepeats --merge [-b histogram.bin] \
+partial ...\n");
+   fprintf(stderr,"       indirectrepeats --benchmark [-n minpat]\
+[-m maxpat] file.faa [output]\n");
+   fprintf(stderr,"       indirectrepeats --serve socket [-q][-t threads] \
+file.faa\n");
+   fprintf(stderr,"       indirectrepeats --dna [-x][-v][-q][-n minpat]\
+[-m maxpat] file.fa [output]\n");
+   fprintf(stderr,"       indirectrepeats --organisms [-x][-q][-n minpat]\
+[-m maxpat][-s pattern]\n");
+   fprintf(stderr,"                       [-S patterns.txt][-k mismatches]\
+[-t threads]\n");
+   fprintf(stderr,"                       file.faa|directory ...\n");
+   fprintf(stderr,"       indirectrepeats -T\n");
    fprintf(stderr,"       -x Do non-exact matching\n");
    fprintf(stderr,"       -v Verbose (report macthed sequences)\n");
    fprintf(stderr,"       -q Quiet (do not report progress)\n");
    fprintf(stderr,"       -n Minimum pattern length (default: 1)\n");
    fprintf(stderr,"       -m Maxmimum pattern length (default: 10)\n");
    fprintf(stderr,"       -s Specify a sequence pattern\n");
+   fprintf(stderr,"       -S Specify a file of sequence patterns, one \
+per line\n");
+   fprintf(stderr,"       -k With -s or -S, allow up to this many \
+substitutions (max %d)\n", MAXMISMATCHES);
+   fprintf(stderr,"       -t Number of threads (default: 1)\n");
+   fprintf(stderr,"       -T Run the self-test of the pattern matching \
+kernel\n");
+   fprintf(stderr,"       -H Give the distribution of repeat lengths \
+for every residue\n");
+   fprintf(stderr,"       -b With -H, also write the distribution in \
+binary to this file\n");
+   fprintf(stderr,"       --build-index Write a binary corpus of the \
+FASTA file\n");
+   fprintf(stderr,"       --shard Search shard i of N and write partial \
+results\n");
+   fprintf(stderr,"       --merge Combine the partial results from \
+every shard\n");
+   fprintf(stderr,"       --incremental Keep a checkpoint and search \
+only new sequences\n");
+   fprintf(stderr,"       --hits  Write the position of every match \
+to this file (- for\n");
+   fprintf(stderr,"               stdout)\n");
+   fprintf(stderr,"       --bed   With --hits, write BED rather than \
+TSV\n");
+   fprintf(stderr,"       --metrics Write progress and run metrics as \
+JSON lines (- for\n");
+   fprintf(stderr,"               stderr)\n");
+   fprintf(stderr,"       --benchmark Time the search engines and check \
+they give the same\n");
+   fprintf(stderr,"               counts\n");
+   fprintf(stderr,"       --serve Load the file once and answer queries \
+on a Unix socket\n");
+   fprintf(stderr,"       --null Compare the counts with N shuffles of \
+the sequences\n");
+   fprintf(stderr,"       --null-corpus With --null, shuffle across the \
+whole file rather\n");
+   fprintf(stderr,"               than within each sequence\n");
+   fprintf(stderr,"       --dna   Search nucleotide rather than protein \
+sequences\n");
+   fprintf(stderr,"       --organisms Count the patterns in each of \
+many files\n");
    fprintf(stderr,"\n");
    fprintf(stderr,"Searches a file for matches to a poly-amino acid \
 sequence. By default,\n");
@@ -385,7 +7937,16 @@ sequence. By default,\n");
 occurrences of n-mers\n");
    fprintf(stderr,"from 1..10 residues. You can override this with -s \
 and just look\n");
-   fprintf(stderr,"at the one specified pattern.\n");
+   fprintf(stderr,"at the one specified pattern. -S tests all the \
+patterns in a file in a\n");
+   fprintf(stderr,"single pass.\n");
+   fprintf(stderr,"\n");
+   fprintf(stderr,"Patterns may have longer spacers (e.g. AXXA) and the \
+repeated residue may\n");
+   fprintf(stderr,"be a class of residues in square brackets (e.g. \
+[ST]X[ST]X[ST]). Residues\n");
+   fprintf(stderr,"in the spacers may not be any of the repeated \
+residues.\n");
    fprintf(stderr,"\n");
    fprintf(stderr,"By default, does exact matching. In other words, if \
 you are looking for\n");
@@ -395,6 +7956,143 @@ can override this\n");
 residues before and\n");
    fprintf(stderr,"after the pattern do not extend the pattern.\n");
    fprintf(stderr,"\n");
+   fprintf(stderr,"-k finds degenerate repeats in one pass. A match may \
+have up to the given\n");
+   fprintf(stderr,"number of substitutions, each being a repeated \
+position which is not the\n");
+   fprintf(stderr,"residue (or class) or a spacer which is. So with -k 1, \
+AXAXA matches\n");
+   fprintf(stderr,"AXCXA. An exact match is one which is not extended by \
+another repeat one\n");
+   fprintf(stderr,"period before or after it. Patterns must be regular: \
+they start and end\n");
+   fprintf(stderr,"with the repeated residue and the spacers are all the \
+same length.\n");
+   fprintf(stderr,"\n");
+   fprintf(stderr,"With -H, a single table gives the number of matches \
+for every residue\n");
+   fprintf(stderr,"and every pattern length with no upper limit on the \
+length. With -v a\n");
+   fprintf(stderr,"second table gives the longest match of each residue \
+in each sequence.\n");
+   fprintf(stderr,"\n");
+   fprintf(stderr,"file.faa may be compressed with gzip (.gz) or zstd \
+(.zst). If it is not\n");
+   fprintf(stderr,"given, the sequences are read from standard input.\n");
+   fprintf(stderr,"\n");
+   fprintf(stderr,"A corpus written with --build-index may be given in \
+place of file.faa\n");
+   fprintf(stderr,"in any of the searches. It is mapped directly so \
+needs no parsing.\n");
+   fprintf(stderr,"The corpus also indexes every alternating run of two \
+or more of a\n");
+   fprintf(stderr,"residue by residue and length, so -s (and --serve) \
+with a simple pattern\n");
+   fprintf(stderr,"such as AXAXA only visits the runs long enough to \
+match rather than\n");
+   fprintf(stderr,"scanning every sequence. Corpus files from earlier \
+versions are still\n");
+   fprintf(stderr,"read but are scanned.\n");
+   fprintf(stderr,"\n");
+   fprintf(stderr,"A large file may be searched in pieces, perhaps on \
+different machines,\n");
+   fprintf(stderr,"with --shard 1/N to --shard N/N. Each writes a \
+binary partial result\n");
+   fprintf(stderr,"and --merge combines these into exactly the output \
+of a single search.\n");
+   fprintf(stderr,"The search options are taken from the partial \
+files.\n");
+   fprintf(stderr,"\n");
+   fprintf(stderr,"With --incremental, the results so far are saved in \
+the checkpoint file\n");
+   fprintf(stderr,"with the number of bytes searched and a hash of \
+them. If the checkpoint\n");
+   fprintf(stderr,"exists, the start of file.faa is checked against it \
+and only the rest\n");
+   fprintf(stderr,"is searched. This searches only the sequences \
+appended to a database\n");
+   fprintf(stderr,"since the last run, or resumes a run which was \
+killed.\n");
+   fprintf(stderr,"\n");
+   fprintf(stderr,"--hits gives a line for each match with the label, \
+pattern, first and\n");
+   fprintf(stderr,"last residue (from 1) and whether it is exact or \
+extended (part of a\n");
+   fprintf(stderr,"longer repeat). With --bed, the lines have the \
+sequence identifier, start\n");
+   fprintf(stderr,"(from 0), end and pattern. With --hits -, the hits \
+are written to standard\n");
+   fprintf(stderr,"output ahead of the counts.\n");
+   fprintf(stderr,"\n");
+   fprintf(stderr,"--metrics writes a progress line every 10000 \
+sequences and a summary with\n");
+   fprintf(stderr,"the time spent reading, scanning, formatting hits \
+and writing output,\n");
+   fprintf(stderr,"residues/s, MB/s, hits/s, peak RSS and the \
+utilisation of each thread.\n");
+   fprintf(stderr,"\n");
+   fprintf(stderr,"--benchmark counts every pattern with the original \
+scalar search, the\n");
+   fprintf(stderr,"bitmask kernel and the run scanner on one thread, \
+reports the time taken\n");
+   fprintf(stderr,"by each and fails if the counts differ. genproteome \
+writes synthetic\n");
+   fprintf(stderr,"files for this.\n");
+   fprintf(stderr,"\n");
+   fprintf(stderr,"--serve keeps the sequences in memory (a corpus is \
+used from the mapped\n");
+   fprintf(stderr,"file) and answers queries, one per line, from a pool \
+of -t threads:\n");
+   fprintf(stderr,"   PATTERN [-x] [-v] pattern   Matches to a pattern \
+as with -s\n");
+   fprintf(stderr,"   HISTOGRAM [-x]              Table of run lengths \
+as with -H\n");
+   fprintf(stderr,"   STATS                       Number of sequences \
+and residues\n");
+   fprintf(stderr,"   QUIT                        Close the \
+connection\n");
+   fprintf(stderr,"Each reply ends with a line containing only a full \
+stop. Errors start\n");
+   fprintf(stderr,"with ERROR.\n");
+   fprintf(stderr,"\n");
+   fprintf(stderr,"--null N counts the patterns in N shuffles of each \
+sequence, which keep\n");
+   fprintf(stderr,"its composition, on -t threads and writes a table in \
+place of the\n");
+   fprintf(stderr,"normal output giving, for each pattern, the observed \
+count, the mean\n");
+   fprintf(stderr,"(expected) count and standard deviation in the \
+shuffles, the z-score and\n");
+   fprintf(stderr,"the empirical p-value of a count at least as high. \
+The shuffles are the\n");
+   fprintf(stderr,"same whatever the number of threads.\n");
+   fprintf(stderr,"\n");
+   fprintf(stderr,"--dna counts the runs of A, C, G and T (in either \
+case) as the default\n");
+   fprintf(stderr,"search does for amino acids; any other base, such as \
+N, is a spacer.\n");
+   fprintf(stderr,"Each sequence is packed into bit planes and \
+scanned 64 bases at\n");
+   fprintf(stderr,"a time in a window of a million bases, so a whole \
+chromosome is searched\n");
+   fprintf(stderr,"in a few megabytes of memory.\n");
+   fprintf(stderr,"\n");
+   fprintf(stderr,"--organisms takes the rest of the command line as \
+input files, or\n");
+   fprintf(stderr,"directories of them, and writes a single tab \
+separated matrix to\n");
+   fprintf(stderr,"standard output with a row for each file giving the \
+number of sequences\n");
+   fprintf(stderr,"and residues and the matches to each pattern per \
+million residues. The\n");
+   fprintf(stderr,"files are searched on a pool of -t threads, the \
+largest first, with small\n");
+   fprintf(stderr,"files batched together. Each row is named from the \
+file name without\n");
+   fprintf(stderr,"the directory or extensions, or by the path given if \
+two files would\n");
+   fprintf(stderr,"have the same name.\n");
+   fprintf(stderr,"\n");
 
    exit(0);
 }
@@ -408,38 +8106,165 @@ residues before and\n");
             
             char   *infile      Input file (or blank string)
             char   *outfile     Output file (or blank string)
-            int    *minpat      
-            int    *maxpat      
-            char   *pattern
-            BOOL   *verbose
-            BOOL   *quiet
-            BOOL   *exact
+            OPTIONS *opts       Search options
    Returns: BOOL                Success?
 
    Parse the command line
 
    01.06.09  Original   By: ACRM   
+   16.10.26  Options now returned in OPTIONS. Added -t
+   16.10.26  Added -T
+   16.10.26  Added -H and -b
+   16.10.26  Added -S
+   16.10.26  Added --build-index
+   16.10.26  Added --shard and --merge
+   16.10.26  Added --incremental
+   16.10.26  Added --hits and --bed
+   16.10.26  Added --metrics
+   16.10.26  Added --benchmark
+   16.10.26  Added --serve
+   16.10.26  Added --null and --null-corpus
+   16.10.26  Added --dna
+   16.10.26  Added -k
+   16.10.26  Added --organisms
+   17.10.26  Conflicting options are checked after the loop so they are
+             also rejected when reading from stdin
+   17.10.26  -v is rejected with --null
 */
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                  int *minpat, int *maxpat, char *pattern, BOOL *verbose,
-                  BOOL *quiet, BOOL *exact)
+                  OPTIONS *opts)
 {
    argc--;
    argv++;
 
    infile[0] = outfile[0] = '\0';
-   pattern[0] = '\0';
-   *maxpat = 10;
-   *minpat = 1;
-   *verbose = FALSE;
-   *exact = TRUE;
-   *quiet = FALSE;
+   opts->pattern[0] = '\0';
+   opts->maxpat     = 10;
+   opts->minpat     = 1;
+   opts->verbose    = FALSE;
+   opts->exact      = TRUE;
+   opts->quiet      = FALSE;
+   opts->nthreads   = 1;
+   opts->selftest   = FALSE;
+   opts->benchmark  = FALSE;
+   opts->histogram  = FALSE;
+   opts->histfile[0] = '\0';
+   opts->patfile[0] = '\0';
+   opts->corpusfile[0] = '\0';
+   opts->ckptfile[0] = '\0';
+   opts->hitsfile[0] = '\0';
+   opts->bed        = FALSE;
+   opts->hitsfp     = NULL;
+   opts->metricsfile[0] = '\0';
+   opts->socketfile[0] = '\0';
+   opts->metrics    = NULL;
+   opts->patset     = NULL;
+   opts->periodic   = NULL;
+   opts->shard      = 0;
+   opts->nshards    = 0;
+   opts->merge      = FALSE;
+   opts->nnull      = 0;
+   opts->nullcorpus = FALSE;
+   opts->dna        = FALSE;
+   opts->mismatches = 0;
+   opts->organisms  = FALSE;
+   opts->orgfiles   = NULL;
+   opts->norgfiles  = 0;
+   opts->partfiles  = NULL;
+   opts->npartfiles = 0;
    
    while(argc)
    {
       if(argv[0][0] == '-')
       {
-         if (argv [0][2]!='\0')
+         if(!strcmp(argv[0], "--build-index"))
+         {
+            argv++;
+            argc--;
+            if(!argc)
+               return(FALSE);
+            strncpy(opts->corpusfile, argv[0], MAXBUFF);
+            opts->corpusfile[MAXBUFF-1] = '\0';
+         }
+         else if(!strcmp(argv[0], "--shard"))
+         {
+            argv++;
+            argc--;
+            if(!argc || 
+               (sscanf(argv[0], "%d/%d", &(opts->shard), 
+                       &(opts->nshards)) != 2) ||
+               (opts->shard < 1) || (opts->shard > opts->nshards))
+               return(FALSE);
+         }
+         else if(!strcmp(argv[0], "--incremental"))
+         {
+            argv++;
+            argc--;
+            if(!argc)
+               return(FALSE);
+            strncpy(opts->ckptfile, argv[0], MAXBUFF);
+            opts->ckptfile[MAXBUFF-1] = '\0';
+         }
+         else if(!strcmp(argv[0], "--hits"))
+         {
+            argv++;
+            argc--;
+            if(!argc)
+               return(FALSE);
+            strncpy(opts->hitsfile, argv[0], MAXBUFF);
+            opts->hitsfile[MAXBUFF-1] = '\0';
+         }
+         else if(!strcmp(argv[0], "--metrics"))
+         {
+            argv++;
+            argc--;
+            if(!argc)
+               return(FALSE);
+            strncpy(opts->metricsfile, argv[0], MAXBUFF);
+            opts->metricsfile[MAXBUFF-1] = '\0';
+         }
+         else if(!strcmp(argv[0], "--serve"))
+         {
+            argv++;
+            argc--;
+            if(!argc)
+               return(FALSE);
+            strncpy(opts->socketfile, argv[0], MAXBUFF);
+            opts->socketfile[MAXBUFF-1] = '\0';
+         }
+         else if(!strcmp(argv[0], "--null"))
+         {
+            argv++;
+            argc--;
+            if(!argc || !sscanf(argv[0], "%d", &(opts->nnull)) ||
+               (opts->nnull < 1))
+               return(FALSE);
+         }
+         else if(!strcmp(argv[0], "--null-corpus"))
+         {
+            opts->nullcorpus = TRUE;
+         }
+         else if(!strcmp(argv[0], "--organisms"))
+         {
+            opts->organisms = TRUE;
+         }
+         else if(!strcmp(argv[0], "--dna"))
+         {
+            opts->dna = TRUE;
+         }
+         else if(!strcmp(argv[0], "--benchmark"))
+         {
+            opts->benchmark = TRUE;
+         }
+         else if(!strcmp(argv[0], "--bed"))
+         {
+            opts->bed = TRUE;
+         }
+         else if(!strcmp(argv[0], "--merge"))
+         {
+            opts->merge = TRUE;
+         }
+         else if (argv [0][2]!='\0')
          {
            return(FALSE);
          }
@@ -451,29 +8276,67 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
                return(FALSE);
                break;
             case 'v':
-               *verbose = TRUE;
+               opts->verbose = TRUE;
                break;
             case 'x':
-               *exact = FALSE;
+               opts->exact = FALSE;
                break;
             case 'q':
-               *quiet = TRUE;
+               opts->quiet = TRUE;
+               break;
+            case 'T':
+               opts->selftest = TRUE;
+               break;
+            case 'H':
+               opts->histogram = TRUE;
+               break;
+            case 'S':
+               argv++;
+               argc--;
+               if(!argc)
+                  return(FALSE);
+               strncpy(opts->patfile, argv[0], MAXBUFF);
+               opts->patfile[MAXBUFF-1] = '\0';
+               break;
+            case 'b':
+               argv++;
+               argc--;
+               if(!argc)
+                  return(FALSE);
+               strncpy(opts->histfile, argv[0], MAXBUFF);
+               opts->histfile[MAXBUFF-1] = '\0';
                break;
             case 's':
                argv++;
                argc--;
-               strncpy(pattern, argv[0], MAXPATLEN);
+               strncpy(opts->pattern, argv[0], MAXPATLEN);
+               opts->pattern[MAXPATLEN-1] = '\0';
                break;
             case 'n':
                argv++;
                argc--;
-               if(!sscanf(argv[0], "%d", minpat))
+               if(!sscanf(argv[0], "%d", &(opts->minpat)))
                   return(FALSE);
                break;
             case 'm':
                argv++;
                argc--;
-               if(!sscanf(argv[0], "%d", maxpat))
+               if(!sscanf(argv[0], "%d", &(opts->maxpat)))
+                  return(FALSE);
+               break;
+            case 'k':
+               argv++;
+               argc--;
+               if(!argc || !sscanf(argv[0], "%d", &(opts->mismatches)) ||
+                  (opts->mismatches < 0) || 
+                  (opts->mismatches > MAXMISMATCHES))
+                  return(FALSE);
+               break;
+            case 't':
+               argv++;
+               argc--;
+               if(!argc || !sscanf(argv[0], "%d", &(opts->nthreads)) ||
+                  (opts->nthreads < 1) || (opts->nthreads > MAXTHREADS))
                   return(FALSE);
                break;
             default:
@@ -482,33 +8345,79 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
             }
          }         
       }
+      else if(opts->merge)
+      {
+         /* The rest are all partial result files                       */
+         opts->partfiles  = argv;
+         opts->npartfiles = argc;
+         return(TRUE);
+      }
+      else if(opts->organisms)
+      {
+         /* Only the counts are given for each file                     */
+         if(opts->verbose || opts->histogram || opts->hitsfile[0] ||
+            opts->nshards || opts->ckptfile[0] || opts->nnull ||
+            opts->socketfile[0] || opts->benchmark || opts->dna ||
+            opts->corpusfile[0] || opts->metricsfile[0])
+            return(FALSE);
+
+         /* The rest are all input files or directories                 */
+         opts->orgfiles  = argv;
+         opts->norgfiles = argc;
+         return(TRUE);
+      }
       else
       {
          /* Check that there are 1 or 2 arguments left                  */
          if(argc > 2)
             return(FALSE);
-         
+
          /* Copy the first to infile                                    */
-         if(argc)
-         {
-            strcpy(infile, argv[0]);
-            argc--;
-            argv++;
-         }
+         strcpy(infile, argv[0]);
+         argc--;
+         argv++;
          
          /* If there's another, copy it to outfile                      */
          if(argc)
-         {
             strcpy(outfile, argv[0]);
-            argc--;
-            argv++;
-         }
-         
-         return(TRUE);
+         break;
       }
       
       argc--;
       argv++;
    }
+
+   /* These checks apply whether the input is a file or stdin           */
+
+   /* A checkpoint covers the whole file                                */
+   if(opts->ckptfile[0] && opts->nshards)
+      return(FALSE);
+
+   /* There are no patterns with -H                                     */
+   if((opts->hitsfile[0] || opts->nnull) && opts->histogram)
+      return(FALSE);
+
+   /* The null model gives counts for the whole file                    */
+   if(opts->nnull && (opts->verbose || opts->nshards || 
+                      opts->ckptfile[0] || opts->hitsfile[0]))
+      return(FALSE);
+   if(opts->nullcorpus && !opts->nnull)
+      return(FALSE);
+
+   /* -k only applies to the patterns from -s and -S                    */
+   if(opts->mismatches && 
+      ((!opts->pattern[0] && !opts->patfile[0]) || 
+       opts->histogram || opts->dna || opts->socketfile[0] ||
+       opts->benchmark))
+      return(FALSE);
+
+   /* --dna only counts the runs of each base                           */
+   if(opts->dna && (opts->pattern[0] || opts->patfile[0] ||
+                    opts->histogram || opts->hitsfile[0] ||
+                    opts->nshards || opts->ckptfile[0] ||
+                    opts->nnull || opts->socketfile[0] ||
+                    opts->benchmark || opts->corpusfile[0]))
+      return(FALSE);
+   
    return(TRUE);
 }
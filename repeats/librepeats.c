@@ -0,0 +1,1383 @@
+/*************************************************************************
+
+   Program:    librepeats
+   File:       librepeats.c
+
+   Version:    V1.3
+   Date:       17.10.26
+   Function:   Scan sequences for indirect repeats
+
+   Copyright:  (c) UCL / Dr. Andrew C. R. Martin 2026
+   Author:     Dr. Andrew C. R. Martin
+   Address:    Biomolecular Structure & Modelling Unit,
+               Institute of Structural & Molecular Biology,
+               University College,
+               Gower Street,
+               London.
+               WC1E 6BT.
+   EMail:      andrew.martin@ucl.ac.uk
+               andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain, but it may be copied
+   according to the conditions laid out in the accompanying file
+   COPYING.DOC
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If someone
+   else breaks this code, I don't want to be blamed for code that does not
+   work!
+
+   The code may not be sold commercially or included as part of a
+   commercial product except as described in the file COPYING.DOC.
+
+**************************************************************************
+
+   Description:
+   ============
+   The matching code from indirectrepeats as a library which may be 
+   linked into other programs.
+
+   A scanner is made with rpNewScanner() and given patterns with 
+   rpAddPattern(). With no patterns, it finds every alternating pattern
+   (cXcX...c) of every residue with minpat..maxpat occurrences of the
+   residue, set with rpSetRuns(). Sequences are passed to rpScan() as a
+   pointer and a length, so they need not be terminated or copied, and
+   each hit is passed to a callback. rpScanInto() fills an array of 
+   hits instead.
+
+   Everything a scan needs is held in the scanner and there are no 
+   global or static variables, so any number of scanners may be used
+   at the same time in different threads. A scanner must only be used 
+   by one thread at a time.
+
+   Programs using the library need only include librepeats.h. The lower
+   level functions, declared in rpkernels.h, are also used by 
+   indirectrepeats. rpFindApproxStarts() also finds matches with a 
+   number of substitutions.
+
+**************************************************************************
+
+   Usage:
+   ======
+   cc -O2 -mavx2 -c librepeats.c
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0   16.10.26 Original. Matching code moved from indirectrepeats.c
+                   By: ACRM
+   V1.1   16.10.26 Added FindApproxStarts()
+   V1.2   17.10.26 Running out of memory for the masks is returned as
+                   an error rather than exiting
+   V1.3   17.10.26 Functions used only here are static. Those shared with
+                   indirectrepeats have an rp prefix and are declared in 
+                   rpkernels.h. The API uses int rather than BOOL
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+#include "librepeats.h"
+#include "rpkernels.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define MAXRUNPAT  ((INT_MAX / NRESIDUES) - 1) /* Largest maxpat        */
+
+/************************************************************************/
+/* Type definitions
+*/
+typedef struct
+{
+   char     *pattern;   /* The pattern as given                         */
+   int      patlen;     /* Length of the pattern                        */
+   BOOL     isperiodic; /* Matched with periodic rather than pattern    */
+   PERIODIC periodic;   /* Compiled pattern                             */
+}  RPPATTERN;
+
+struct rpscanner
+{
+   int        resindex[256]; /* Residue to index in RESIDUES (or -1)    */
+   BOOL       exact;         /* Only report exact matches               */
+   int        minpat,        /* Occurrences of each residue when there  */
+              maxpat,        /* are no patterns                         */
+              npatterns,     /* Patterns from rpAddPattern()            */
+              maxpatterns;   /* Allocated size of patterns              */
+   RPPATTERN  *patterns;
+   MATCHMASKS masks;         /* Work space for the bitmask kernel       */
+};
+
+typedef struct
+{
+   RPHIT *hits;      /* Hits for rpScanInto()                           */
+   long  nhits,      /* Number of hits found                            */
+         maxhits;    /* Size of hits                                    */
+}  HITBUFFER;
+
+/************************************************************************/
+/* Prototypes
+*/
+static int StoreHit(const RPHIT *hit, void *data);
+static long ScanPatterns(RPSCANNER *scanner, const char *sequence, 
+                         int seqlen, RPHITFUNC func, void *data);
+static long ScanRuns(RPSCANNER *scanner, const char *sequence, 
+                     int seqlen, RPHITFUNC func, void *data);
+static BOOL GrowMatchMasks(MATCHMASKS *masks, size_t need);
+static void BuildResidueMask(const char *sequence, int seqlen, char ch,
+                             uint64_t *mask);
+static void BuildClassMask(const char *sequence, int seqlen, 
+                           PERIODIC *periodic, MATCHMASKS *masks, 
+                           size_t need);
+static uint64_t MaskBits(uint64_t *mask, int bit);
+
+/************************************************************************/
+/*>RPSCANNER *rpNewScanner(int exact)
+   ----------------------------------
+   Input:   int       exact     Only report exact matches (non-zero)
+   Returns: RPSCANNER *         The scanner (NULL if out of memory)
+
+   Makes a scanner. With no patterns it finds the alternating patterns 
+   of every residue with 1..10 occurrences.
+
+   16.10.26  Original   By: ACRM
+*/
+RPSCANNER *rpNewScanner(int exact)
+{
+   RPSCANNER *scanner;
+
+   if((scanner = (RPSCANNER *)calloc(1, sizeof(RPSCANNER))) == NULL)
+      return(NULL);
+
+   rpBuildResidueIndex(scanner->resindex);
+   scanner->exact  = (exact != 0);
+   scanner->minpat = 1;
+   scanner->maxpat = 10;
+   return(scanner);
+}
+
+/************************************************************************/
+/*>void rpFreeScanner(RPSCANNER *scanner)
+   --------------------------------------
+   I/O:     RPSCANNER *scanner  The scanner
+
+   Frees a scanner and its patterns
+
+   16.10.26  Original   By: ACRM
+*/
+void rpFreeScanner(RPSCANNER *scanner)
+{
+   int i;
+
+   if(scanner == NULL)
+      return;
+
+   for(i=0; i<scanner->npatterns; i++)
+      free(scanner->patterns[i].pattern);
+   free(scanner->patterns);
+   rpFreeMatchMasks(&(scanner->masks));
+   free(scanner);
+}
+
+/************************************************************************/
+/*>int rpAddPattern(RPSCANNER *scanner, const char *pattern)
+   ---------------------------------------------------------
+   I/O:     RPSCANNER *scanner  The scanner
+   Input:   char      *pattern  Pattern such as AXA, AXXA or [ST]X[ST]
+   Returns: int                 Index of the pattern for the hits (-1 if
+                                it is not valid or out of memory)
+
+   Adds a pattern to the scanner. Once a pattern has been added, only 
+   the patterns are searched.
+
+   16.10.26  Original   By: ACRM
+*/
+int rpAddPattern(RPSCANNER *scanner, const char *pattern)
+{
+   RPPATTERN *newpatterns, *pat;
+   PERIODIC  periodic;
+   int       compiled;
+
+   if((pattern == NULL) || (pattern[0] == '\0') ||
+      ((compiled = rpCompilePattern(pattern, &periodic)) < 0))
+      return(-1);
+
+   if(scanner->npatterns == scanner->maxpatterns)
+   {
+      int maxpatterns = scanner->maxpatterns ? 
+                        2 * scanner->maxpatterns : 16;
+      
+      if((newpatterns = (RPPATTERN *)realloc(scanner->patterns,
+                                             maxpatterns * 
+                                             sizeof(RPPATTERN))) == NULL)
+         return(-1);
+      scanner->patterns    = newpatterns;
+      scanner->maxpatterns = maxpatterns;
+   }
+
+   pat = &(scanner->patterns[scanner->npatterns]);
+   if((pat->pattern = (char *)malloc(strlen(pattern)+1)) == NULL)
+      return(-1);
+   strcpy(pat->pattern, pattern);
+   pat->isperiodic = (compiled == 1);
+   pat->periodic   = periodic;
+   pat->patlen     = pat->isperiodic ? periodic.patlen : strlen(pattern);
+
+   return(scanner->npatterns++);
+}
+
+/************************************************************************/
+/*>int rpSetRuns(RPSCANNER *scanner, int minpat, int maxpat)
+   ---------------------------------------------------------
+   I/O:     RPSCANNER *scanner  The scanner
+   Input:   int       minpat    Fewest occurrences of the residue
+            int       maxpat    Most occurrences of the residue
+   Returns: int                 Valid? (1 or 0)
+
+   Sets the range of alternating patterns found when there are no 
+   patterns. The hits for a residue with n occurrences have the pattern
+   index residue*(maxpat+1) + n where residue is the index in RESIDUES.
+
+   16.10.26  Original   By: ACRM
+*/
+int rpSetRuns(RPSCANNER *scanner, int minpat, int maxpat)
+{
+   if((minpat < 1) || (maxpat < minpat) || (maxpat > MAXRUNPAT))
+      return(FALSE);
+
+   scanner->minpat = minpat;
+   scanner->maxpat = maxpat;
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>int rpNumPatterns(RPSCANNER *scanner)
+   -------------------------------------
+   Input:   RPSCANNER *scanner  The scanner
+   Returns: int                 One more than the largest pattern index
+                                in the hits
+
+   16.10.26  Original   By: ACRM
+*/
+int rpNumPatterns(RPSCANNER *scanner)
+{
+   if(scanner->npatterns)
+      return(scanner->npatterns);
+   return(NRESIDUES * (scanner->maxpat + 1));
+}
+
+/************************************************************************/
+/*>int rpPatternName(RPSCANNER *scanner, int pattern, char *name,
+                     size_t size)
+   --------------------------------------------------------------
+   Input:   RPSCANNER *scanner  The scanner
+            int       pattern   Pattern index from a hit
+   Output:  char      *name     The pattern (e.g. AXAXA)
+   Input:   size_t    size      Size of name
+   Returns: int                 Was the pattern valid and name big 
+                                enough? (1 or 0)
+
+   Gives the pattern for a pattern index. The pattern is given as it
+   was added so name must have room for any residue classes.
+
+   16.10.26  Original   By: ACRM
+   17.10.26  Checks the length of the pattern as given rather than the
+             compiled length
+*/
+int rpPatternName(RPSCANNER *scanner, int pattern, char *name,
+                  size_t size)
+{
+   int    res, n;
+   size_t i, len;
+
+   if((pattern < 0) || (pattern >= rpNumPatterns(scanner)) || !size)
+      return(FALSE);
+
+   if(scanner->npatterns)
+   {
+      len = strlen(scanner->patterns[pattern].pattern);
+      if(len >= size)
+         return(FALSE);
+      memcpy(name, scanner->patterns[pattern].pattern, len + 1);
+      return(TRUE);
+   }
+
+   res = pattern / (scanner->maxpat + 1);
+   n   = pattern % (scanner->maxpat + 1);
+   if(n < 1)
+      return(FALSE);
+   len = 2*(size_t)n - 1;
+   if(len >= size)
+      return(FALSE);
+   for(i=0; i<len; i++)
+      name[i] = (i & 1) ? SPACER : RESIDUES[res];
+   name[len] = '\0';
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>long rpScan(RPSCANNER *scanner, const char *sequence, size_t seqlen,
+               RPHITFUNC func, void *data)
+   -------------------------------------------------------------------
+   I/O:     RPSCANNER *scanner  The scanner
+   Input:   char      *sequence The sequence in upper case (need not be
+                                terminated)
+            size_t    seqlen    Length of the sequence
+            RPHITFUNC func      Called for each hit
+            void      *data     Passed to func
+   Returns: long                Number of hits passed to func (-1 if the
+                                sequence is too long or there is no
+                                memory for the masks)
+
+   Scans a sequence. Hits are given in order of pattern then position
+   for patterns, and in order of position for alternating patterns.
+   The scan stops early if func returns 0.
+
+   16.10.26  Original   By: ACRM
+   17.10.26  Returns -1 if there is no memory for the masks
+*/
+long rpScan(RPSCANNER *scanner, const char *sequence, size_t seqlen,
+            RPHITFUNC func, void *data)
+{
+   if(seqlen > INT_MAX)
+      return(-1);
+
+   if(scanner->npatterns)
+      return(ScanPatterns(scanner, sequence, (int)seqlen, func, data));
+   return(ScanRuns(scanner, sequence, (int)seqlen, func, data));
+}
+
+/************************************************************************/
+/*>long rpScanInto(RPSCANNER *scanner, const char *sequence, 
+                   size_t seqlen, RPHIT *hits, long maxhits)
+   ----------------------------------------------------------
+   I/O:     RPSCANNER *scanner  The scanner
+   Input:   char      *sequence The sequence in upper case
+            size_t    seqlen    Length of the sequence
+   Output:  RPHIT     *hits     The hits
+   Input:   long      maxhits   Size of hits
+   Returns: long                Number of hits found (-1 if the sequence
+                                is too long or there is no memory)
+
+   Scans a sequence into an array of hits. If more than maxhits are 
+   found, only the first maxhits are stored but all are counted so a 
+   bigger array can be given if needed.
+
+   16.10.26  Original   By: ACRM
+*/
+long rpScanInto(RPSCANNER *scanner, const char *sequence, size_t seqlen,
+                RPHIT *hits, long maxhits)
+{
+   HITBUFFER buffer;
+
+   buffer.hits    = hits;
+   buffer.nhits   = 0;
+   buffer.maxhits = maxhits;
+   if(rpScan(scanner, sequence, seqlen, StoreHit, &buffer) < 0)
+      return(-1);
+   return(buffer.nhits);
+}
+
+/************************************************************************/
+/*>int StoreHit(const RPHIT *hit, void *data)
+   ------------------------------------------
+   Input:   RPHIT     *hit      A hit
+   I/O:     void      *data     HITBUFFER for the hits
+   Returns: int                 1 to carry on scanning
+
+   Hit callback for rpScanInto()
+
+   16.10.26  Original   By: ACRM
+*/
+static int StoreHit(const RPHIT *hit, void *data)
+{
+   HITBUFFER *buffer = (HITBUFFER *)data;
+
+   if(buffer->nhits < buffer->maxhits)
+      buffer->hits[buffer->nhits] = *hit;
+   buffer->nhits++;
+   return(1);
+}
+
+/************************************************************************/
+/*>long ScanPatterns(RPSCANNER *scanner, const char *sequence, 
+                     int seqlen, RPHITFUNC func, void *data)
+   ------------------------------------------------------------
+   I/O:     RPSCANNER *scanner  The scanner
+   Input:   char      *sequence The sequence
+            int       seqlen    Length of the sequence
+            RPHITFUNC func      Called for each hit
+            void      *data     Passed to func
+   Returns: long                Number of hits passed to func (-1 if 
+                                there is no memory for the masks)
+
+   Finds the starts of each pattern with the bitmask kernel and passes
+   them to func. For non-exact matching, each hit is checked to see if
+   it is also an exact match.
+
+   16.10.26  Original (from ScanSequenceForPattern())   By: ACRM
+   17.10.26  Returns -1 if the masks can't be grown
+*/
+static long ScanPatterns(RPSCANNER *scanner, const char *sequence, 
+                         int seqlen, RPHITFUNC func, void *data)
+{
+   RPPATTERN *pat;
+   RPHIT     hit;
+   long      nhits = 0;
+   int       i, nwords, start;
+
+   for(i=0; i<scanner->npatterns; i++)
+   {
+      pat = &(scanner->patterns[i]);
+      if(pat->isperiodic)
+         nwords = rpFindPeriodicStarts(sequence, seqlen, &(pat->periodic),
+                                       scanner->exact, &(scanner->masks));
+      else
+         nwords = rpFindPatternStarts(sequence, seqlen, pat->pattern, 
+                                      pat->patlen, scanner->exact, 
+                                      &(scanner->masks));
+      if(nwords < 0)
+         return(-1);
+
+      for(start=rpNextStart(scanner->masks.starts, nwords, 0);
+          start >= 0;
+          start=rpNextStart(scanner->masks.starts, nwords, start+1))
+      {
+         hit.pattern = i;
+         hit.start   = start;
+         hit.end     = start + pat->patlen - 1;
+         hit.exact   = scanner->exact || 
+                       (pat->isperiodic ?
+                        rpMatchPeriodicAt(sequence, seqlen, 
+                                          &(pat->periodic), start, TRUE) :
+                        rpCheckBounds(sequence, seqlen, pat->pattern, 
+                                      pat->patlen, start));
+         nhits++;
+         if(!(*func)(&hit, data))
+            return(nhits);
+      }
+   }
+   return(nhits);
+}
+
+/************************************************************************/
+/*>long ScanRuns(RPSCANNER *scanner, const char *sequence, int seqlen,
+                 RPHITFUNC func, void *data)
+   -------------------------------------------------------------------
+   I/O:     RPSCANNER *scanner  The scanner
+   Input:   char      *sequence The sequence
+            int       seqlen    Length of the sequence
+            RPHITFUNC func      Called for each hit
+            void      *data     Passed to func
+   Returns: long                Number of hits passed to func
+
+   Finds every maximal alternating run with rpNextRun() and passes the 
+   matches to func. A run containing m occurrences of a residue 
+   contains (m-n+1) non-exact matches to the pattern with n 
+   occurrences. An exact match is only made by the full run.
+
+   16.10.26  Original (from ScanSequenceForRuns())   By: ACRM
+*/
+static long ScanRuns(RPSCANNER *scanner, const char *sequence, 
+                     int seqlen, RPHITFUNC func, void *data)
+{
+   RPHIT hit;
+   long  nhits = 0;
+   int   npat  = scanner->maxpat + 1,
+         pos   = 0,
+         r, m, n, k, top;
+   BOOL  isexact;
+
+   while(rpNextRun(scanner->resindex, sequence, seqlen, &pos, &r, &m, 
+                   &isexact))
+   {
+      if(scanner->exact)
+      {
+         /* Only the whole run can match                                */
+         if(isexact && (m >= scanner->minpat) && (m <= scanner->maxpat))
+         {
+            hit.pattern = r*npat + m;
+            hit.start   = pos - 1;
+            hit.end     = pos + 2*m - 3;
+            hit.exact   = TRUE;
+            nhits++;
+            if(!(*func)(&hit, data))
+               return(nhits);
+         }
+      }
+      else
+      {
+         top = (m < scanner->maxpat) ? m : scanner->maxpat;
+         for(n=scanner->minpat; n<=top; n++)
+         {
+            for(k=0; k<=m-n; k++)
+            {
+               hit.pattern = r*npat + n;
+               hit.start   = pos - 1 + 2*k;
+               hit.end     = hit.start + 2*n - 2;
+               hit.exact   = isexact && (n == m);
+               nhits++;
+               if(!(*func)(&hit, data))
+                  return(nhits);
+            }
+         }
+      }
+   }
+   return(nhits);
+}
+
+/************************************************************************/
+/*>void rpBuildResidueIndex(int *resindex)
+   ---------------------------------------
+   Output:  int    *resindex    256 entries giving the index in RESIDUES
+                                of each character (-1 if not a residue)
+
+   16.10.26  Original (from InitResidueIndex())   By: ACRM
+*/
+void rpBuildResidueIndex(int *resindex)
+{
+   char *letters = RESIDUES;
+   int  i;
+   
+   for(i=0; i<256; i++)
+      resindex[i] = (-1);
+   for(i=0; letters[i]; i++)
+      resindex[(unsigned char)letters[i]] = i;
+}
+
+/************************************************************************/
+/*>BOOL rpNextRun(const int *resindex, const char *sequence, int seqlen, 
+                  int *pos, int *res, int *len, BOOL *exact)
+   ------------------------------------------------------------------------
+   Input:   int     *resindex   Residue index from rpBuildResidueIndex()
+            char    *sequence   The sequence
+            int     seqlen      Length of the sequence
+   I/O:     int     *pos        Offset to search from (start at 0); set
+                                to one past the start of the run ready
+                                for the next call
+   Output:  int     *res        Residue index in RESIDUES
+            int     *len        Number of occurrences of the residue
+            BOOL    *exact      Is the run an exact match?
+   Returns: BOOL                Was a run found?
+
+   Finds the next maximal alternating run (cXcX...c) of any residue.
+   Every occurrence of a residue belongs to exactly one run so the total
+   work over a sequence is linear in its length. A run is not an exact 
+   match if rpCheckBounds() would reject it: that is, if it starts at 
+   offset 1 and is preceded by c, or ends 2 from the C-terminus and is
+   followed by c.
+
+   16.10.26  Original (in ScanSequenceForRuns())   By: ACRM
+   16.10.26  Moved to librepeats. Added resindex
+*/
+BOOL rpNextRun(const int *resindex, const char *sequence, int seqlen, 
+               int *pos, int *res, int *len, BOOL *exact)
+{
+   int  p, q, m, r;
+   char c;
+
+   for(p=*pos; p<seqlen; p++)
+   {
+      c = sequence[p];
+      if((r = resindex[(unsigned char)c]) < 0)
+         continue;
+
+      /* Skip this if it continues a run started earlier                */
+      if((p >= 2) && (sequence[p-1] != c) && (sequence[p-2] == c))
+         continue;
+
+      /* Walk along the run to find its length                          */
+      for(q=p, m=1; 
+          (q+2 < seqlen) && (sequence[q+1] != c) && (sequence[q+2] == c);
+          q+=2, m++);
+
+      *pos   = p+1;
+      *res   = r;
+      *len   = m;
+      *exact = !((p == 1) && (sequence[0] == c)) &&
+               !((q == seqlen-2) && (sequence[seqlen-1] == c));
+      return(TRUE);
+   }
+
+   *pos = seqlen;
+   return(FALSE);
+}
+
+/************************************************************************/
+/*>int rpFindPatternStarts(const char *sequence, int seqlen, 
+                           const char *pattern, int patlen, BOOL exact, 
+                           MATCHMASKS *masks)
+   ------------------------------------------------------------------
+   Input:   char       *sequence  The sequence
+            int        seqlen     Length of the sequence
+            char       *pattern   Pattern of the form AXAXA
+            int        patlen     Length of the pattern
+            BOOL       exact      Only keep exact matches
+   I/O:     MATCHMASKS *masks     Masks (grown as needed); on return
+                                  masks->starts has a bit set for each
+                                  offset where the pattern starts
+   Returns: int                   Number of words in masks->starts
+                                  (-1 if there is no memory)
+
+   Finds every offset at which SearchSequenceForPattern() would find 
+   the pattern. A mask is built with a bit set where the sequence is 
+   the pattern residue. The starts for a block of 64 offsets are then 
+   found by ANDing that mask shifted by each even pattern position and
+   its complement shifted by each odd pattern position. Almost all 
+   blocks become zero after the first couple of positions so the work
+   is linear in the sequence length.
+
+   For exact matching, the tests made by rpCheckBounds() are also made
+   on whole blocks from the residue mask. A match is removed if the
+   two residues before it (or after it) extend the pattern, or if it
+   is one residue from either end and that residue is the pattern 
+   residue.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Added exact
+   16.10.26  Masks are grown by GrowMatchMasks()
+   16.10.26  Moved to librepeats
+   17.10.26  Returns -1 if there is no memory for the masks
+*/
+int rpFindPatternStarts(const char *sequence, int seqlen, 
+                        const char *pattern, int patlen, BOOL exact, 
+                        MATCHMASKS *masks)
+{
+   uint64_t starts, bits, *eq, 
+            before, after;
+   size_t   need;
+   int      nwords, w, j, last;
+
+   nwords = (seqlen + 63) / 64;
+   
+   /* Room for the pattern to run off the end of the last block         */
+   need = nwords + (patlen / 64) + 2;
+   if(!GrowMatchMasks(masks, need))
+      return(-1);
+   eq = masks->eq;
+   
+   BuildResidueMask(sequence, seqlen, pattern[0], eq);
+   for(w=nwords; w<need; w++)
+      eq[w] = 0;
+
+   for(w=0; w<nwords; w++)
+   {
+      starts = ~(uint64_t)0;
+      for(j=0; (j<patlen) && starts; j++)
+      {
+         bits = MaskBits(eq, 64*w + j);
+         if(!(j & 1))
+            starts &= bits;
+         else if(j < patlen-1)
+            starts &= ~bits;
+      }
+
+      if(exact && starts)
+      {
+         /* Pattern continues before or after the match                 */
+         before = ~MaskBits(eq, 64*w - 1) & MaskBits(eq, 64*w - 2);
+         after  = ~MaskBits(eq, 64*w + patlen) & 
+                   MaskBits(eq, 64*w + patlen + 1);
+
+         /* Only one residue before or after the match                  */
+         if(w == 0)
+            before |= (eq[0] & 1) << 1;
+         last = seqlen - 1 - patlen;
+         if((last >= 64*w) && (last < 64*w + 64) && 
+            (MaskBits(eq, seqlen - 1) & 1))
+            after |= (uint64_t)1 << (last - 64*w);
+         
+         starts &= ~(before | after);
+      }
+      masks->starts[w] = starts;
+   }
+
+   /* Clear starts where the pattern would run off the end              */
+   last = seqlen - patlen;
+   for(w=0; w<nwords; w++)
+   {
+      if(64*w > last)
+         masks->starts[w] = 0;
+      else if(64*w + 63 > last)
+         masks->starts[w] &= (~(uint64_t)0) >> (63 - (last - 64*w));
+   }
+
+   return(nwords);
+}
+
+/************************************************************************/
+/*>int rpFindPeriodicStarts(const char *sequence, int seqlen, 
+                            PERIODIC *periodic, BOOL exact, 
+                            MATCHMASKS *masks)
+   ------------------------------------------------------------------------
+   Input:   char       *sequence  The sequence
+            int        seqlen     Length of the sequence
+            PERIODIC   *periodic  The compiled pattern
+            BOOL       exact      Only keep exact matches
+   I/O:     MATCHMASKS *masks     Masks (grown as needed); on return
+                                  masks->starts has a bit set for each
+                                  offset where the pattern starts
+   Returns: int                   Number of words in masks->starts
+                                  (-1 if there is no memory)
+
+   The equivalent of rpFindPatternStarts() for a PERIODIC pattern. The 
+   residue mask has a bit set for every residue in the class. From this
+   an anchor mask is made once for the sequence with a bit set where a
+   class residue is followed by a whole spacer with no class residues 
+   in it. The starts are then found by ANDing the anchor mask shifted 
+   by each repeated position but the last, and the residue mask at the
+   last. This takes nrepeat steps per block whatever the period so, 
+   once the anchor mask is made, matching AXXXA is no more work than 
+   matching AXA.
+
+   For exact matching, a match is removed if there is an anchor one 
+   period before it or if its last repeated residue is an anchor with
+   a class residue one period after it.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Moved to librepeats
+   16.10.26  Residue mask made by BuildClassMask()
+   17.10.26  Returns -1 if there is no memory for the masks
+*/
+int rpFindPeriodicStarts(const char *sequence, int seqlen, 
+                         PERIODIC *periodic, BOOL exact, MATCHMASKS *masks)
+{
+   uint64_t starts, occupied, 
+            *eq, *anchors;
+   size_t   need;
+   int      nwords, w, i, j, last,
+            k = periodic->period,
+            n = periodic->nrepeat;
+
+   nwords = (seqlen + 63) / 64;
+
+   /* Room for the pattern and one more period to run off the end       */
+   need = nwords + ((periodic->patlen + k) / 64) + 2;
+   if(!GrowMatchMasks(masks, need))
+      return(-1);
+   eq      = masks->eq;
+   anchors = masks->anchors;
+
+   BuildClassMask(sequence, seqlen, periodic, masks, need);
+
+   /* Anchor mask                                                       */
+   for(w=0; w<nwords; w++)
+   {
+      occupied = 0;
+      for(j=1; j<k; j++)
+         occupied |= MaskBits(eq, 64*w + j);
+      anchors[w] = eq[w] & ~occupied;
+   }
+   for(w=nwords; w<need; w++)
+      anchors[w] = 0;
+
+   for(w=0; w<nwords; w++)
+   {
+      starts = eq[w];
+      for(i=0; (i<n-1) && starts; i++)
+         starts &= MaskBits(anchors, 64*w + i*k);
+      if(starts)
+         starts &= MaskBits(eq, 64*w + (n-1)*k);
+
+      if(exact && starts)
+      {
+         starts &= ~MaskBits(anchors, 64*w - k);
+         starts &= ~(MaskBits(anchors, 64*w + (n-1)*k) & 
+                     MaskBits(eq, 64*w + n*k));
+      }
+      masks->starts[w] = starts;
+   }
+
+   /* Clear starts where the pattern would run off the end              */
+   last = seqlen - periodic->patlen;
+   for(w=0; w<nwords; w++)
+   {
+      if(64*w > last)
+         masks->starts[w] = 0;
+      else if(64*w + 63 > last)
+         masks->starts[w] &= (~(uint64_t)0) >> (63 - (last - 64*w));
+   }
+
+   return(nwords);
+}
+
+/************************************************************************/
+/*>int rpFindApproxStarts(const char *sequence, int seqlen, 
+                          PERIODIC *periodic, BOOL exact, 
+                          MATCHMASKS *masks)
+   ------------------------------------------------------------------------
+   Input:   char       *sequence  The sequence
+            int        seqlen     Length of the sequence
+            PERIODIC   *periodic  The compiled pattern
+            BOOL       exact      Only keep exact matches
+   I/O:     MATCHMASKS *masks     Masks (grown as needed); on return
+                                  masks->starts has a bit set for each
+                                  offset where the pattern starts
+   Returns: int                   Number of words in masks->starts
+                                  (-1 if there is no memory)
+
+   The equivalent of rpFindPeriodicStarts() allowing up to 
+   periodic->mismatches substitutions. A substitution is a repeated
+   position which is not in the class or a spacer position which is.
+   
+   This is shift-and with error states, run across the 64 offsets in a
+   block rather than across the pattern so that patterns of any length
+   may be used. errors[d] has a bit set for each offset which has had 
+   exactly d substitutions so far. At each pattern position, the 
+   mismatch mask (the residue mask shifted by the position, inverted 
+   for a repeated position) moves each offset up one state, and those
+   in the last state are dropped. A block stops as soon as no offset 
+   is left, so the work is linear in the sequence length and a little
+   more than for an exact match.
+
+   For exact matching, a match is removed if the class residue one 
+   period before it or after it, with a clean spacer between, extends
+   the repeat, as in rpMatchPeriodicAt().
+
+   16.10.26  Original   By: ACRM
+   17.10.26  Returns -1 if there is no memory for the masks
+*/
+int rpFindApproxStarts(const char *sequence, int seqlen, 
+                       PERIODIC *periodic, BOOL exact, MATCHMASKS *masks)
+{
+   uint64_t errors[MAXMISMATCHES+1],
+            alive, x, before, after, 
+            *eq;
+   size_t   need;
+   int      nwords, w, j, d, last, end,
+            k      = periodic->period,
+            maxerr = periodic->mismatches;
+
+   if(maxerr > MAXMISMATCHES)
+      maxerr = MAXMISMATCHES;
+   nwords = (seqlen + 63) / 64;
+   
+   /* Room for the pattern and one more period to run off the end       */
+   need = nwords + ((periodic->patlen + k) / 64) + 2;
+   if(!GrowMatchMasks(masks, need))
+      return(-1);
+   eq = masks->eq;
+   BuildClassMask(sequence, seqlen, periodic, masks, need);
+
+   end = periodic->patlen - 1;
+   for(w=0; w<nwords; w++)
+   {
+      alive     = ~(uint64_t)0;
+      errors[0] = alive;
+      for(d=1; d<=maxerr; d++)
+         errors[d] = 0;
+      
+      for(j=0; (j<periodic->patlen) && alive; j++)
+      {
+         x = MaskBits(eq, 64*w + j);
+         if(!(j % k))
+            x = ~x;
+         
+         alive &= ~(errors[maxerr] & x);
+         for(d=maxerr; d>0; d--)
+            errors[d] = (errors[d] & ~x) | (errors[d-1] & x);
+         errors[0] &= ~x;
+      }
+
+      if(exact && alive)
+      {
+         before = MaskBits(eq, 64*w - k);
+         after  = MaskBits(eq, 64*w + end + k);
+         for(j=1; j<k; j++)
+         {
+            before &= ~MaskBits(eq, 64*w - j);
+            after  &= ~MaskBits(eq, 64*w + end + j);
+         }
+         alive &= ~(before | after);
+      }
+      masks->starts[w] = alive;
+   }
+
+   /* Clear starts where the pattern would run off the end              */
+   last = seqlen - periodic->patlen;
+   for(w=0; w<nwords; w++)
+   {
+      if(64*w > last)
+         masks->starts[w] = 0;
+      else if(64*w + 63 > last)
+         masks->starts[w] &= (~(uint64_t)0) >> (63 - (last - 64*w));
+   }
+
+   return(nwords);
+}
+
+/************************************************************************/
+/*>int rpCompilePattern(const char *pattern, PERIODIC *periodic)
+   -------------------------------------------------------
+   Input:   char     *pattern   The pattern
+   Output:  PERIODIC *periodic  The compiled pattern
+   Returns: int                 1 if the pattern was compiled, 0 if it
+                                is a simple pattern which should be
+                                searched with rpFindPatternStarts(), -1 
+                                if it is not valid
+
+   A pattern is made of repeated residues separated by spacers of X.
+   A repeated residue may be a single residue or a class of residues
+   in square brackets. All the repeated residues must be the same and
+   all the spacers must be the same length. So AXXA, [ST]X[ST]X[ST] 
+   and [DE]XXX[DE] are compiled. A spacer position may not be any of 
+   the repeated residues.
+
+   Patterns with a single residue and a spacer of one (AXA) are left 
+   as simple patterns, as are any other patterns without a class, so
+   that they are matched exactly as before.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Moved to librepeats
+*/
+int rpCompilePattern(const char *pattern, PERIODIC *periodic)
+{
+   const char *p, *end;
+   char       residues[MAXAA+1];
+   int  pos      = 0,
+        last     = (-1),
+        period   = 0,
+        nres;
+   BOOL hasclass = (strchr(pattern, '[') != NULL);
+
+   memset(periodic, 0, sizeof(PERIODIC));
+
+   for(p=pattern; *p; p++, pos++)
+   {
+      if(*p == SPACER)
+         continue;
+
+      /* Read a repeated residue or class                               */
+      if(*p == '[')
+      {
+         if((end = strchr(p, ']')) == NULL)
+            return(-1);
+         nres = end - p - 1;
+         if((nres < 1) || (nres > MAXAA))
+            return(-1);
+         strncpy(residues, p+1, nres);
+         p = end;
+      }
+      else
+      {
+         residues[0] = *p;
+         nres = 1;
+      }
+      residues[nres] = '\0';
+      
+      if(periodic->nrepeat == 0)
+      {
+         /* The pattern must start with the repeated residue            */
+         if(pos != 0)
+            return(hasclass ? (-1) : 0);
+         strcpy(periodic->residues, residues);
+         for(end=residues; *end; end++)
+         {
+            if((*end == SPACER) || (*end == '[') || (*end == ']'))
+               return(hasclass ? (-1) : 0);
+            periodic->inclass[(unsigned char)*end] = 1;
+         }
+      }
+      else
+      {
+         /* Same residues and spacing as before                         */
+         if(strcmp(residues, periodic->residues) ||
+            ((period != 0) && (pos - last != period)) ||
+            (pos - last < 2))
+            return(hasclass ? (-1) : 0);
+         period = pos - last;
+      }
+      last = pos;
+      periodic->nrepeat++;
+   }
+
+   /* Must end with the repeated residue                                */
+   if((periodic->nrepeat == 0) || (last != pos-1))
+      return(hasclass ? (-1) : 0);
+
+   periodic->period = period ? period : 2;
+   periodic->patlen = pos;
+
+   if(!hasclass && (periodic->period == 2 || periodic->nrepeat == 1))
+      return(0);
+   return(1);
+}
+
+/************************************************************************/
+/*>BOOL rpMatchPeriodicAt(const char *sequence, int seqlen, 
+                          PERIODIC *periodic, int offset, BOOL exact)
+   ----------------------------------------------------------------------
+   Input:   char     *sequence  The sequence
+            int      seqlen     Length of the sequence
+            PERIODIC *periodic  The compiled pattern
+            int      offset     Offset into the sequence
+            BOOL     exact      Do exact matching
+   Returns: BOOL                Does the pattern match at offset?
+
+   Tests a PERIODIC pattern at one offset, one residue at a time, 
+   allowing periodic->mismatches substitutions. This is the reference 
+   for rpFindPeriodicStarts() and rpFindApproxStarts() used by the 
+   self-test.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Moved to librepeats
+   16.10.26  Allows substitutions
+*/
+BOOL rpMatchPeriodicAt(const char *sequence, int seqlen, 
+                       PERIODIC *periodic, int offset, BOOL exact)
+{
+   int  i, j, 
+        k = periodic->period,
+        nmismatch = 0;
+   char *inclass = periodic->inclass;
+
+   if(offset + periodic->patlen > seqlen)
+      return(FALSE);
+
+   for(i=0; i<periodic->patlen; i++)
+   {
+      if(((inclass[(unsigned char)sequence[offset+i]] != 0) != 
+          ((i % k) == 0)) &&
+         (++nmismatch > periodic->mismatches))
+         return(FALSE);
+   }
+   
+   if(exact)
+   {
+      /* Another repeat one period before                               */
+      if(offset >= k)
+      {
+         for(j=1; (j<k) && !inclass[(unsigned char)sequence[offset-j]];
+             j++);
+         if((j == k) && inclass[(unsigned char)sequence[offset-k]])
+            return(FALSE);
+      }
+
+      /* Another repeat one period after                                */
+      i = offset + periodic->patlen - 1;
+      if(i + k < seqlen)
+      {
+         for(j=1; (j<k) && !inclass[(unsigned char)sequence[i+j]]; j++);
+         if((j == k) && inclass[(unsigned char)sequence[i+k]])
+            return(FALSE);
+      }
+   }
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>BOOL GrowMatchMasks(MATCHMASKS *masks, size_t need)
+   ---------------------------------------------------
+   I/O:     MATCHMASKS *masks   Masks
+   Input:   size_t     need     Number of words needed in each mask
+   Returns: BOOL                Success? On failure the masks are freed
+
+   Makes sure the masks have at least the required number of words. 
+   The contents are not kept.
+
+   16.10.26  Original (from rpFindPatternStarts())   By: ACRM
+   17.10.26  Returns FALSE rather than exiting if there is no memory
+*/
+static BOOL GrowMatchMasks(MATCHMASKS *masks, size_t need)
+{
+   if(need > masks->nwords)
+   {
+      rpFreeMatchMasks(masks);
+      if(((masks->eq = (uint64_t *)malloc(need * sizeof(uint64_t))) 
+          == NULL) ||
+         ((masks->starts = (uint64_t *)malloc(need * sizeof(uint64_t)))
+          == NULL) ||
+         ((masks->anchors = (uint64_t *)malloc(need * sizeof(uint64_t)))
+          == NULL))
+      {
+         rpFreeMatchMasks(masks);
+         return(FALSE);
+      }
+      masks->nwords = need;
+   }
+   return(TRUE);
+}
+
+/************************************************************************/
+/*>void BuildResidueMask(const char *sequence, int seqlen, char ch, 
+                         uint64_t *mask)
+   ---------------------------------------------------------
+   Input:   char     *sequence  The sequence
+            int      seqlen     Length of the sequence
+            char     ch         Residue to look for
+   Output:  uint64_t *mask      Bit i set if sequence[i]==ch. Must have
+                                (seqlen+63)/64 words
+
+   Builds the residue mask 64 residues at a time using AVX2 or SSE2 
+   compares where the compiler supports them, with a scalar loop for
+   other machines and for the end of the sequence.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Moved to librepeats
+*/
+static void BuildResidueMask(const char *sequence, int seqlen, char ch, 
+                             uint64_t *mask)
+{
+   int      i = 0, j;
+   uint64_t word;
+
+#if defined(__AVX2__)
+   __m256i  chv = _mm256_set1_epi8(ch);
+   uint32_t lo, hi;
+
+   for(; i+64<=seqlen; i+=64)
+   {
+      lo = (uint32_t)_mm256_movemask_epi8(
+              _mm256_cmpeq_epi8(
+                 _mm256_loadu_si256((const __m256i *)(sequence+i)), chv));
+      hi = (uint32_t)_mm256_movemask_epi8(
+              _mm256_cmpeq_epi8(
+                 _mm256_loadu_si256((const __m256i *)(sequence+i+32)), chv));
+      mask[i/64] = (uint64_t)lo | ((uint64_t)hi << 32);
+   }
+#elif defined(__SSE2__)
+   __m128i  chv = _mm_set1_epi8(ch);
+   int      k;
+
+   for(; i+64<=seqlen; i+=64)
+   {
+      word = 0;
+      for(k=0; k<4; k++)
+      {
+         word |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+                    _mm_cmpeq_epi8(
+                       _mm_loadu_si128((const __m128i *)(sequence+i+16*k)), 
+                       chv)) << (16*k);
+      }
+      mask[i/64] = word;
+   }
+#endif
+
+   for(; i<seqlen; i+=64)
+   {
+      word = 0;
+      for(j=0; (j<64) && (i+j<seqlen); j++)
+      {
+         if(sequence[i+j] == ch)
+            word |= (uint64_t)1 << j;
+      }
+      mask[i/64] = word;
+   }
+}
+
+/************************************************************************/
+/*>void BuildClassMask(const char *sequence, int seqlen, 
+                       PERIODIC *periodic, MATCHMASKS *masks, 
+                       size_t need)
+   ------------------------------------------------------------
+   Input:   char       *sequence  The sequence
+            int        seqlen     Length of the sequence
+            PERIODIC   *periodic  The compiled pattern
+            size_t     need       Words to fill in masks->eq
+   I/O:     MATCHMASKS *masks     masks->eq is set for every residue in
+                                  the class; masks->starts is used as
+                                  work space
+
+   Builds the residue mask for the whole class of a PERIODIC pattern,
+   clearing the words after the end of the sequence. The masks must 
+   already have need words.
+
+   16.10.26  Original (from rpFindPeriodicStarts())   By: ACRM
+*/
+static void BuildClassMask(const char *sequence, int seqlen, 
+                           PERIODIC *periodic, MATCHMASKS *masks, 
+                           size_t need)
+{
+   uint64_t *eq    = masks->eq;
+   size_t   w, 
+            nwords = (seqlen + 63) / 64;
+   int      i;
+
+   BuildResidueMask(sequence, seqlen, periodic->residues[0], eq);
+   for(i=1; periodic->residues[i]; i++)
+   {
+      BuildResidueMask(sequence, seqlen, periodic->residues[i], 
+                       masks->starts);
+      for(w=0; w<nwords; w++)
+         eq[w] |= masks->starts[w];
+   }
+   for(w=nwords; w<need; w++)
+      eq[w] = 0;
+}
+
+/************************************************************************/
+/*>uint64_t MaskBits(uint64_t *mask, int bit)
+   ------------------------------------------
+   Input:   uint64_t *mask      A residue mask
+            int      bit        Offset of the first bit
+   Returns: uint64_t            64 bits of the mask starting at bit
+
+   Extracts 64 bits from a mask starting at any offset. Negative 
+   offsets are allowed and give zeros for the bits before the start. 
+   The mask must have a word beyond the last one used.
+
+   16.10.26  Original   By: ACRM
+   16.10.26  Allows offsets before -64
+*/
+static uint64_t MaskBits(uint64_t *mask, int bit)
+{
+   int      shift;
+   uint64_t bits;
+
+   if(bit <= -64)
+      return(0);
+   if(bit < 0)
+      return(mask[0] << (-bit));
+   
+   shift = bit & 63;
+   bits  = mask[bit >> 6] >> shift;
+   if(shift)
+      bits |= mask[(bit >> 6) + 1] << (64 - shift);
+   return(bits);
+}
+
+/************************************************************************/
+/*>int rpNextStart(uint64_t *starts, int nwords, int offset)
+   ---------------------------------------------------------
+   Input:   uint64_t *starts    Mask of pattern starts
+            int      nwords     Number of words in the mask
+            int      offset     Offset to search from
+   Returns: int                 Offset of the next start at or after
+                                offset (-1 if none)
+
+   Finds the next set bit in a mask of pattern starts
+
+   16.10.26  Original   By: ACRM
+*/
+int rpNextStart(uint64_t *starts, int nwords, int offset)
+{
+   int      w = offset >> 6,
+            bit;
+   uint64_t word;
+
+   if(w >= nwords)
+      return(-1);
+   
+   word = starts[w] & ((~(uint64_t)0) << (offset & 63));
+   while(!word)
+   {
+      if(++w >= nwords)
+         return(-1);
+      word = starts[w];
+   }
+
+#ifdef __GNUC__
+   bit = __builtin_ctzll(word);
+#else
+   for(bit=0; !(word & ((uint64_t)1 << bit)); bit++);
+#endif
+
+   return(64*w + bit);
+}
+
+/************************************************************************/
+/*>int rpCountBits(uint64_t word)
+   ------------------------------
+   Input:   uint64_t word       A word
+   Returns: int                 Number of bits set
+
+   Counts the bits set in a word
+
+   16.10.26  Original   By: ACRM
+*/
+int rpCountBits(uint64_t word)
+{
+#ifdef __GNUC__
+   return(__builtin_popcountll(word));
+#else
+   int n;
+   
+   for(n=0; word; n++)
+      word &= word - 1;
+   return(n);
+#endif
+}
+
+/************************************************************************/
+/*>void rpFreeMatchMasks(MATCHMASKS *masks)
+   ----------------------------------------
+   I/O:     MATCHMASKS *masks   Masks to free
+
+   Frees the memory used by the pattern masks
+
+   16.10.26  Original   By: ACRM
+*/
+void rpFreeMatchMasks(MATCHMASKS *masks)
+{
+   free(masks->eq);
+   free(masks->starts);
+   free(masks->anchors);
+   masks->eq      = NULL;
+   masks->starts  = NULL;
+   masks->anchors = NULL;
+   masks->nwords  = 0;
+}
+
+/************************************************************************/
+/* takes a sequence, a pattern and the offset into the sequence
+   where the pattern was found. Checks if this is a sub pattern
+   i.e. the pattern continues before or after the identified 
+   place
+*/
+BOOL rpCheckBounds(const char *sequence, int seqlen, const char *pattern, 
+                   int patlen, int offset)
+{
+   char ch;
+
+   ch     = pattern[0];
+
+   /* Check the N terminus                                              */
+   if(offset >= 2)
+   {
+      if((sequence[offset-1] != ch) &&
+         (sequence[offset-2] == ch))
+      {
+         return(FALSE);
+      }
+   }
+   else if(offset == 1)
+   {
+      if(sequence[offset-1] == ch)
+      {
+         return(FALSE);
+      }
+   }
+   
+   /* Check the C terminus                                              */
+   if((seqlen - (offset+patlen)) >= 2)
+   {
+      if((sequence[offset+patlen]   != ch) &&
+         (sequence[offset+patlen+1] == ch))
+      {
+         return(FALSE);
+      }
+   }
+   else if ((seqlen - (offset+patlen)) == 1)
+   {
+      if(sequence[offset+patlen] == ch)
+      {
+         return(FALSE);
+      }
+   }
+   
+
+   return(TRUE);
+}
+
@@ -0,0 +1,102 @@
+/*************************************************************************
+
+   Program:    librepeats
+   File:       librepeats.h
+
+   Version:    V1.3
+   Date:       17.10.26
+   Function:   Scan sequences for indirect repeats
+
+   Copyright:  (c) UCL / Dr. Andrew C. R. Martin 2026
+   Author:     Dr. Andrew C. R. Martin
+   Address:    Biomolecular Structure & Modelling Unit,
+               Institute of Structural & Molecular Biology,
+               University College,
+               Gower Street,
+               London.
+               WC1E 6BT.
+   EMail:      andrew.martin@ucl.ac.uk
+               andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain, but it may be copied
+   according to the conditions laid out in the accompanying file
+   COPYING.DOC
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If someone
+   else breaks this code, I don't want to be blamed for code that does not
+   work!
+
+   The code may not be sold commercially or included as part of a
+   commercial product except as described in the file COPYING.DOC.
+
+**************************************************************************
+
+   Description:
+   ============
+   See librepeats.c
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0   16.10.26 Original   By: ACRM
+   V1.1   16.10.26 Added FindApproxStarts() and PERIODIC.mismatches
+   V1.2   17.10.26 GrowMatchMasks() returns FALSE rather than exiting
+   V1.3   17.10.26 Only the rp*() API is given here. The kernels shared
+                   with indirectrepeats are in rpkernels.h. RPSCANNER is
+                   opaque and BOOL is replaced by int so bioplib is not
+                   needed
+
+*************************************************************************/
+#ifndef _LIBREPEATS_H
+#define _LIBREPEATS_H
+
+/************************************************************************/
+/* Includes
+*/
+#include <stddef.h>
+
+/************************************************************************/
+/* Type definitions
+*/
+typedef struct
+{
+   int  pattern,     /* Pattern index from rpAddPattern() or, with no
+                        patterns, residue*(maxpat+1) + occurrences      */
+        start,       /* Offset of the first residue of the match        */
+        end,         /* Offset of the last residue of the match         */
+        exact;       /* Non-zero if this is an exact match              */
+}  RPHIT;
+
+/* Called for each hit with the data given to rpScan(). Returns 0 to 
+   stop the scan
+*/
+typedef int (*RPHITFUNC)(const RPHIT *hit, void *data);
+
+/* Defined in librepeats.c                                              */
+typedef struct rpscanner RPSCANNER;
+
+/************************************************************************/
+/* Prototypes
+*/
+RPSCANNER *rpNewScanner(int exact);
+void rpFreeScanner(RPSCANNER *scanner);
+int rpAddPattern(RPSCANNER *scanner, const char *pattern);
+int rpSetRuns(RPSCANNER *scanner, int minpat, int maxpat);
+int rpNumPatterns(RPSCANNER *scanner);
+int rpPatternName(RPSCANNER *scanner, int pattern, char *name,
+                  size_t size);
+long rpScan(RPSCANNER *scanner, const char *sequence, size_t seqlen,
+            RPHITFUNC func, void *data);
+long rpScanInto(RPSCANNER *scanner, const char *sequence, size_t seqlen,
+                RPHIT *hits, long maxhits);
+
+#endif
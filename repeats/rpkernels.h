@@ -0,0 +1,123 @@
+/*************************************************************************
+
+   Program:    librepeats
+   File:       rpkernels.h
+
+   Version:    V1.0
+   Date:       17.10.26
+   Function:   Matching kernels shared by librepeats and indirectrepeats
+
+   Copyright:  (c) UCL / Dr. Andrew C. R. Martin 2026
+   Author:     Dr. Andrew C. R. Martin
+   Address:    Biomolecular Structure & Modelling Unit,
+               Institute of Structural & Molecular Biology,
+               University College,
+               Gower Street,
+               London.
+               WC1E 6BT.
+   EMail:      andrew.martin@ucl.ac.uk
+               andrew@bioinf.org.uk
+
+**************************************************************************
+
+   This program is not in the public domain, but it may be copied
+   according to the conditions laid out in the accompanying file
+   COPYING.DOC
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified. If someone
+   else breaks this code, I don't want to be blamed for code that does not
+   work!
+
+   The code may not be sold commercially or included as part of a
+   commercial product except as described in the file COPYING.DOC.
+
+**************************************************************************
+
+   Description:
+   ============
+   The lower level matching functions from librepeats.c which are also
+   used by indirectrepeats. These are not part of the library API and
+   programs using the library should only include librepeats.h
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0   17.10.26 Original. Split from librepeats.h   By: ACRM
+
+*************************************************************************/
+#ifndef _RPKERNELS_H
+#define _RPKERNELS_H
+
+/************************************************************************/
+/* Includes
+*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bioplib/SysDefs.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define MAXAA      24
+#define NRESIDUES  20
+#define RESIDUES   "ACDEFGHIKLMNPQRSTVWY"
+#define SPACER     'X'          /* Spacer residue in a pattern          */
+#define MAXMISMATCHES 8         /* Most substitutions in an approximate
+                                   match                                */
+
+/************************************************************************/
+/* Type definitions
+*/
+typedef struct
+{
+   uint64_t *eq,     /* Bit set where the sequence is the residue       */
+            *starts, /* Bit set where the pattern starts                */
+            *anchors;/* Bit set where the residue is followed by a
+                        spacer free of the residue (PERIODIC only)      */
+   size_t   nwords;  /* Allocated words in each mask                    */
+}  MATCHMASKS;
+
+typedef struct
+{
+   char residues[MAXAA+1],   /* Residues allowed at repeated positions  */
+        inclass[256];        /* Non-zero for each residue in residues   */
+   int  period,              /* Offset from one repeated residue to the
+                                next                                    */
+        nrepeat,             /* Number of repeated residues             */
+        patlen,              /* Length of the pattern                   */
+        mismatches;          /* Substitutions allowed (see 
+                                rpFindApproxStarts())                   */
+}  PERIODIC;
+
+/************************************************************************/
+/* Prototypes
+*/
+void rpBuildResidueIndex(int *resindex);
+BOOL rpNextRun(const int *resindex, const char *sequence, int seqlen,
+               int *pos, int *res, int *len, BOOL *exact);
+int rpFindPatternStarts(const char *sequence, int seqlen,
+                        const char *pattern, int patlen, BOOL exact,
+                        MATCHMASKS *masks);
+int rpFindPeriodicStarts(const char *sequence, int seqlen,
+                         PERIODIC *periodic, BOOL exact, 
+                         MATCHMASKS *masks);
+int rpFindApproxStarts(const char *sequence, int seqlen, 
+                       PERIODIC *periodic, BOOL exact, MATCHMASKS *masks);
+int rpCompilePattern(const char *pattern, PERIODIC *periodic);
+BOOL rpMatchPeriodicAt(const char *sequence, int seqlen,
+                       PERIODIC *periodic, int offset, BOOL exact);
+BOOL rpCheckBounds(const char *sequence, int seqlen, const char *pattern,
+                   int patlen, int offset);
+int rpNextStart(uint64_t *starts, int nwords, int offset);
+int rpCountBits(uint64_t word);
+void rpFreeMatchMasks(MATCHMASKS *masks);
+
+#endif